@@ -0,0 +1,66 @@
+#ifndef __WSA_DDC_H__
+#define __WSA_DDC_H__
+
+#include "kiss_fft.h"
+#include "thinkrf_stdint.h"
+#include "wsa_worker_pool.h"
+
+/// the fraction of the output bandwidth the filter passes unattenuated
+#define WSA_DDC_PASSBAND 0.8
+
+/// how much the default filter attenuates whatever would alias into the 
+/// passband, in dB
+#define WSA_DDC_STOPBAND_ATTENUATION 80.0
+
+/// a host side digital down converter: mixes one sub-band of a capture to 
+/// DC, low pass filters it and decimates it.  Each ddc keeps its own 
+/// state, so any number of them can follow sub-bands of the same stream.
+struct wsa_ddc {
+	/// the sample rate of the input, in Hz
+	double sample_rate;
+
+	/// the frequency shifted to DC, relative to the input's baseband, in Hz
+	double fshift;
+
+	/// the input samples per output sample
+	uint32_t decimation;
+
+	/// the low pass filter
+	uint32_t ntaps;
+	float *taps;
+
+	/// the nco: its current value and the rotation applied every sample
+	double nco_r;
+	double nco_i;
+	double step_r;
+	double step_i;
+
+	/// the last ntaps - 1 mixed samples, followed by the block being filtered
+	kiss_fft_cpx *work;
+	uint32_t work_size;
+
+	/// the position of the next output relative to the start of the next block
+	uint32_t next_output;
+};
+
+struct wsa_ddc *wsa_ddc_new(double sample_rate, double fshift, uint32_t decimation, uint32_t ntaps);
+void wsa_ddc_free(struct wsa_ddc *ddc);
+void wsa_ddc_reset(struct wsa_ddc *ddc);
+double wsa_ddc_output_rate(struct wsa_ddc *ddc);
+int32_t wsa_ddc_output_size(struct wsa_ddc *ddc, int32_t len);
+int32_t wsa_ddc_process(struct wsa_ddc *ddc,
+					kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					int32_t len,
+					kiss_fft_cpx *out,
+					int32_t out_size);
+int32_t wsa_ddc_process_bank(struct wsa_worker_pool *pool,
+					struct wsa_ddc **ddcs,
+					int32_t count,
+					kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					int32_t len,
+					kiss_fft_cpx **outs,
+					int32_t *out_counts);
+
+#endif
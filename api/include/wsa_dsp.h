@@ -1,6 +1,7 @@
 
 #include "kiss_fft.h"
 #include "thinkrf_stdint.h"
+#include "wsa_fft.h"
 
 
 // ////////////////////////////////////////////////////////////////////////////
@@ -18,29 +19,140 @@ void correct_dc_offset(int32_t samples_per_packet,
 					kiss_fft_scalar * idata,
 					kiss_fft_scalar * qdata);
 
+// ////////////////////////////////////////////////////////////////////////////
+// Correction Section                                                        //
+// ////////////////////////////////////////////////////////////////////////////
+
+/// streaming DC offset and I/Q gain/phase imbalance correction.  The 
+/// estimates are running averages updated once per block.
+struct psd_iq_corrector {
+	/// how much each block moves the estimates, 0 to 1
+	float alpha;
+
+	/// the number of blocks the estimates are made of
+	uint32_t blocks;
+
+	/// the estimates: DC offsets, powers of I and Q, and their correlation
+	double dc_i;
+	double dc_q;
+	double power_i;
+	double power_q;
+	double cross;
+
+	/// the correction applied to the next block
+	float offset_i;
+	float offset_q;
+	float phase;
+	float gain;
+};
+
+void psd_iq_corrector_init(struct psd_iq_corrector *corrector, float alpha);
+void psd_iq_corrector_reset(struct psd_iq_corrector *corrector);
+void psd_iq_correct(struct psd_iq_corrector *corrector, kiss_fft_scalar *idata, kiss_fft_scalar *qdata, int32_t len);
+void psd_iq_correct_i16(struct psd_iq_corrector *corrector,
+					int16_t const *i16_buffer,
+					int16_t const *q16_buffer,
+					kiss_fft_scalar scale,
+					kiss_fft_scalar *idata,
+					kiss_fft_scalar *qdata,
+					int32_t len);
+
 // ////////////////////////////////////////////////////////////////////////////
 // Windowing Section                                                         //
 // ////////////////////////////////////////////////////////////////////////////
 
 void window_hanning_scalar_array(kiss_fft_scalar *values, int len);
 void window_hanning_cpx(kiss_fft_cpx *value, int len, int index);
+void window_hanning_table(kiss_fft_scalar *window, int len);
+void window_hanning_fixed(int16_t *window, int len);
 
 // ////////////////////////////////////////////////////////////////////////////
 // Spectral Inversion Section                                                //
 // ////////////////////////////////////////////////////////////////////////////
 
 void reverse_cpx(kiss_fft_cpx *value, int len);
+void reverse_scalar_array(kiss_fft_scalar *values, int len);
 
 // ////////////////////////////////////////////////////////////////////////////
 // FFT Section                                                               //
 // ////////////////////////////////////////////////////////////////////////////
 int rfft(kiss_fft_scalar *idata, kiss_fft_cpx *fftdata, int len);
+void rfft_execute(struct wsa_fft_plan *plan, kiss_fft_scalar *idata, kiss_fft_cpx *fftdata);
 kiss_fft_scalar cpx_to_power(kiss_fft_cpx value);
 kiss_fft_scalar power_to_logpower(kiss_fft_scalar value);
 
+// ////////////////////////////////////////////////////////////////////////////
+// Averaging Section                                                         //
+// ////////////////////////////////////////////////////////////////////////////
+
+/// trace modes used to combine consecutive spectra
+#define WSA_TRACE_CLEAR_WRITE 0
+#define WSA_TRACE_AVERAGE 1
+#define WSA_TRACE_RMS 2 // same as WSA_TRACE_AVERAGE, see psd_trace_update()
+#define WSA_TRACE_EXPONENTIAL 3
+#define WSA_TRACE_MAX_HOLD 4
+#define WSA_TRACE_MIN_HOLD 5
+
+int32_t psd_welch_segment_count(int32_t len, int32_t fftlen, int32_t hop);
+int32_t psd_welch_accumulate(struct wsa_fft_plan *plan,
+					kiss_fft_scalar *idata,
+					kiss_fft_scalar const *window,
+					int32_t fftlen,
+					int32_t hop,
+					int32_t first,
+					int32_t count,
+					kiss_fft_scalar *segment,
+					kiss_fft_cpx *fftout,
+					kiss_fft_scalar *power);
+int32_t psd_welch_accumulate_fixed(struct wsa_fft_plan *plan,
+					int16_t *i16data,
+					int32_t *i32data,
+					int16_t const *window,
+					int32_t fftlen,
+					int32_t hop,
+					int32_t first,
+					int32_t count,
+					int32_t *segment,
+					int32_t *fftout,
+					kiss_fft_scalar *power);
+int32_t psd_welch_accumulate_cpx(struct wsa_fft_plan *plan,
+					kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					kiss_fft_scalar const *window,
+					int32_t fftlen,
+					int32_t hop,
+					int32_t first,
+					int32_t count,
+					kiss_fft_cpx *segment,
+					kiss_fft_cpx *fftout,
+					kiss_fft_scalar *power);
+int32_t psd_welch_power(kiss_fft_scalar *idata,
+					int32_t len,
+					int32_t fftlen,
+					int32_t hop,
+					kiss_fft_scalar *segment,
+					kiss_fft_cpx *fftout,
+					kiss_fft_scalar *power);
+int32_t psd_welch_power_cpx(struct wsa_fft_plan *plan,
+					kiss_fft_cpx *data,
+					kiss_fft_scalar const *window,
+					int32_t len,
+					int32_t fftlen,
+					int32_t hop,
+					kiss_fft_cpx *segment,
+					kiss_fft_cpx *fftout,
+					kiss_fft_scalar *power);
+void psd_trace_update(uint32_t trace_mode,
+					uint32_t weight,
+					float *acc,
+					float *trace,
+					float const *power,
+					uint32_t len);
+
 // ////////////////////////////////////////////////////////////////////////////
 // Utility Functions                                                         //
 // ////////////////////////////////////////////////////////////////////////////
+uint32_t psd_max_index(float const *data, uint32_t len);
 int16_t psd_peak_find(uint64_t fstart, 
 				uint64_t fstop, 
 				uint32_t rbw, 
@@ -59,4 +171,130 @@ int16_t psd_calculate_absolute_power(uint32_t start_bin,
 								uint32_t stop_bin,
 								float *spectral_data,
 								uint32_t data_size,
-								float *absolute_power);
\ No newline at end of file
+								float *absolute_power);
+
+// ////////////////////////////////////////////////////////////////////////////
+// Spectrum Index Section                                                    //
+// ////////////////////////////////////////////////////////////////////////////
+
+/// occupied bandwidth definitions
+#define PSD_OBW_SYMMETRIC 0
+#define PSD_OBW_PERCENTILE 1
+
+/// the linear power of a spectrum and its running sum, built once so that
+/// power queries over any range of bins take constant time
+struct psd_spectrum_index {
+	/// the number of bins indexed
+	uint32_t len;
+
+	/// the number of bins the buffers can hold
+	uint32_t capacity;
+
+	/// the power of each bin, in mW
+	float *linear;
+
+	/// prefix[i] is the power of bins 0 to i - 1, in mW (len + 1 values)
+	double *prefix;
+};
+
+struct psd_spectrum_index *psd_spectrum_index_new(uint32_t capacity);
+void psd_spectrum_index_free(struct psd_spectrum_index *index);
+int16_t psd_spectrum_index_reserve(struct psd_spectrum_index *index, uint32_t capacity);
+int16_t psd_spectrum_index_build(struct psd_spectrum_index *index, float const *spectral_data, uint32_t data_size);
+int16_t psd_index_absolute_power(struct psd_spectrum_index const *index,
+								uint32_t start_bin,
+								uint32_t stop_bin,
+								double *absolute_power);
+int16_t psd_index_channel_power(struct psd_spectrum_index const *index,
+								uint32_t start_bin,
+								uint32_t stop_bin,
+								float *channel_power);
+int16_t psd_index_acpr(struct psd_spectrum_index const *index,
+								uint32_t main_start,
+								uint32_t main_stop,
+								uint32_t adj_start,
+								uint32_t adj_stop,
+								float *acpr);
+int16_t psd_index_occupied_bandwidth(struct psd_spectrum_index const *index,
+								uint32_t start_bin,
+								uint32_t stop_bin,
+								float occupied_percentage,
+								uint32_t method,
+								uint32_t *obw_start,
+								uint32_t *obw_stop);
+int16_t psd_occupied_bandwidth(uint64_t fstart,
+								uint64_t fstop,
+								uint32_t data_size,
+								float const *spectral_data,
+								float occupied_percentage,
+								uint32_t method,
+								uint64_t *occupied_bw);
+
+// ////////////////////////////////////////////////////////////////////////////
+// Peak Search Section                                                       //
+// ////////////////////////////////////////////////////////////////////////////
+
+/// peak interpolation methods
+#define PSD_PEAK_INTERP_NONE 0
+#define PSD_PEAK_INTERP_PARABOLIC 1
+#define PSD_PEAK_INTERP_GAUSSIAN 2
+
+/// a peak found by psd_peak_search()
+struct psd_peak {
+	/// the bin holding the peak
+	uint32_t bin;
+
+	/// the interpolated frequency, in Hz
+	double freq;
+
+	/// the interpolated level, in dBm
+	float power;
+};
+
+int16_t psd_peak_search(uint64_t fstart,
+				uint64_t fstop,
+				uint32_t data_size,
+				float const *spectral_data,
+				float threshold,
+				float excursion,
+				uint32_t min_separation,
+				uint32_t interpolation,
+				uint32_t max_peaks,
+				struct psd_peak *peaks,
+				uint32_t *peak_count);
+
+// ////////////////////////////////////////////////////////////////////////////
+// Envelope Section                                                          //
+// ////////////////////////////////////////////////////////////////////////////
+
+int32_t psd_envelope(kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					int32_t len,
+					int32_t interval,
+					float reflevel,
+					float *rms,
+					float *peak);
+int32_t psd_envelope_cpx(kiss_fft_cpx const *data,
+					int32_t len,
+					int32_t interval,
+					float reflevel,
+					float *rms,
+					float *peak);
+
+// ////////////////////////////////////////////////////////////////////////////
+// Output Section                                                            //
+// ////////////////////////////////////////////////////////////////////////////
+
+/// formats a spectrum can be kept in besides float dBm
+#define WSA_OUTPUT_FLOAT 0
+#define WSA_OUTPUT_CDB16 1
+#define WSA_OUTPUT_U8 2
+
+/// the finest 8 bit step psd_u8_range() picks, in dB
+#define PSD_U8_MIN_SCALE 0.01f
+
+void psd_pack_cdb16(float const *data, uint32_t len, int16_t *packed);
+void psd_unpack_cdb16(int16_t const *packed, uint32_t len, float *data);
+void psd_u8_range(float const *data, uint32_t len, float *offset, float *scale);
+void psd_pack_u8(float const *data, uint32_t len, float offset, float scale, uint8_t *packed);
+void psd_unpack_u8(uint8_t const *packed, uint32_t len, float offset, float scale, float *data);
@@ -170,6 +170,7 @@
 #define WSA_ERR_SWEEPMODEUNDEF (LNEG_NUM - 3013)
 #define WSA_ERR_INVSWEEPSTARTID (LNEG_NUM - 3014)
 #define WSA_ERR_SWEEPWHILESTREAMING (LNEG_NUM - 3015)
+#define WSA_ERR_SWEEPGROUPRBW (LNEG_NUM - 3016)
 
 // ///////////////////////////////
 // STREAM ERRORS  				//
@@ -183,6 +184,9 @@
 // DSP ERRORS    				//
 // ///////////////////////////////
 #define WSA_ERR_INVCHPOWERRANGE	(LNEG_NUM - 4500)
+#define WSA_ERR_INVFFTBACKEND	(LNEG_NUM - 4501)
+#define WSA_ERR_INVMASK	(LNEG_NUM - 4502)
+#define WSA_ERR_INVSTREAMTYPE	(LNEG_NUM - 4503)
 
 
 // ///////////////////////////////
@@ -0,0 +1,45 @@
+#ifndef __WSA_FFT_H__
+#define __WSA_FFT_H__
+
+#include "kiss_fft.h"
+#include "thinkrf_stdint.h"
+
+// ////////////////////////////////////////////////////////////////////////////
+// FFT Backend Section                                                       //
+// ////////////////////////////////////////////////////////////////////////////
+
+/// the fft libraries plans can be made with. Kiss is always built in,
+/// FFTW is built in when the library is compiled with WSA_FFT_FFTW defined
+#define WSA_FFT_BACKEND_KISS 0
+#define WSA_FFT_BACKEND_FFTW 1
+#define WSA_FFT_BACKEND_COUNT 2
+
+/// plan types. The fixed point real transforms always use kiss, take
+/// int16_t or int32_t samples and scale their output by 1 / nfft
+#define WSA_FFT_COMPLEX 0
+#define WSA_FFT_COMPLEX_INVERSE 1
+#define WSA_FFT_REAL 2
+#define WSA_FFT_REAL_FIXED16 3
+#define WSA_FFT_REAL_FIXED32 4
+
+struct wsa_fft_plan;
+
+uint8_t wsa_fft_backend_available(uint32_t backend);
+const char *wsa_fft_backend_name(uint32_t backend);
+int16_t wsa_fft_set_backend(uint32_t backend);
+uint32_t wsa_fft_get_backend(void);
+
+struct wsa_fft_plan *wsa_fft_plan_new(int32_t nfft, uint32_t type);
+struct wsa_fft_plan *wsa_fft_plan_backend_new(uint32_t backend, int32_t nfft, uint32_t type);
+void wsa_fft_plan_free(struct wsa_fft_plan *plan);
+int32_t wsa_fft_plan_size(struct wsa_fft_plan *plan);
+uint32_t wsa_fft_plan_type(struct wsa_fft_plan *plan);
+
+void wsa_fft_execute(struct wsa_fft_plan *plan, kiss_fft_cpx *in, kiss_fft_cpx *out);
+void wsa_fft_execute_real(struct wsa_fft_plan *plan, kiss_fft_scalar *in, kiss_fft_cpx *out);
+void wsa_fft_execute_real_fixed16(struct wsa_fft_plan *plan, int16_t *in, int16_t *out);
+void wsa_fft_execute_real_fixed32(struct wsa_fft_plan *plan, int32_t *in, int32_t *out);
+
+int16_t wsa_fft_benchmark(uint32_t backend, int32_t nfft, int32_t iterations, double *usec);
+
+#endif
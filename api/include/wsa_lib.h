@@ -200,6 +200,8 @@
 #define WSA_RFE_SH_STRING   "SH"
 #define WSA_RFE_SHN_STRING  "SHN"
 #define WSA_RFE_ZIF_STRING  "ZIF"
+#define WSA_RFE_DECSH_STRING  "DECSH"
+#define WSA_RFE_DECSHN_STRING "DECSHN"
 
 #define  WSA_CURRENT_LAN_CONFIG "CURRENT"
 #define  WSA_OPTION_LAN_CONFIG ""
@@ -240,6 +242,9 @@ struct wsa_time {
 	uint64_t psec;
 };
 
+/// picoseconds in a second, the resolution of a VRT time stamp
+#define WSA_PSEC_PER_SEC 1000000000000ULL
+
 //structure to hold the header of a packet
 struct wsa_vrt_packet_header {
 	uint8_t pkt_count;
@@ -352,6 +357,10 @@ int32_t wsa_decode_zif_frame(uint8_t *data_buf, int16_t *i_buf, int16_t *q_buf,
 
 int32_t wsa_decode_i_only_frame(uint32_t stream_id, uint8_t *data_buf, int16_t *i16_buf, int32_t *i32_buf, int32_t sample_size);
 
+void wsa_time_add_samples(struct wsa_time const *start, int64_t offset, double sample_rate, 
+						  struct wsa_time *time_stamp);
+double wsa_time_diff(struct wsa_time const *end, struct wsa_time const *start);
+
 int16_t wsa_read_status(struct wsa_device *dev, char *output);
 
 const char *wsa_get_error_msg(int16_t err_code);
@@ -0,0 +1,71 @@
+#ifndef __WSA_MASK_H__
+#define __WSA_MASK_H__
+
+#include "thinkrf_stdint.h"
+#include "wsa_sweep_device.h"
+
+/// the limit lines of a mask
+#define WSA_MASK_UPPER 1
+#define WSA_MASK_LOWER 2
+
+/// a corner of a limit line
+struct wsa_mask_point {
+	/// the frequency, in Hz
+	uint64_t freq;
+
+	/// the limit, in dBm
+	float power;
+};
+
+/// a run of adjacent bins that fail a mask
+struct wsa_mask_violation {
+	/// the first and last failing bins
+	uint32_t start_bin;
+	uint32_t stop_bin;
+
+	/// the frequencies of the first and last failing bins, in Hz
+	uint64_t fstart;
+	uint64_t fstop;
+
+	/// the limit lines failed (WSA_MASK_UPPER | WSA_MASK_LOWER)
+	uint32_t limits;
+
+	/// the bin furthest past a limit, and by how far, in dB (negative)
+	uint32_t worst_bin;
+	float worst_margin;
+};
+
+/// a spectrum mask: piecewise linear upper and lower limit lines, and 
+/// the per bin limits they were last compiled into.  The limits are only 
+/// rebuilt when the mask is evaluated on a different frequency axis.
+struct wsa_mask {
+	/// the limit lines, in increasing frequency order
+	struct wsa_mask_point *upper;
+	uint32_t upper_count;
+	struct wsa_mask_point *lower;
+	uint32_t lower_count;
+
+	/// the axis the limits were compiled for, len is 0 if they are stale
+	uint64_t fstart;
+	uint64_t fstop;
+	uint32_t len;
+
+	/// the compiled limits, one per bin
+	float *upper_limit;
+	float *lower_limit;
+	uint32_t capacity;
+};
+
+struct wsa_mask *wsa_mask_new(void);
+void wsa_mask_free(struct wsa_mask *mask);
+int16_t wsa_mask_set_limit(struct wsa_mask *mask, uint32_t limit, 
+	struct wsa_mask_point const *points, uint32_t count);
+int16_t wsa_mask_compile(struct wsa_mask *mask, uint64_t fstart, uint64_t fstop, uint32_t len);
+int16_t wsa_mask_check(struct wsa_mask *mask, float const *data, 
+	struct wsa_mask_violation *violations, uint32_t max_violations,
+	uint32_t *violation_count, float *worst_margin);
+int16_t wsa_mask_evaluate(struct wsa_mask *mask, struct wsa_power_spectrum_config *cfg,
+	struct wsa_mask_violation *violations, uint32_t max_violations,
+	uint32_t *violation_count, float *worst_margin);
+
+#endif
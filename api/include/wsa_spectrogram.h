@@ -0,0 +1,91 @@
+#ifndef __WSA_SPECTROGRAM_H__
+#define __WSA_SPECTROGRAM_H__
+
+#include "kiss_fft.h"
+#include "thinkrf_stdint.h"
+#include "wsa_lib.h"
+#include "wsa_fft.h"
+
+/// a spectrogram: a ring of fixed width rows of power, in dBm, each the
+/// average of one or more spectra.  Rows are numbered from 0 as they are
+/// written; the last capacity rows stay in the ring, where readers can 
+/// use them in place with wsa_spectrogram_get_row().
+struct wsa_spectrogram {
+	/// the number of values in each row
+	uint32_t width;
+
+	/// the number of rows the ring holds
+	uint32_t capacity;
+
+	/// the number of spectra averaged into each row
+	uint32_t decimation;
+
+	/// the rows, one after the other, and the time stamp of each
+	float *rows;
+	struct wsa_time *time_stamps;
+
+	/// the number of rows written, row n is at n % capacity
+	uint64_t rows_written;
+
+	/// the linear power of the row being averaged, and of how many spectra
+	double *accumulator;
+	uint32_t accumulated;
+	struct wsa_time row_time;
+
+	/// stream input only: the fft, and the spectra it takes from the samples
+	uint32_t fft_size;
+	uint32_t hop;
+	uint8_t iq;
+	double sample_rate;
+	struct wsa_fft_plan *plan;
+
+	/// stream input only: samples not yet part of a complete spectrum, and the time of the first
+	kiss_fft_scalar *pending;
+	kiss_fft_cpx *pending_cpx;
+	uint32_t pending_len;
+	uint32_t pending_size;
+	struct wsa_time pending_time;
+
+	/// stream input only: the window, and scratch space for the fft
+	kiss_fft_scalar *window;
+	kiss_fft_scalar *segment;
+	kiss_fft_cpx *segment_cpx;
+	kiss_fft_cpx *fftout;
+	kiss_fft_scalar *power;
+
+	/// stream input only: buffers packets are decoded into by wsa_spectrogram_read_stream()
+	int16_t *i16_buffer;
+	int16_t *q16_buffer;
+	int32_t *i32_buffer;
+	kiss_fft_scalar *idata;
+	kiss_fft_scalar *qdata;
+	uint32_t decode_size;
+	float reflevel;
+};
+
+struct wsa_spectrogram *wsa_spectrogram_new(uint32_t width, uint32_t capacity, uint32_t decimation);
+struct wsa_spectrogram *wsa_spectrogram_new_stream(uint32_t fft_size,
+					uint32_t overlap,
+					uint8_t iq,
+					double sample_rate,
+					uint32_t capacity,
+					uint32_t decimation);
+void wsa_spectrogram_free(struct wsa_spectrogram *sg);
+void wsa_spectrogram_reset(struct wsa_spectrogram *sg);
+int32_t wsa_spectrogram_add_spectrum(struct wsa_spectrogram *sg, 
+					float const *data, 
+					uint32_t len, 
+					struct wsa_time const *time_stamp);
+int32_t wsa_spectrogram_add_samples(struct wsa_spectrogram *sg,
+					kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					uint32_t len,
+					struct wsa_time const *time_stamp,
+					float reflevel);
+int32_t wsa_spectrogram_read_stream(struct wsa_device *dev, 
+					struct wsa_spectrogram *sg, 
+					int32_t samples_per_packet, 
+					int32_t packets);
+float *wsa_spectrogram_get_row(struct wsa_spectrogram *sg, uint64_t row, struct wsa_time *time_stamp);
+
+#endif
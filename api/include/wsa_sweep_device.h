@@ -3,6 +3,23 @@
 
 #include "wsa_lib.h"
 #include "wsa_api.h"
+#include "wsa_worker_pool.h"
+
+/// the memory a capture works in, private to wsa_sweep_device.c
+struct wsa_capture_workspace;
+
+/// a sweep plan shared by configs, private to wsa_sweep_device.c
+struct wsa_shared_plan;
+
+/// the state of an adaptive sweep, private to wsa_sweep_device.c
+struct wsa_adaptive_sweep;
+
+struct wsa_power_spectrum_config;
+
+/// receives the part of the buffer a step of a capture filled in: len 
+/// bins from fstart to fstop
+typedef void (*wsa_power_spectrum_step_callback)(struct wsa_power_spectrum_config *cfg, uint32_t step,
+	uint64_t fstart, uint64_t fstop, float const *data, uint32_t len, void *arg);
 
 /// a struct for holding all the info about captured data being received
 
@@ -43,11 +60,32 @@ struct wsa_sweep_plan {
 	/// packets per block
 	uint32_t ppb;
 
+	/// decimation rate, 1 for none
+	uint32_t decimation;
+
 	/// indicate whether DD mode is required
 	uint8_t dd_mode;
 
 };
 
+/// how long a device takes to sweep, fitted to the time stamps of the 
+/// sweeps it has done.  A step takes retune_time, plus packet_time for 
+/// each packet, plus byte_time for each byte of samples, plus the time 
+/// to capture the samples.
+struct wsa_sweep_timing {
+	double retune_time;
+	double packet_time;
+	double byte_time;
+
+	/// the number of steps observed
+	uint32_t steps;
+
+	/// the least squares sums the model is fitted from
+	double zz[3][3];
+	double zy[3];
+	double z[3];
+};
+
 /// this struct represents our sweep device object
 struct wsa_sweep_device {
 	/// a reference to the wsa we're connected to
@@ -57,6 +95,9 @@ struct wsa_sweep_device {
 	struct {
 		uint8_t attenuator;
 	} device_settings;
+
+	/// the sweep time model of the device
+	struct wsa_sweep_timing timing;
 };
 
 /// struct representing a configuration that we are going to sweep with and capture power spectrum data
@@ -76,9 +117,17 @@ struct wsa_power_spectrum_config {
 
 	/// the rbw
 	uint64_t rbw;
+
+	/// the rbw that was asked for (rbw holds the one the plan achieves)
+	uint64_t requested_rbw;
 			
-	/// a sweep plan that achieves capturing the spectrum requested
+	/// a sweep plan that achieves capturing the spectrum requested, shared 
+	/// with other configs for the same sweep so it must not be changed
 	struct wsa_sweep_plan *sweep_plan;
+	struct wsa_shared_plan *shared_plan;
+
+	/// the frequency of each bin of buf, shared like the plan
+	double const *freqs;
 
 	/// how many packets will this sweep plan generate
 	uint32_t packet_total;
@@ -89,18 +138,91 @@ struct wsa_power_spectrum_config {
 	
 	/// The number of samples per packet
 	uint32_t samples_per_packet;
+
+	/// The number of samples in each FFT
+	uint32_t fft_size;
+
+	/// the decimation the device applies to the samples, 1 for none
+	uint32_t decimation;
+
+	/// the minimum number of overlapping segments averaged in each block (welch)
+	uint32_t welch_segments;
+
+	/// the overlap between consecutive segments, in percent
+	uint32_t welch_overlap;
+
+	/// how consecutive captures are combined into buf (WSA_TRACE_*)
+	uint32_t trace_mode;
+
+	/// the averaging length of the trace mode
+	uint32_t trace_average;
+
+	/// the number of captures combined into buf since the last reset
+	uint32_t trace_count;
+
+	/// the fixed point fft used on the raw samples (16 or 32 bits), 0 for floating point
+	uint32_t fixed_point;
+
+	/// the number of threads computing spectra
+	uint32_t threads;
+
+	/// read the next blocks while the workers compute the previous ones
+	uint8_t pipeline;
+
+	/// the workers computing spectra
+	struct wsa_worker_pool *worker_pool;
+
+	/// the memory captures work in, sized when the config is allocated 
+	/// or its settings change
+	struct wsa_capture_workspace *workspace;
+
+	/// called as each step of a capture is done
+	wsa_power_spectrum_step_callback step_callback;
+	void *step_arg;
+
+	/// the steps in a sweep, and how many the current capture has done
+	uint32_t step_count;
+	uint32_t steps_done;
+
+	/// re-sweep only the steps that changed or are stale, NULL to sweep them all
+	struct wsa_adaptive_sweep *adaptive;
+
 	/// the float buffer 
 	float *buf;
 
+	/// the buffer a continuous capture writes the next sweep to
+	float *back_buf;
+
+	/// the trace as linear power, which the trace modes combine captures in
+	float *trace_acc;
+
+	/// the format of the packed copy of buf kept alongside it (WSA_OUTPUT_*)
+	uint32_t output_format;
+
+	/// buf in centi-dB, for WSA_OUTPUT_CDB16
+	int16_t *cdb16_buf;
+
+	/// buf in 8 bit steps of u8_scale dB above u8_offset dBm, for WSA_OUTPUT_U8
+	uint8_t *u8_buf;
+	float u8_offset;
+	float u8_scale;
+
+	/// pick u8_offset and u8_scale from each trace
+	uint8_t u8_auto;
+
 	// determine if the reference level needs to be modified
 	uint8_t modify_ref;
 	/// the length of the float buffer
 	uint32_t buflen;
 };
 
+/// receives each spectrum of a continuous capture, returns nonzero to stop
+typedef int (*wsa_power_spectrum_callback)(struct wsa_power_spectrum_config *cfg, float *buf, uint32_t sweep, void *arg);
 
 struct wsa_sweep_device *wsa_sweep_device_new(struct wsa_device *device);
 void wsa_sweep_device_free(struct wsa_sweep_device *sweepdev);
+void wsa_sweep_timing_reset(struct wsa_sweep_device *sweep_device);
+double wsa_estimate_sweep_time(struct wsa_sweep_device *sweep_device, struct wsa_power_spectrum_config *cfg);
 void wsa_sweep_device_set_attenuator(struct wsa_sweep_device *sweep_device, unsigned int val);
 int wsa_power_spectrum_alloc(
 	struct wsa_sweep_device *sweep_device,
@@ -111,10 +233,28 @@ int wsa_power_spectrum_alloc(
 	struct wsa_power_spectrum_config **pscfg
 );
 void wsa_power_spectrum_free(struct wsa_power_spectrum_config *cfg);
+void wsa_sweep_plan_cache_clear(void);
+int wsa_power_spectrum_set_averaging(struct wsa_power_spectrum_config *cfg, uint32_t segments, uint32_t overlap);
+int wsa_power_spectrum_set_trace_mode(struct wsa_power_spectrum_config *cfg, uint32_t trace_mode, uint32_t average);
+void wsa_power_spectrum_reset_trace(struct wsa_power_spectrum_config *cfg);
+int wsa_power_spectrum_set_threads(struct wsa_power_spectrum_config *cfg, uint32_t threads);
+int wsa_power_spectrum_set_pipeline(struct wsa_power_spectrum_config *cfg, uint8_t enable);
+int wsa_power_spectrum_set_fixed_point(struct wsa_power_spectrum_config *cfg, uint32_t bits);
+int wsa_power_spectrum_set_output(struct wsa_power_spectrum_config *cfg, uint32_t format, float offset, float scale);
+void wsa_power_spectrum_set_step_callback(struct wsa_power_spectrum_config *cfg, 
+	wsa_power_spectrum_step_callback callback, void *arg);
+int wsa_power_spectrum_set_adaptive(struct wsa_power_spectrum_config *cfg, 
+	float threshold, uint32_t max_age, uint32_t refresh);
 void wsa_configure_sweep(struct wsa_sweep_device *sweep_device, struct wsa_power_spectrum_config *pscfg);
 int wsa_capture_power_spectrum(
 	struct wsa_sweep_device *sweep_device,
 	struct wsa_power_spectrum_config *pscfg,
 	float **buf
 );
+int wsa_capture_power_spectrum_continuous(
+	struct wsa_sweep_device *sweep_device,
+	struct wsa_power_spectrum_config *pscfg,
+	wsa_power_spectrum_callback callback,
+	void *arg
+);
 #endif
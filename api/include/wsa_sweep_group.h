@@ -0,0 +1,49 @@
+#ifndef __WSA_SWEEP_GROUP_H__
+#define __WSA_SWEEP_GROUP_H__
+
+#include "thinkrf_stdint.h"
+#include "wsa_sweep_device.h"
+
+/// a sweep group: one span swept by several devices at once.  The span is
+/// split into consecutive sub spans, one per device, each swept with its
+/// own power spectrum config; the captures run concurrently and their
+/// spectra are joined, in frequency order, into one buffer.
+struct wsa_sweep_group {
+	/// the number of devices
+	uint32_t count;
+
+	/// the devices and their configs, in the order of their sub spans
+	struct wsa_sweep_device **devices;
+	struct wsa_power_spectrum_config **cfgs;
+
+	/// where the spectrum of each config starts in the buffer
+	uint32_t *offsets;
+
+	/// the result of the last capture of each config
+	int *results;
+
+	/// the span, and the rbw every config was planned with
+	uint64_t fstart;
+	uint64_t fstop;
+	uint64_t rbw;
+
+	/// the joined spectrum, and the frequency of each of its bins
+	float *buf;
+	double *freqs;
+	uint32_t buflen;
+};
+
+int wsa_sweep_group_new(
+	struct wsa_sweep_device **devices,
+	uint32_t count,
+	uint64_t fstart,
+	uint64_t fstop,
+	uint32_t rbw,
+	char const *mode,
+	struct wsa_sweep_group **groupp
+);
+void wsa_sweep_group_free(struct wsa_sweep_group *group);
+void wsa_sweep_group_configure(struct wsa_sweep_group *group);
+int wsa_sweep_group_capture(struct wsa_sweep_group *group, float **buf);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __WSA_THREAD_H__
+#define __WSA_THREAD_H__
+
+#include "thinkrf_stdint.h"
+
+// ////////////////////////////////////////////////////////////////////////////
+// OS specific threading primitives, implemented in src-<platform>           //
+// ////////////////////////////////////////////////////////////////////////////
+
+struct wsa_thread;
+struct wsa_mutex;
+struct wsa_cond;
+
+struct wsa_thread *wsa_thread_new(void (*func)(void *), void *arg);
+void wsa_thread_join(struct wsa_thread *thread);
+
+struct wsa_mutex *wsa_mutex_new(void);
+void wsa_mutex_free(struct wsa_mutex *mutex);
+void wsa_mutex_lock(struct wsa_mutex *mutex);
+void wsa_mutex_unlock(struct wsa_mutex *mutex);
+struct wsa_mutex *wsa_mutex_global(void);
+
+struct wsa_cond *wsa_cond_new(void);
+void wsa_cond_free(struct wsa_cond *cond);
+void wsa_cond_wait(struct wsa_cond *cond, struct wsa_mutex *mutex);
+void wsa_cond_signal(struct wsa_cond *cond);
+void wsa_cond_broadcast(struct wsa_cond *cond);
+
+int32_t wsa_cpu_count(void);
+double wsa_monotonic_time(void);
+
+#endif
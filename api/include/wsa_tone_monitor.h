@@ -0,0 +1,80 @@
+#ifndef __WSA_TONE_MONITOR_H__
+#define __WSA_TONE_MONITOR_H__
+
+#include "kiss_fft.h"
+#include "thinkrf_stdint.h"
+#include "wsa_lib.h"
+#include "wsa_fft.h"
+
+/// how a tone monitor measures its tones
+#define WSA_TONE_AUTO 0
+#define WSA_TONE_GOERTZEL 1
+#define WSA_TONE_FFT 2
+
+/// measures the power at a set of fixed frequencies in blocks of samples,
+/// either with one goertzel filter per tone or with a full fft, both 
+/// hanning windowed and calibrated like the power spectrum
+struct wsa_tone_monitor {
+	/// the sample rate, in Hz
+	double sample_rate;
+
+	/// the samples measured in each block
+	uint32_t block_len;
+
+	/// 1 for I/Q samples, 0 for real samples
+	uint8_t iq;
+
+	/// the frequencies, relative to the baseband of the samples, in Hz
+	uint32_t tone_count;
+	double *freqs;
+
+	/// the method asked for, and the one in use (WSA_TONE_GOERTZEL or WSA_TONE_FFT)
+	uint32_t method;
+	uint32_t active_method;
+
+	/// the window applied to each block
+	kiss_fft_scalar *window;
+
+	/// goertzel: the coefficients of each tone, and the filter states
+	double *coef;
+	double *cos_w;
+	double *sin_w;
+	double *state;
+	double *dft;
+
+	/// fft: the transform and its scratch space
+	struct wsa_fft_plan *plan;
+	kiss_fft_scalar *segment;
+	kiss_fft_cpx *segment_cpx;
+	kiss_fft_cpx *fftout;
+	double *spectrum;
+
+	/// the block read by wsa_tone_monitor_capture(), and its decode buffers
+	kiss_fft_scalar *idata;
+	kiss_fft_scalar *qdata;
+	int16_t *i16_buffer;
+	int16_t *q16_buffer;
+	int32_t *i32_buffer;
+	kiss_fft_scalar *packet_i;
+	kiss_fft_scalar *packet_q;
+	uint32_t packet_size;
+};
+
+struct wsa_tone_monitor *wsa_tone_monitor_new(double sample_rate, 
+					uint32_t block_len, 
+					uint8_t iq,
+					double const *freqs, 
+					uint32_t tone_count);
+void wsa_tone_monitor_free(struct wsa_tone_monitor *monitor);
+int16_t wsa_tone_monitor_set_method(struct wsa_tone_monitor *monitor, uint32_t method);
+int16_t wsa_tone_monitor_process(struct wsa_tone_monitor *monitor,
+					kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					uint32_t len,
+					float reflevel,
+					float *power);
+int16_t wsa_tone_monitor_capture(struct wsa_device *dev, 
+					struct wsa_tone_monitor *monitor, 
+					float *power);
+
+#endif
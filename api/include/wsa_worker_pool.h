@@ -0,0 +1,19 @@
+#ifndef __WSA_WORKER_POOL_H__
+#define __WSA_WORKER_POOL_H__
+
+#include "thinkrf_stdint.h"
+
+/// a job run by the pool: index is the item to process, worker identifies
+/// the thread running it (0 to size - 1) so it can use its own scratch memory
+typedef void (*wsa_worker_job)(void *arg, int32_t index, int32_t worker);
+
+struct wsa_worker_pool;
+
+struct wsa_worker_pool *wsa_worker_pool_new(int32_t size);
+void wsa_worker_pool_free(struct wsa_worker_pool *pool);
+int32_t wsa_worker_pool_size(struct wsa_worker_pool *pool);
+void wsa_worker_pool_start(struct wsa_worker_pool *pool, wsa_worker_job job, void *arg, int32_t count);
+void wsa_worker_pool_wait(struct wsa_worker_pool *pool);
+void wsa_worker_pool_run(struct wsa_worker_pool *pool, wsa_worker_job job, void *arg, int32_t count);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __WSA_ZERO_SPAN_H__
+#define __WSA_ZERO_SPAN_H__
+
+#include "thinkrf_stdint.h"
+#include "wsa_lib.h"
+#include "wsa_ddc.h"
+
+/// one point of a zero span trace: the power over an interval of samples
+struct wsa_envelope_point {
+	/// the time of the first sample of the interval
+	struct wsa_time time_stamp;
+
+	/// the rms and peak power over the interval, in dBm
+	float rms;
+	float peak;
+};
+
+int16_t wsa_zero_span_capture(struct wsa_device *dev,
+				double sample_rate,
+				struct wsa_ddc *ddc,
+				int32_t interval,
+				struct wsa_envelope_point *points,
+				int32_t max_points,
+				int32_t *point_count);
+
+#endif
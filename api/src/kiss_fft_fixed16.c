@@ -0,0 +1,45 @@
+/*
+ * builds a 16 bit fixed point copy of kiss_fft and kiss_fftr.  The kiss
+ * symbols are renamed so this can be linked next to the floating point
+ * build, and only the small wrapper below is used by wsa_fft.c.
+ */
+#include "thinkrf_stdint.h"
+
+#define FIXED_POINT 16
+
+#define kiss_fft_alloc kiss_fft16_alloc
+#define kiss_fft kiss_fft16
+#define kiss_fft_stride kiss_fft16_stride
+#define kiss_fft_cleanup kiss_fft16_cleanup
+#define kiss_fft_next_fast_size kiss_fft16_next_fast_size
+#define kf_work kf16_work
+#define kf_factor kf16_factor
+#define kiss_fftr_alloc kiss_fftr16_alloc
+#define kiss_fftr kiss_fftr16
+#define kiss_fftri kiss_fftri16
+
+#include "kiss_fft.c"
+#include "kiss_fftr.c"
+
+/**
+ * allocates a 16 bit fixed point real fft
+ *
+ * @param nfft - the fft length, must be even
+ * @return - the kiss config, free it with free(), NULL on failure
+ */
+void *wsa_kiss_fixed16_alloc(int nfft)
+{
+	return kiss_fftr_alloc(nfft, 0, 0, 0);
+}
+
+/**
+ * runs a 16 bit fixed point real fft.  The output is scaled by 1 / nfft.
+ *
+ * @param cfg - a config from wsa_kiss_fixed16_alloc()
+ * @param in - nfft real values
+ * @param out - nfft / 2 + 1 complex values, stored as interleaved real and imaginary parts
+ */
+void wsa_kiss_fixed16_real(void *cfg, const int16_t *in, int16_t *out)
+{
+	kiss_fftr((kiss_fftr_cfg) cfg, in, (kiss_fft_cpx *) out);
+}
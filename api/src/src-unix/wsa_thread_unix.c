@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wsa_thread.h"
+
+struct wsa_thread {
+	pthread_t handle;
+	void (*func)(void *);
+	void *arg;
+};
+
+struct wsa_mutex {
+	pthread_mutex_t handle;
+};
+
+struct wsa_cond {
+	pthread_cond_t handle;
+};
+
+// guards library wide state, see wsa_mutex_global()
+static struct wsa_mutex wsa_global_mutex = { PTHREAD_MUTEX_INITIALIZER };
+
+// pthread entry point, calls the user function
+static void *wsa_thread_main(void *arg)
+{
+	struct wsa_thread *thread = (struct wsa_thread *) arg;
+
+	thread->func(thread->arg);
+	return NULL;
+}
+
+/**
+ * Start a new thread running func(arg)
+ *
+ * @param func - the function to run
+ * @param arg - the argument passed to func
+ *
+ * @return the thread, or NULL on failure
+ */
+struct wsa_thread *wsa_thread_new(void (*func)(void *), void *arg)
+{
+	struct wsa_thread *thread;
+
+	thread = malloc(sizeof(struct wsa_thread));
+	if (thread == NULL)
+		return NULL;
+
+	thread->func = func;
+	thread->arg = arg;
+	if (pthread_create(&thread->handle, NULL, wsa_thread_main, thread) != 0) {
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+/**
+ * Wait for a thread to finish and free it
+ *
+ * @param thread - the thread to join
+ */
+void wsa_thread_join(struct wsa_thread *thread)
+{
+	pthread_join(thread->handle, NULL);
+	free(thread);
+}
+
+struct wsa_mutex *wsa_mutex_new(void)
+{
+	struct wsa_mutex *mutex;
+
+	mutex = malloc(sizeof(struct wsa_mutex));
+	if (mutex == NULL)
+		return NULL;
+
+	pthread_mutex_init(&mutex->handle, NULL);
+	return mutex;
+}
+
+void wsa_mutex_free(struct wsa_mutex *mutex)
+{
+	pthread_mutex_destroy(&mutex->handle);
+	free(mutex);
+}
+
+void wsa_mutex_lock(struct wsa_mutex *mutex)
+{
+	pthread_mutex_lock(&mutex->handle);
+}
+
+void wsa_mutex_unlock(struct wsa_mutex *mutex)
+{
+	pthread_mutex_unlock(&mutex->handle);
+}
+
+/**
+ * Retrieve the mutex guarding library wide state.  It exists for the 
+ * life of the process, so it can be used before anything is set up, and 
+ * must never be freed.
+ *
+ * @return the global mutex
+ */
+struct wsa_mutex *wsa_mutex_global(void)
+{
+	return &wsa_global_mutex;
+}
+
+struct wsa_cond *wsa_cond_new(void)
+{
+	struct wsa_cond *cond;
+
+	cond = malloc(sizeof(struct wsa_cond));
+	if (cond == NULL)
+		return NULL;
+
+	pthread_cond_init(&cond->handle, NULL);
+	return cond;
+}
+
+void wsa_cond_free(struct wsa_cond *cond)
+{
+	pthread_cond_destroy(&cond->handle);
+	free(cond);
+}
+
+void wsa_cond_wait(struct wsa_cond *cond, struct wsa_mutex *mutex)
+{
+	pthread_cond_wait(&cond->handle, &mutex->handle);
+}
+
+void wsa_cond_signal(struct wsa_cond *cond)
+{
+	pthread_cond_signal(&cond->handle);
+}
+
+void wsa_cond_broadcast(struct wsa_cond *cond)
+{
+	pthread_cond_broadcast(&cond->handle);
+}
+
+/**
+ * Retrieve the number of processors available
+ *
+ * @return the number of online processors, at least 1
+ */
+int32_t wsa_cpu_count(void)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (count < 1)
+		return 1;
+
+	return (int32_t) count;
+}
+
+/**
+ * reads a clock that only ever moves forward, for timing things
+ *
+ * @return the time in seconds from some fixed point
+ */
+double wsa_monotonic_time(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <windows.h>
+#include <process.h>
+
+#include "wsa_thread.h"
+
+struct wsa_thread {
+	HANDLE handle;
+	void (*func)(void *);
+	void *arg;
+};
+
+struct wsa_mutex {
+	CRITICAL_SECTION handle;
+};
+
+struct wsa_cond {
+	CONDITION_VARIABLE handle;
+};
+
+// guards library wide state, see wsa_mutex_global()
+static struct wsa_mutex wsa_global_mutex;
+static INIT_ONCE wsa_global_mutex_once = INIT_ONCE_STATIC_INIT;
+
+// InitOnceExecuteOnce callback, sets up the global mutex
+static BOOL CALLBACK wsa_global_mutex_init(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+	InitializeCriticalSection(&wsa_global_mutex.handle);
+	return TRUE;
+}
+
+// _beginthreadex entry point, calls the user function
+static unsigned __stdcall wsa_thread_main(void *arg)
+{
+	struct wsa_thread *thread = (struct wsa_thread *) arg;
+
+	thread->func(thread->arg);
+	return 0;
+}
+
+/**
+ * Start a new thread running func(arg)
+ *
+ * @param func - the function to run
+ * @param arg - the argument passed to func
+ *
+ * @return the thread, or NULL on failure
+ */
+struct wsa_thread *wsa_thread_new(void (*func)(void *), void *arg)
+{
+	struct wsa_thread *thread;
+
+	thread = malloc(sizeof(struct wsa_thread));
+	if (thread == NULL)
+		return NULL;
+
+	thread->func = func;
+	thread->arg = arg;
+	thread->handle = (HANDLE) _beginthreadex(NULL, 0, wsa_thread_main, thread, 0, NULL);
+	if (thread->handle == 0) {
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+/**
+ * Wait for a thread to finish and free it
+ *
+ * @param thread - the thread to join
+ */
+void wsa_thread_join(struct wsa_thread *thread)
+{
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+	free(thread);
+}
+
+struct wsa_mutex *wsa_mutex_new(void)
+{
+	struct wsa_mutex *mutex;
+
+	mutex = malloc(sizeof(struct wsa_mutex));
+	if (mutex == NULL)
+		return NULL;
+
+	InitializeCriticalSection(&mutex->handle);
+	return mutex;
+}
+
+void wsa_mutex_free(struct wsa_mutex *mutex)
+{
+	DeleteCriticalSection(&mutex->handle);
+	free(mutex);
+}
+
+void wsa_mutex_lock(struct wsa_mutex *mutex)
+{
+	EnterCriticalSection(&mutex->handle);
+}
+
+void wsa_mutex_unlock(struct wsa_mutex *mutex)
+{
+	LeaveCriticalSection(&mutex->handle);
+}
+
+/**
+ * Retrieve the mutex guarding library wide state.  It exists for the 
+ * life of the process, so it can be used before anything is set up, and 
+ * must never be freed.
+ *
+ * @return the global mutex
+ */
+struct wsa_mutex *wsa_mutex_global(void)
+{
+	InitOnceExecuteOnce(&wsa_global_mutex_once, wsa_global_mutex_init, NULL, NULL);
+	return &wsa_global_mutex;
+}
+
+struct wsa_cond *wsa_cond_new(void)
+{
+	struct wsa_cond *cond;
+
+	cond = malloc(sizeof(struct wsa_cond));
+	if (cond == NULL)
+		return NULL;
+
+	InitializeConditionVariable(&cond->handle);
+	return cond;
+}
+
+void wsa_cond_free(struct wsa_cond *cond)
+{
+	// condition variables don't need to be destroyed on windows
+	free(cond);
+}
+
+void wsa_cond_wait(struct wsa_cond *cond, struct wsa_mutex *mutex)
+{
+	SleepConditionVariableCS(&cond->handle, &mutex->handle, INFINITE);
+}
+
+void wsa_cond_signal(struct wsa_cond *cond)
+{
+	WakeConditionVariable(&cond->handle);
+}
+
+void wsa_cond_broadcast(struct wsa_cond *cond)
+{
+	WakeAllConditionVariable(&cond->handle);
+}
+
+/**
+ * Retrieve the number of processors available
+ *
+ * @return the number of processors, at least 1
+ */
+int32_t wsa_cpu_count(void)
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	if (info.dwNumberOfProcessors < 1)
+		return 1;
+
+	return (int32_t) info.dwNumberOfProcessors;
+}
+
+/**
+ * reads a clock that only ever moves forward, for timing things
+ *
+ * @return the time in seconds from some fixed point
+ */
+double wsa_monotonic_time(void)
+{
+	LARGE_INTEGER now;
+	LARGE_INTEGER freq;
+
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+
+	return (double) now.QuadPart / (double) freq.QuadPart;
+}
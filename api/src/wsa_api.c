@@ -929,8 +929,10 @@ int16_t wsa_read_vrt_packet (struct wsa_device * const dev,
 	else if (header->stream_id == I32_DATA_STREAM_ID || header->stream_id == I16_DATA_STREAM_ID)
 		result = (int16_t) wsa_decode_i_only_frame(header->stream_id, data_buffer, i16_buffer, i32_buffer,  header->samples_per_packet);
 
-	// apply reflevel offset to R5500 if needed
-	if (header->packet_type == IF_PACKET_TYPE){
+	// apply reflevel offset to R5500 if needed, once per digitizer context packet
+	// so that blocks of several data packets don't accumulate the offset
+	if (header->stream_id == DIGITIZER_STREAM_ID &&
+		(digitizer->indicator_field & REF_LEVEL_INDICATOR_MASK) == REF_LEVEL_INDICATOR_MASK){
 		if ((strstr(dev->descr.prod_model, R5500) != NULL)){
 			digitizer->reference_level = digitizer->reference_level - REFLEVEL_OFFSET;
 		}
@@ -991,6 +993,7 @@ int16_t wsa_compute_fft(int32_t const samples_per_packet,
 	kiss_fft_scalar *qdata;
 	kiss_fft_cpx *fftout;
 	kiss_fft_scalar tmpscalar;
+	struct psd_iq_corrector corrector;
 	int16_t result = 0;
 	int32_t i = 0;
 
@@ -998,19 +1001,23 @@ int16_t wsa_compute_fft(int32_t const samples_per_packet,
 	qdata = (float *) malloc(sizeof(float) * MAX_BLOCK_SIZE);
 	fftout = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * MAX_BLOCK_SIZE);
 
-	// window and normalize the data
-	normalize_iq_data(samples_per_packet,
-					stream_id,
-					i16_buffer,
-					q16_buffer,
-					i32_buffer,
-					idata,
-					qdata);
+	// normalize the data; only I is transformed, so for I/Q data only I is
+	// decoded, with its DC offset removed in the same pass.  Every call is
+	// a capture of its own, so the corrector starts afresh.
+	if (stream_id == I16Q16_DATA_STREAM_ID) {
+		psd_iq_corrector_init(&corrector, 1);
+		psd_iq_correct_i16(&corrector, i16_buffer, NULL, 8192, idata, NULL, samples_per_packet);
+	} else {
+		normalize_iq_data(samples_per_packet,
+						stream_id,
+						i16_buffer,
+						q16_buffer,
+						i32_buffer,
+						idata,
+						qdata);
+	}
 	doutf(DHIGH, "In wsa_compute_fft: normalized data\n");
 
-	// correct the DC offset
-	//correct_dc_offset(samples_per_packet, idata, qdata);
-
 	window_hanning_scalar_array(idata, samples_per_packet);
 
 	doutf(DHIGH, "In wsa_compute_fft: applied hanning window\n");
@@ -1179,7 +1186,9 @@ int16_t calculate_channel_power(struct wsa_device *dev,
  * @occupied_percentage - How much of the channel power percentage should be in the occupied bandwidth
  * @mode - A string containing the mode for the measurement
  * @attenuator - An integer to hold the 20dB attenuator's state (0 = on, 1 = off)
- * @occupied_bandwidth -An unsigned 64-bit pointer to hold the frequency (MHz)
+ * @occupied_bandwidth -An unsigned 64-bit pointer to hold the bandwidth (Hz)
+ *
+ * Use psd_occupied_bandwidth() on a spectrum that has already been captured.
  *
  * @return 0 on success or a negative value on error
  */
@@ -1199,14 +1208,7 @@ int16_t calculate_occupied_bandwidth(struct wsa_device *dev,
 	struct wsa_sweep_device *wsa_sweep_dev = &wsa_Sweep_Device;
 	int result = 0;
 	float *psbuf;
-	float perc_abs_power = 0;
-	float abs_power;
-	float tmp_channel_power = 0;
-	float calc_rbw = 0;
-	uint64_t start_freq = fstart + ((fstop - fstart) / 2);
-	uint64_t stop_freq = fstart + ((fstop - fstart) / 2);
-	uint32_t i = 0;
-	float min_point = 0;
+
 	// create the sweep device
 	wsa_sweep_dev = wsa_sweep_device_new(dev);
 	
@@ -1225,40 +1227,15 @@ int16_t calculate_occupied_bandwidth(struct wsa_device *dev,
 	// capture power spectrum
 	wsa_configure_sweep(wsa_sweep_dev, pscfg);
 	result = wsa_capture_power_spectrum(wsa_sweep_dev, pscfg, &psbuf);
-	calc_rbw = (float) (fstop - fstart) / ((uint64_t) pscfg->buflen);
-	
-	// find the minimum of spectrum
-	for (i = 0; i < pscfg->buflen; i++)
-	{
-		if (psbuf[i] < min_point)
-			min_point = (float) abs(psbuf[i]);
-	}
-
-
-	// find minimum point
-	// calculate the total absolute power
-	result = psd_calculate_absolute_power((uint32_t) 0, (uint32_t) pscfg->buflen, psbuf,  pscfg->buflen, &abs_power);
-	
-	perc_abs_power = abs_power * (occupied_percentage / 100);;
-	// find the location where the occupied bandwidth begins
-	i = 1;
-	tmp_channel_power = -50;
 
-	while (tmp_channel_power <= perc_abs_power && i < pscfg->buflen){
-		result = psd_calculate_absolute_power((uint32_t) (((pscfg->buflen) / 2) - i), (uint32_t) (((pscfg->buflen) / 2) + i), psbuf, pscfg->buflen, &tmp_channel_power);
-		i++;
+	// find the band about the center holding the percentage of the power
+	if (result >= 0)
+		result = psd_occupied_bandwidth(fstart, fstop, pscfg->buflen, pscfg->buf, 
+			occupied_percentage, PSD_OBW_SYMMETRIC, occupied_bw);
 
-		start_freq = start_freq -  (uint64_t) calc_rbw;
-		stop_freq = stop_freq +  (uint64_t) calc_rbw;
-		
-	}
-	if (stop_freq > start_freq)
-		*occupied_bw = stop_freq - start_freq;
-	else
-		*occupied_bw = start_freq - stop_freq;
 	wsa_power_spectrum_free(pscfg);
 	wsa_sweep_device_free(wsa_sweep_dev);
-	return 0;
+	return (int16_t) result;
 }
 
 /**
@@ -1759,6 +1736,8 @@ int16_t wsa_get_rfe_input_mode(struct wsa_device *dev, char *mode)
 		(strcmp(mode, WSA_RFE_HDR_STRING)  != 0) &&
 		(strcmp(mode, WSA_RFE_SH_STRING)   != 0) &&
 		(strcmp(mode, WSA_RFE_SHN_STRING)  != 0) &&
+		(strcmp(mode, WSA_RFE_DECSH_STRING) != 0) &&
+		(strcmp(mode, WSA_RFE_DECSHN_STRING) != 0) &&
 		(strcmp(mode, WSA_RFE_IQIN_STRING) != 0)) {
 		return WSA_ERR_INVRFEINPUTMODE;
     }
@@ -1786,6 +1765,8 @@ int16_t wsa_set_rfe_input_mode(struct wsa_device *dev, char const *mode)
 		(strcmp(mode, WSA_RFE_HDR_STRING)  != 0) &&
 		(strcmp(mode, WSA_RFE_SH_STRING)   != 0) &&
 		(strcmp(mode, WSA_RFE_SHN_STRING)  != 0) &&
+		(strcmp(mode, WSA_RFE_DECSH_STRING) != 0) &&
+		(strcmp(mode, WSA_RFE_DECSHN_STRING) != 0) &&
 		(strcmp(mode, WSA_RFE_IQIN_STRING) != 0)) {
 		return WSA_ERR_INVRFEINPUTMODE;
     }
@@ -2509,6 +2490,8 @@ int16_t wsa_get_sweep_rfe_input_mode(struct wsa_device *dev, char *mode)
 		(strcmp(mode, WSA_RFE_HDR_STRING)  != 0) &&
 		(strcmp(mode, WSA_RFE_SH_STRING)   != 0) &&
 		(strcmp(mode, WSA_RFE_SHN_STRING)  != 0) &&
+		(strcmp(mode, WSA_RFE_DECSH_STRING) != 0) &&
+		(strcmp(mode, WSA_RFE_DECSHN_STRING) != 0) &&
 		(strcmp(mode, WSA_RFE_IQIN_STRING) != 0)) {
 		return WSA_ERR_INVRFEINPUTMODE;
     }
@@ -2536,6 +2519,8 @@ int16_t wsa_set_sweep_rfe_input_mode(struct wsa_device *dev, char const *mode)
 		(strcmp(mode, WSA_RFE_HDR_STRING)  != 0) &&
 		(strcmp(mode, WSA_RFE_SH_STRING)   != 0) &&
 		(strcmp(mode, WSA_RFE_SHN_STRING)  != 0) &&
+		(strcmp(mode, WSA_RFE_DECSH_STRING) != 0) &&
+		(strcmp(mode, WSA_RFE_DECSHN_STRING) != 0) &&
 		(strcmp(mode, WSA_RFE_IQIN_STRING) != 0)) {
 		return WSA_ERR_INVRFEINPUTMODE;
     }
@@ -191,6 +191,7 @@ const char *_wsa_get_err_msg(int16_t err_id)
 		{WSA_ERR_SWEEPMODEUNDEF, "WSA returned undefined sweep status"},
 		{WSA_ERR_INVSWEEPSTARTID, "Sweep Start ID is out of bounds"},
 		{WSA_ERR_SWEEPWHILESTREAMING, "Cannot initiate sweep mode while streaming"},
+		{WSA_ERR_SWEEPGROUPRBW, "The devices of a sweep group cannot be planned with the same RBW"},
 		
 		//*****
 		// Stream Errors  
@@ -203,7 +204,10 @@ const char *_wsa_get_err_msg(int16_t err_id)
 		//*****
 		// DSP ERRORS      
 		//*****
-		{WSA_ERR_INVCHPOWERRANGE, "Invalid start/stop ranges for channel power"}
+		{WSA_ERR_INVCHPOWERRANGE, "Invalid start/stop ranges for channel power"},
+		{WSA_ERR_INVFFTBACKEND, "FFT backend is not available in this build"},
+		{WSA_ERR_INVMASK, "Limit line points must be in increasing frequency order"},
+		{WSA_ERR_INVSTREAMTYPE, "The captured data stream does not match the I/Q setting"}
 
 
 	};
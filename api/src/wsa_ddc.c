@@ -0,0 +1,365 @@
+#include <stdlib.h>
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "wsa_ddc.h"
+#include "wsa_error.h"
+#include "wsa_debug.h"
+
+/// the work handed to each thread by wsa_ddc_process_bank()
+struct wsa_ddc_bank_job {
+	struct wsa_ddc **ddcs;
+	kiss_fft_scalar const *idata;
+	kiss_fft_scalar const *qdata;
+	int32_t len;
+	kiss_fft_cpx **outs;
+	int32_t *out_counts;
+};
+
+
+/**
+ * calculates the zeroth order modified bessel function of the first kind,
+ * for the kaiser window
+ *
+ * @param x - the argument
+ * @return - I0(x)
+ */
+static double wsa_ddc_bessel_i0(double x)
+{
+	double sum = 1;
+	double term = 1;
+	int k;
+
+	for (k = 1; k < 50 && term > sum * 1e-12; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+
+/// kaiser's estimates fall about 1 dB short of the attenuation they are 
+/// asked for, so the filters are designed with this much margin
+#define WSA_DDC_DESIGN_ATTENUATION (WSA_DDC_STOPBAND_ATTENUATION + 1.0)
+
+
+/**
+ * calculates how many taps the default filter needs.  The passband ends at
+ * WSA_DDC_PASSBAND of the output nyquist frequency and the stopband starts
+ * where frequencies alias into the passband, at 2 - WSA_DDC_PASSBAND of 
+ * it; kaiser's estimate gives the length that attenuates the stopband by
+ * WSA_DDC_STOPBAND_ATTENUATION over that transition.
+ *
+ * @param decimation - the decimation the filter is for
+ * @return - the number of taps, always odd
+ */
+static uint32_t wsa_ddc_default_taps(uint32_t decimation)
+{
+	// the width of the transition, in cycles per input sample
+	double transition = (1.0 - WSA_DDC_PASSBAND) / decimation;
+	uint32_t ntaps;
+
+	// nothing aliases without decimation
+	if (decimation == 1)
+		return 1;
+
+	ntaps = (uint32_t) ceil((WSA_DDC_DESIGN_ATTENUATION - 7.95) / (14.36 * transition)) + 1;
+
+	return ntaps | 1;
+}
+
+
+/**
+ * designs the low pass filter of a ddc: a kaiser windowed sinc with unity
+ * gain at DC, cut off at the output nyquist frequency, in the middle of 
+ * the transition between the passband and the frequencies that alias into
+ * it.  With the default length it is flat to within 0.001 dB up to 
+ * WSA_DDC_PASSBAND of the output nyquist frequency, 6 dB down at the 
+ * nyquist frequency, and at least WSA_DDC_STOPBAND_ATTENUATION dB down 
+ * from 2 - WSA_DDC_PASSBAND of it.  A shorter filter widens the transition
+ * rather than raising the stopband.
+ *
+ * @param taps - the filter to fill
+ * @param ntaps - the number of taps
+ * @param decimation - the decimation the filter is for
+ */
+static void wsa_ddc_design_filter(float *taps, uint32_t ntaps, uint32_t decimation)
+{
+	double cutoff = 1.0 / (2.0 * decimation);
+	double beta = 0.1102 * (WSA_DDC_DESIGN_ATTENUATION - 8.7);
+	double center = (ntaps - 1) / 2.0;
+	double sum = 0;
+	double x, r, window;
+	uint32_t k;
+
+	for (k = 0; k < ntaps; k++) {
+		x = k - center;
+		if (x == 0)
+			taps[k] = (float) (2 * cutoff);
+		else
+			taps[k] = (float) (sin(2 * M_PI * cutoff * x) / (M_PI * x));
+
+		if (ntaps > 1) {
+			r = x / center;
+			window = wsa_ddc_bessel_i0(beta * sqrt(1 - r * r)) / wsa_ddc_bessel_i0(beta);
+			taps[k] = (float) (taps[k] * window);
+		}
+		sum += taps[k];
+	}
+
+	for (k = 0; k < ntaps; k++)
+		taps[k] = (float) (taps[k] / sum);
+}
+
+
+/**
+ * creates a digital down converter
+ *
+ * @param sample_rate - the sample rate of the input, in Hz
+ * @param fshift - the frequency to move to DC, relative to the input's 
+ *	baseband, in Hz.  For I only data this is between 0 and sample_rate / 2, 
+ *	for I/Q data between -sample_rate / 2 and sample_rate / 2.
+ * @param decimation - the input samples per output sample, 1 or more
+ * @param ntaps - the length of the low pass filter, 0 for the length that 
+ *	attenuates aliases by WSA_DDC_STOPBAND_ATTENUATION (about 25 taps per 
+ *	unit of decimation)
+ * @return - the ddc, or NULL on invalid parameters or failure
+ */
+struct wsa_ddc *wsa_ddc_new(double sample_rate, double fshift, uint32_t decimation, uint32_t ntaps)
+{
+	struct wsa_ddc *ddc;
+
+	if (sample_rate <= 0 || decimation < 1 || fabs(fshift) > sample_rate / 2)
+		return NULL;
+
+	if (ntaps == 0)
+		ntaps = wsa_ddc_default_taps(decimation);
+
+	ddc = malloc(sizeof(struct wsa_ddc));
+	if (ddc == NULL)
+		return NULL;
+
+	ddc->sample_rate = sample_rate;
+	ddc->fshift = fshift;
+	ddc->decimation = decimation;
+	ddc->ntaps = ntaps;
+	ddc->step_r = cos(-2 * M_PI * fshift / sample_rate);
+	ddc->step_i = sin(-2 * M_PI * fshift / sample_rate);
+	ddc->work = NULL;
+	ddc->work_size = 0;
+	ddc->taps = malloc(sizeof(float) * ntaps);
+	if (ddc->taps == NULL) {
+		free(ddc);
+		return NULL;
+	}
+
+	wsa_ddc_design_filter(ddc->taps, ntaps, decimation);
+	wsa_ddc_reset(ddc);
+
+	return ddc;
+}
+
+
+/**
+ * frees a digital down converter
+ *
+ * @param ddc - the ddc to free, may be NULL
+ */
+void wsa_ddc_free(struct wsa_ddc *ddc)
+{
+	if (ddc == NULL)
+		return;
+
+	if (ddc->work)
+		free(ddc->work);
+	free(ddc->taps);
+	free(ddc);
+}
+
+
+/**
+ * forgets the samples seen so far, so the next block is treated as the 
+ * start of a new stream
+ *
+ * @param ddc - the ddc
+ */
+void wsa_ddc_reset(struct wsa_ddc *ddc)
+{
+	ddc->nco_r = 1;
+	ddc->nco_i = 0;
+	ddc->next_output = 0;
+
+	if (ddc->work)
+		memset(ddc->work, 0, sizeof(kiss_fft_cpx) * (ddc->ntaps - 1));
+}
+
+
+/**
+ * retrieves the sample rate of the ddc's output
+ *
+ * @param ddc - the ddc
+ * @return - the output sample rate, in Hz
+ */
+double wsa_ddc_output_rate(struct wsa_ddc *ddc)
+{
+	return ddc->sample_rate / ddc->decimation;
+}
+
+
+/**
+ * calculates how many output samples a block of input can produce
+ *
+ * @param ddc - the ddc
+ * @param len - the number of input samples
+ * @return - the size the output buffer given to wsa_ddc_process() needs
+ */
+int32_t wsa_ddc_output_size(struct wsa_ddc *ddc, int32_t len)
+{
+	return (len / (int32_t) ddc->decimation) + 1;
+}
+
+
+/**
+ * mixes, filters and decimates a block of samples.  Blocks are treated as
+ * one continuous stream until wsa_ddc_reset() is called, so a stream can 
+ * be processed in blocks of any size.
+ *
+ * The output is complex, at wsa_ddc_output_rate().  A real input tone of 
+ * amplitude A comes out with amplitude A / 2, the same level the real fft
+ * of the input would show, so the spectrum of the output is calibrated 
+ * the same way as the spectrum of the input.
+ *
+ * @param ddc - the ddc
+ * @param idata - the normalized I samples
+ * @param qdata - the normalized Q samples, NULL for I only data
+ * @param len - the number of input samples
+ * @param out - where to store the output samples
+ * @param out_size - the size of out, at least wsa_ddc_output_size(ddc, len)
+ * @return - the number of output samples, or negative on error
+ */
+int32_t wsa_ddc_process(struct wsa_ddc *ddc,
+					kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					int32_t len,
+					kiss_fft_cpx *out,
+					int32_t out_size)
+{
+	uint32_t history = ddc->ntaps - 1;
+	uint32_t total = history + (uint32_t) len;
+	uint32_t i, k, pos;
+	int32_t count = 0;
+	kiss_fft_cpx *work;
+	kiss_fft_cpx *tail;
+	double in_r, in_i;
+	double tmp, norm;
+	float acc_r, acc_i;
+
+	if (len < 0 || out_size < wsa_ddc_output_size(ddc, len))
+		return WSA_ERR_INVCAPTURESIZE;
+
+	// make room for the history and the new block
+	if (ddc->work_size < total) {
+		work = realloc(ddc->work, sizeof(kiss_fft_cpx) * total);
+		if (work == NULL)
+			return WSA_ERR_MALLOCFAILED;
+		if (ddc->work == NULL)
+			memset(work, 0, sizeof(kiss_fft_cpx) * history);
+		ddc->work = work;
+		ddc->work_size = total;
+	}
+	work = ddc->work;
+
+	// mix the block down with the nco
+	for (i = 0; i < (uint32_t) len; i++) {
+		in_r = idata[i];
+		in_i = qdata ? qdata[i] : 0;
+		work[history + i].r = (kiss_fft_scalar) (in_r * ddc->nco_r - in_i * ddc->nco_i);
+		work[history + i].i = (kiss_fft_scalar) (in_r * ddc->nco_i + in_i * ddc->nco_r);
+
+		tmp = ddc->nco_r * ddc->step_r - ddc->nco_i * ddc->step_i;
+		ddc->nco_i = ddc->nco_r * ddc->step_i + ddc->nco_i * ddc->step_r;
+		ddc->nco_r = tmp;
+	}
+
+	// keep the nco on the unit circle
+	norm = sqrt(ddc->nco_r * ddc->nco_r + ddc->nco_i * ddc->nco_i);
+	ddc->nco_r /= norm;
+	ddc->nco_i /= norm;
+
+	// only the outputs that are kept are filtered (the polyphase form of the decimator)
+	for (pos = history + ddc->next_output; pos < total; pos += ddc->decimation) {
+		tail = work + pos - history;
+		acc_r = 0;
+		acc_i = 0;
+		for (k = 0; k < ddc->ntaps; k++) {
+			acc_r += ddc->taps[k] * tail[k].r;
+			acc_i += ddc->taps[k] * tail[k].i;
+		}
+		out[count].r = acc_r;
+		out[count].i = acc_i;
+		count++;
+	}
+	ddc->next_output = pos - total;
+
+	// the end of this block is the history of the next one
+	memmove(work, work + len, sizeof(kiss_fft_cpx) * history);
+
+	return count;
+}
+
+
+// runs one ddc of a bank
+static void wsa_ddc_bank_run(void *arg, int32_t index, int32_t worker)
+{
+	struct wsa_ddc_bank_job *job = (struct wsa_ddc_bank_job *) arg;
+
+	worker = worker;
+	job->out_counts[index] = wsa_ddc_process(job->ddcs[index],
+		job->idata, job->qdata, job->len,
+		job->outs[index], wsa_ddc_output_size(job->ddcs[index], job->len));
+}
+
+
+/**
+ * runs several ddcs on the same block of samples in parallel, one per
+ * sub-band being watched
+ *
+ * @param pool - the workers to use
+ * @param ddcs - the ddcs
+ * @param count - the number of ddcs
+ * @param idata - the normalized I samples
+ * @param qdata - the normalized Q samples, NULL for I only data
+ * @param len - the number of input samples
+ * @param outs - an output buffer for each ddc, of at least wsa_ddc_output_size() samples
+ * @param out_counts - where to store the number of samples (or the error) of each ddc
+ * @return - 0 on success, or the first negative error of the ddcs
+ */
+int32_t wsa_ddc_process_bank(struct wsa_worker_pool *pool,
+					struct wsa_ddc **ddcs,
+					int32_t count,
+					kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					int32_t len,
+					kiss_fft_cpx **outs,
+					int32_t *out_counts)
+{
+	struct wsa_ddc_bank_job job;
+	int32_t i;
+
+	job.ddcs = ddcs;
+	job.idata = idata;
+	job.qdata = qdata;
+	job.len = len;
+	job.outs = outs;
+	job.out_counts = out_counts;
+
+	wsa_worker_pool_run(pool, wsa_ddc_bank_run, &job, count);
+
+	for (i = 0; i < count; i++)
+		if (out_counts[i] < 0)
+			return out_counts[i];
+
+	return 0;
+}
@@ -2,10 +2,15 @@
 #include "thinkrf_stdint.h"
 #include "wsa_lib.h"
 #include "wsa_dsp.h"
+#include "wsa_fft.h"
 #include "wsa_error.h"
 #define _USE_MATH_DEFINES
 #include "math.h"
+#include <float.h>
 #define ENOMEM 4
+
+/// the smallest power converted to dB, to keep silent intervals finite
+#define PSD_MIN_POWER 1e-20f
 // ////////////////////////////////////////////////////////////////////////////
 // Local Functions Section                                                   //
 // ////////////////////////////////////////////////////////////////////////////
@@ -21,6 +26,7 @@ kiss_fft_scalar find_average(int32_t array_size, kiss_fft_scalar * data_array, k
 	}
 	*average = sum / array_size;
 
+	return *average;
 }
 
 kiss_fft_scalar normalize_scalar(kiss_fft_scalar value, kiss_fft_scalar maxval);
@@ -109,12 +115,272 @@ void correct_dc_offset(int32_t samples_per_packet,
 
 	for (i=0; i < samples_per_packet; i++)
 	{
-		idata[i] = idata[i] / i_average;
-		qdata[i] = qdata[i] / i_average;
+		idata[i] = idata[i] - i_average;
+		qdata[i] = qdata[i] - q_average;
 	}
 
 
 }
+
+// ////////////////////////////////////////////////////////////////////////////
+// Correction Section                                                        //
+// ////////////////////////////////////////////////////////////////////////////
+
+/// the samples the corrector sums in float before adding them to the 
+/// double sums
+#define PSD_IQ_CHUNK 1024
+
+/// the sums over a block that the corrector's estimates are updated from
+struct psd_iq_sums {
+	double i;
+	double q;
+	double ii;
+	double qq;
+	double iq;
+};
+
+/**
+ * initializes a streaming DC offset and I/Q imbalance corrector
+ *
+ * @param corrector - the corrector
+ * @param alpha - how much each block moves the estimates, between 0 and 1; 
+ *	1 corrects every block with its own statistics only
+ */
+void psd_iq_corrector_init(struct psd_iq_corrector *corrector, float alpha)
+{
+	if (alpha <= 0 || alpha > 1)
+		alpha = 1;
+
+	corrector->alpha = alpha;
+	psd_iq_corrector_reset(corrector);
+}
+
+/**
+ * forgets the estimates of a corrector, for instance after retuning
+ *
+ * @param corrector - the corrector
+ */
+void psd_iq_corrector_reset(struct psd_iq_corrector *corrector)
+{
+	corrector->blocks = 0;
+	corrector->dc_i = 0;
+	corrector->dc_q = 0;
+	corrector->power_i = 0;
+	corrector->power_q = 0;
+	corrector->cross = 0;
+	corrector->offset_i = 0;
+	corrector->offset_q = 0;
+	corrector->phase = 0;
+	corrector->gain = 1;
+}
+
+/**
+ * folds the sums of a block into the running estimates of a corrector, and
+ * works out the correction for the next block.  Q is made uncorrelated 
+ * with I and scaled to the same power: q' = gain * (q + phase * i).
+ *
+ * @param corrector - the corrector
+ * @param sums - the sums over the block
+ * @param len - the number of samples in the block
+ * @param iq - 1 if the block had Q data
+ */
+static void psd_iq_corrector_update(struct psd_iq_corrector *corrector, struct psd_iq_sums const *sums, int32_t len, int iq)
+{
+	double alpha = (corrector->blocks == 0) ? 1.0 : corrector->alpha;
+	double mean_i = sums->i / len;
+	double mean_q = sums->q / len;
+	double residual;
+
+	corrector->dc_i += alpha * (mean_i - corrector->dc_i);
+	corrector->offset_i = (float) corrector->dc_i;
+	corrector->blocks++;
+	if (!iq)
+		return;
+
+	corrector->dc_q += alpha * (mean_q - corrector->dc_q);
+	corrector->power_i += alpha * (((sums->ii / len) - (mean_i * mean_i)) - corrector->power_i);
+	corrector->power_q += alpha * (((sums->qq / len) - (mean_q * mean_q)) - corrector->power_q);
+	corrector->cross += alpha * (((sums->iq / len) - (mean_i * mean_q)) - corrector->cross);
+	corrector->offset_q = (float) corrector->dc_q;
+
+	// leave the imbalance alone until there's signal to measure it on
+	corrector->phase = 0;
+	corrector->gain = 1;
+	if (corrector->power_i <= 0)
+		return;
+
+	residual = corrector->power_q - ((corrector->cross * corrector->cross) / corrector->power_i);
+	if (residual <= 0)
+		return;
+
+	corrector->phase = (float) (-corrector->cross / corrector->power_i);
+	corrector->gain = (float) sqrt(corrector->power_i / residual);
+}
+
+/**
+ * sums a block of samples for the corrector and corrects it in the same
+ * pass: i' = i - offset_i, q' = gain * (q - offset_q + phase * i').  The 
+ * sums are kept in four float lanes so the compiler can vectorize the 
+ * loop, and added to the double sums every PSD_IQ_CHUNK samples so long 
+ * blocks keep their precision.  The output may be the input.
+ *
+ * @param corrector - the corrector whose current correction is applied
+ * @param iin - the I samples
+ * @param qin - the Q samples, NULL for I only data
+ * @param len - the number of samples
+ * @param iout - where to store the corrected I samples
+ * @param qout - where to store the corrected Q samples, unused for I only data
+ * @param sums - the sums to add the uncorrected samples to
+ */
+static void psd_iq_sum_correct(struct psd_iq_corrector const *corrector, 
+					kiss_fft_scalar const *iin,
+					kiss_fft_scalar const *qin,
+					int32_t len,
+					kiss_fft_scalar *iout,
+					kiss_fft_scalar *qout,
+					struct psd_iq_sums *sums)
+{
+	kiss_fft_scalar offset_i = corrector->offset_i;
+	kiss_fft_scalar offset_q = corrector->offset_q;
+	kiss_fft_scalar phase = corrector->phase;
+	kiss_fft_scalar gain = corrector->gain;
+	kiss_fft_scalar si[4], sq[4], sii[4], sqq[4], siq[4];
+	kiss_fft_scalar i, q;
+	int32_t start, stop, n, k;
+
+	for (start = 0; start < len; start = stop) {
+		stop = (len - start > PSD_IQ_CHUNK) ? start + PSD_IQ_CHUNK : len;
+		for (k = 0; k < 4; k++)
+			si[k] = sq[k] = sii[k] = sqq[k] = siq[k] = 0;
+
+		if (qin == NULL) {
+			for (n = start; n + 4 <= stop; n += 4) {
+				for (k = 0; k < 4; k++) {
+					si[k] += iin[n + k];
+					iout[n + k] = iin[n + k] - offset_i;
+				}
+			}
+			for (; n < stop; n++) {
+				si[0] += iin[n];
+				iout[n] = iin[n] - offset_i;
+			}
+		} else {
+			for (n = start; n + 4 <= stop; n += 4) {
+				for (k = 0; k < 4; k++) {
+					i = iin[n + k];
+					q = qin[n + k];
+					si[k] += i;
+					sq[k] += q;
+					sii[k] += i * i;
+					sqq[k] += q * q;
+					siq[k] += i * q;
+					iout[n + k] = i - offset_i;
+					qout[n + k] = gain * ((q - offset_q) + (phase * (i - offset_i)));
+				}
+			}
+			for (; n < stop; n++) {
+				i = iin[n];
+				q = qin[n];
+				si[0] += i;
+				sq[0] += q;
+				sii[0] += i * i;
+				sqq[0] += q * q;
+				siq[0] += i * q;
+				iout[n] = i - offset_i;
+				qout[n] = gain * ((q - offset_q) + (phase * (i - offset_i)));
+			}
+		}
+
+		for (k = 0; k < 4; k++) {
+			sums->i += si[k];
+			sums->q += sq[k];
+			sums->ii += sii[k];
+			sums->qq += sqq[k];
+			sums->iq += siq[k];
+		}
+	}
+}
+
+/**
+ * removes the DC offset, and the gain and phase imbalance of I/Q data, 
+ * in place.  Each block is corrected with the estimates of the blocks 
+ * before it while its own sums are taken in the same pass, so only the 
+ * first block after a reset is read twice: once for its sums, and once 
+ * to correct it with them.
+ *
+ * @param corrector - the corrector
+ * @param idata - the I samples
+ * @param qdata - the Q samples, NULL for I only data (only the DC offset is removed)
+ * @param len - the number of samples
+ */
+void psd_iq_correct(struct psd_iq_corrector *corrector, kiss_fft_scalar *idata, kiss_fft_scalar *qdata, int32_t len)
+{
+	struct psd_iq_sums sums;
+	uint32_t blocks = corrector->blocks;
+
+	if (len <= 0)
+		return;
+
+	memset(&sums, 0, sizeof(struct psd_iq_sums));
+	psd_iq_sum_correct(corrector, idata, qdata, len, idata, qdata, &sums);
+	psd_iq_corrector_update(corrector, &sums, len, qdata != NULL);
+
+	// with nothing to go on before, the block was left as it was
+	if (blocks == 0)
+		psd_iq_sum_correct(corrector, idata, qdata, len, idata, qdata, &sums);
+}
+
+/**
+ * normalizes 16 bit samples and corrects them, as normalize_iq_data() 
+ * followed by psd_iq_correct(), but a chunk at a time so the samples are
+ * only brought into the cache once
+ *
+ * @param corrector - the corrector
+ * @param i16_buffer - the 16 bit I samples
+ * @param q16_buffer - the 16 bit Q samples, NULL for I only data
+ * @param scale - the full scale of the samples
+ * @param idata - where to store the corrected I samples
+ * @param qdata - where to store the corrected Q samples, unused for I only data
+ * @param len - the number of samples
+ */
+void psd_iq_correct_i16(struct psd_iq_corrector *corrector,
+					int16_t const *i16_buffer,
+					int16_t const *q16_buffer,
+					kiss_fft_scalar scale,
+					kiss_fft_scalar *idata,
+					kiss_fft_scalar *qdata,
+					int32_t len)
+{
+	struct psd_iq_sums sums;
+	uint32_t blocks = corrector->blocks;
+	kiss_fft_scalar inv = 1 / scale;
+	int32_t start, stop, n;
+
+	if (len <= 0)
+		return;
+
+	// normalize a chunk while the last one is still in the cache, then 
+	// sum and correct it there
+	memset(&sums, 0, sizeof(struct psd_iq_sums));
+	for (start = 0; start < len; start = stop) {
+		stop = (len - start > PSD_IQ_CHUNK) ? start + PSD_IQ_CHUNK : len;
+
+		for (n = start; n < stop; n++)
+			idata[n] = i16_buffer[n] * inv;
+		if (q16_buffer)
+			for (n = start; n < stop; n++)
+				qdata[n] = q16_buffer[n] * inv;
+
+		psd_iq_sum_correct(corrector, idata + start, q16_buffer ? qdata + start : NULL, stop - start, 
+			idata + start, q16_buffer ? qdata + start : NULL, &sums);
+	}
+	psd_iq_corrector_update(corrector, &sums, len, q16_buffer != NULL);
+
+	// with nothing to go on before, the block was only normalized
+	if (blocks == 0)
+		psd_iq_sum_correct(corrector, idata, q16_buffer ? qdata : NULL, len, idata, qdata, &sums);
+}
+
 // ////////////////////////////////////////////////////////////////////////////
 // Windowing Section                                                         //
 // ////////////////////////////////////////////////////////////////////////////
@@ -148,6 +414,40 @@ void window_hanning_scalar_array(kiss_fft_scalar *values, int len)
 }
 
 
+/**
+ * fills a table with a hanning window, so segments can be windowed with 
+ * one multiply per sample instead of a cosine
+ *
+ * @param window - the table to fill
+ * @param len - the length of the window
+ */
+void window_hanning_table(kiss_fft_scalar *window, int len)
+{
+	int i;
+
+	for(i=0; i<len; i++) {
+		window[i] = (float) (0.5 * (1 - cosf(2 * M_PI * i / (len - 1))));
+	}
+}
+
+
+/**
+ * fills a table with a hanning window in Q15, used to window integer 
+ * samples before a fixed point fft
+ *
+ * @param window - the table to fill
+ * @param len - the length of the window
+ */
+void window_hanning_fixed(int16_t *window, int len)
+{
+	int i;
+
+	for(i=0; i<len; i++) {
+		window[i] = (int16_t) floor(0.5 + 32767 * 0.5 * (1 - cos(2 * M_PI * i / (len - 1))));
+	}
+}
+
+
 /**
  * performs a hanning window on a complex value in place
  *
@@ -190,54 +490,66 @@ void reverse_cpx(kiss_fft_cpx *value, int len)
 	}
 }
 
+/**
+ * reverses an array of scalar values in place, used to undo spectral 
+ * inversion once a spectrum has been reduced to power values
+ *
+ * @values - a pointer to the array of scalar values
+ * @len - the length of the array
+ */
+void reverse_scalar_array(kiss_fft_scalar *values, int len)
+{
+	int i;
+	kiss_fft_scalar tmpval;
+
+	for (i=0; i<(len/2); i++) {
+		tmpval = values[i];
+		values[i] = values[len - i - 1];
+		values[len - i - 1] = tmpval;
+	}
+}
+
+/**
+ * performs a real fft on some scalar data with an existing plan.  Only the
+ * non negative frequencies are stored, fftdata[0] is DC.
+ *
+ * @param plan - a WSA_FFT_REAL plan of the length of the data
+ * @param idata - the real values to perform the FFT on
+ * @param fftdata - the pointer to put the resulting fft data in, 
+ *		at least len / 2 + 1 values
+ */
+void rfft_execute(struct wsa_fft_plan *plan, kiss_fft_scalar *idata, kiss_fft_cpx *fftdata)
+{
+	wsa_fft_execute_real(plan, idata, fftdata);
+}
+
 /**
  * performs a real fft on some scalar data
  *
  * @param idata - the real values to perform the FFT on
- * @param fftdata - the pointer to put the resulting fft data in
+ * @param fftdata - the pointer to put the resulting fft data in. The 
+ *		non negative frequencies are stored in the first half, and 
+ *		repeated in the second half.
  * @param len - the length of the array
  * @returns negative on error, 0 on success
  */
 int rfft(kiss_fft_scalar *idata, kiss_fft_cpx *fftdata, int len)
 {
-	int i, n;
-	kiss_fft_cfg fftcfg;
-	kiss_fft_cpx *iq;
-	kiss_fft_cpx tmpval;
+	int n;
+	struct wsa_fft_plan *plan;
 
-	iq = malloc(sizeof(kiss_fft_cpx) * len);
-	if (iq == NULL) {
+	plan = wsa_fft_plan_new(len, WSA_FFT_REAL);
+	if (plan == NULL) {
 		fprintf(stderr, "error: out of memory during rfft alloc\n");
 		return -ENOMEM;
 	}
 
-	// copy the real data into an complex iq array
-	for (i=0; i<len; i++) {
-		iq[i].r = idata[i];
-		iq[i].i = 0;
-	}
-
-	fftcfg = kiss_fft_alloc(len, 0, 0, 0);
-	kiss_fft(fftcfg, iq, fftdata);
-	free(fftcfg);
-	free(iq);
+	rfft_execute(plan, idata, fftdata);
+	wsa_fft_plan_free(plan);
 
-	// perform fft shift
+	// keep the layout of the fft shifted complex transform this used to be
 	n = len >> 1;
-	for (i=0; i<n; i++) {
-		tmpval.r = fftdata[i].r;
-		tmpval.i = fftdata[i].i;
-		fftdata[i].r = fftdata[i + n].r;
-		fftdata[i].i = fftdata[i + n].i;
-		fftdata[i + n].r = tmpval.r;
-		fftdata[i + n].i = tmpval.i;
-	}
-
-	// because we did a real fft, half the data is just an image.. get rid of it
-	for (i=0; i<n; i++) {
-		fftdata[i].r = fftdata[i+n].r;
-		fftdata[i].i = fftdata[i+n].i;
-	}
+	memmove(fftdata + n, fftdata, sizeof(kiss_fft_cpx) * n);
 
 	return 0;
 }
@@ -258,9 +570,459 @@ kiss_fft_scalar power_to_logpower(kiss_fft_scalar value) {
 	return  (float) (10 * log10(value));
 }
 
+// ////////////////////////////////////////////////////////////////////////////
+// Averaging Section                                                         //
+// ////////////////////////////////////////////////////////////////////////////
+/**
+ * calculates how many welch segments fit in a block of samples
+ *
+ * @param len - the number of samples in the block
+ * @param fftlen - the length of each segment
+ * @param hop - the distance between the start of consecutive segments
+ * @returns the number of segments, at least 1
+ */
+int32_t psd_welch_segment_count(int32_t len, int32_t fftlen, int32_t hop)
+{
+	if (hop <= 0 || len <= fftlen)
+		return 1;
+
+	return ((len - fftlen) / hop) + 1;
+}
+
+/**
+ * sums the unnormalized power of a run of welch segments.  Splitting a
+ * block into runs lets the segments be computed in parallel; adding the
+ * partial sums in a fixed order keeps the result independent of how
+ * many threads did the work.
+ *
+ * @param plan - a WSA_FFT_REAL plan of fftlen points
+ * @param idata - the normalized real samples of the block
+ * @param window - a window_hanning_table() table of fftlen values
+ * @param fftlen - the length of each segment
+ * @param hop - the distance between the start of consecutive segments
+ * @param first - the index of the first segment to sum
+ * @param count - the number of segments to sum
+ * @param segment - scratch buffer of at least fftlen scalars
+ * @param fftout - scratch buffer of at least fftlen / 2 + 1 complex values
+ * @param power - buffer of fftlen / 2 scalars to store the summed power in
+ * @returns negative on error, otherwise the number of segments summed
+ */
+int32_t psd_welch_accumulate(struct wsa_fft_plan *plan,
+					kiss_fft_scalar *idata,
+					kiss_fft_scalar const *window,
+					int32_t fftlen,
+					int32_t hop,
+					int32_t first,
+					int32_t count,
+					kiss_fft_scalar *segment,
+					kiss_fft_cpx *fftout,
+					kiss_fft_scalar *power)
+{
+	int32_t i, seg, start;
+	int32_t half = fftlen >> 1;
+
+	if (wsa_fft_plan_size(plan) != fftlen)
+		return WSA_ERR_INVCAPTURESIZE;
+
+	for (i = 0; i < half; i++)
+		power[i] = 0;
+
+	for (seg = first; seg < first + count; seg++) {
+		start = seg * hop;
+		for (i = 0; i < fftlen; i++)
+			segment[i] = idata[start + i] * window[i];
+
+		rfft_execute(plan, segment, fftout);
+
+		for (i = 0; i < half; i++)
+			power[i] += (fftout[i].r * fftout[i].r) + (fftout[i].i * fftout[i].i);
+	}
+
+	return count;
+}
+
+/**
+ * sums the power of a run of welch segments like psd_welch_accumulate(),
+ * but windows and transforms the raw integer samples with a fixed point
+ * fft.  The power is scaled to match psd_welch_accumulate() on the
+ * normalized samples, so the two can be used interchangeably.  The 16 bit
+ * samples of the I only modes and the 32 bit samples of HDR are both 
+ * supported; the 32 bit fft keeps more of their precision than the 16 bit 
+ * one.
+ *
+ * @param plan - a WSA_FFT_REAL_FIXED16 or WSA_FFT_REAL_FIXED32 plan of fftlen points
+ * @param i16data - the raw 16 bit samples of the block, or NULL
+ * @param i32data - the raw 32 bit samples of the block when i16data is NULL
+ * @param window - a window_hanning_fixed() table of fftlen values
+ * @param fftlen - the length of each segment
+ * @param hop - the distance between the start of consecutive segments
+ * @param first - the index of the first segment to sum
+ * @param count - the number of segments to sum
+ * @param segment - scratch buffer of at least fftlen int32_t
+ * @param fftout - scratch buffer of at least fftlen + 2 int32_t
+ * @param power - buffer of fftlen / 2 scalars to store the summed power in
+ * @returns negative on error, otherwise the number of segments summed
+ */
+int32_t psd_welch_accumulate_fixed(struct wsa_fft_plan *plan,
+					int16_t *i16data,
+					int32_t *i32data,
+					int16_t const *window,
+					int32_t fftlen,
+					int32_t hop,
+					int32_t first,
+					int32_t count,
+					int32_t *segment,
+					int32_t *fftout,
+					kiss_fft_scalar *power)
+{
+	int32_t i, seg, start;
+	int32_t half = fftlen >> 1;
+	uint32_t type = wsa_fft_plan_type(plan);
+	int16_t *segment16 = (int16_t *) segment;
+	int16_t *fftout16 = (int16_t *) fftout;
+	double amplitude;
+	kiss_fft_scalar gain;
+	kiss_fft_scalar re, im;
+
+	if (wsa_fft_plan_size(plan) != fftlen)
+		return WSA_ERR_INVCAPTURESIZE;
+
+	/*
+	 * the windowed samples are scaled so a full scale input (8192 for 
+	 * I16, 8388608 for I32) uses the whole range of the fft: 
+	 * Q15 for the 16 bit fft and Q30 for the 32 bit one
+	 */
+	if (type == WSA_FFT_REAL_FIXED16)
+		amplitude = 32767.0;
+	else if (type == WSA_FFT_REAL_FIXED32)
+		amplitude = 32768.0 * 32767.0;
+	else
+		return WSA_ERR_INVFFTBACKEND;
+
+	// the fft divided by fftlen, undo that and the input scaling
+	gain = (kiss_fft_scalar) (((double) fftlen * (double) fftlen) / (amplitude * amplitude));
+
+	for (i = 0; i < half; i++)
+		power[i] = 0;
+
+	for (seg = first; seg < first + count; seg++) {
+		start = seg * hop;
+
+		if (type == WSA_FFT_REAL_FIXED16) {
+			if (i16data)
+				for (i = 0; i < fftlen; i++)
+					segment16[i] = (int16_t) ((i16data[start + i] * 4 * window[i] + (1 << 14)) >> 15);
+			else
+				for (i = 0; i < fftlen; i++)
+					segment16[i] = (int16_t) (((int64_t) i32data[start + i] * window[i] + (1 << 22)) >> 23);
+
+			wsa_fft_execute_real_fixed16(plan, segment16, fftout16);
+
+			for (i = 0; i < half; i++) {
+				re = (kiss_fft_scalar) fftout16[2 * i];
+				im = (kiss_fft_scalar) fftout16[2 * i + 1];
+				power[i] += ((re * re) + (im * im)) * gain;
+			}
+		} else {
+			if (i16data)
+				for (i = 0; i < fftlen; i++)
+					segment[i] = (i16data[start + i] * window[i]) * 4;
+			else
+				for (i = 0; i < fftlen; i++)
+					segment[i] = (int32_t) (((int64_t) i32data[start + i] * window[i] + (1 << 7)) >> 8);
+
+			wsa_fft_execute_real_fixed32(plan, segment, fftout);
+
+			for (i = 0; i < half; i++) {
+				re = (kiss_fft_scalar) fftout[2 * i];
+				im = (kiss_fft_scalar) fftout[2 * i + 1];
+				power[i] += ((re * re) + (im * im)) * gain;
+			}
+		}
+	}
+
+	return count;
+}
+
+/**
+ * sums the unnormalized power of a run of welch segments of I/Q samples,
+ * like psd_welch_accumulate().  The spectrum is fft shifted: power[0] is
+ * -fs / 2, power[fftlen / 2] is DC.
+ *
+ * @param plan - a WSA_FFT_COMPLEX plan of fftlen points
+ * @param idata - the normalized I samples of the block
+ * @param qdata - the normalized Q samples of the block
+ * @param window - a window_hanning_table() table of fftlen values
+ * @param fftlen - the length of each segment
+ * @param hop - the distance between the start of consecutive segments
+ * @param first - the index of the first segment to sum
+ * @param count - the number of segments to sum
+ * @param segment - scratch buffer of at least fftlen complex values
+ * @param fftout - scratch buffer of at least fftlen complex values
+ * @param power - buffer of fftlen scalars to store the summed power in
+ * @returns negative on error, otherwise the number of segments summed
+ */
+int32_t psd_welch_accumulate_cpx(struct wsa_fft_plan *plan,
+					kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					kiss_fft_scalar const *window,
+					int32_t fftlen,
+					int32_t hop,
+					int32_t first,
+					int32_t count,
+					kiss_fft_cpx *segment,
+					kiss_fft_cpx *fftout,
+					kiss_fft_scalar *power)
+{
+	int32_t i, seg, start;
+	int32_t half = fftlen >> 1;
+
+	if (wsa_fft_plan_size(plan) != fftlen)
+		return WSA_ERR_INVCAPTURESIZE;
+
+	for (i = 0; i < fftlen; i++)
+		power[i] = 0;
+
+	for (seg = first; seg < first + count; seg++) {
+		start = seg * hop;
+		for (i = 0; i < fftlen; i++) {
+			segment[i].r = idata[start + i] * window[i];
+			segment[i].i = qdata[start + i] * window[i];
+		}
+
+		wsa_fft_execute(plan, segment, fftout);
+
+		// accumulate with the negative frequencies first
+		for (i = 0; i < fftlen; i++)
+			power[(i + fftlen - half) % fftlen] += (fftout[i].r * fftout[i].r) + (fftout[i].i * fftout[i].i);
+	}
+
+	return count;
+}
+
+/**
+ * computes a welch averaged power spectrum: the block is split into
+ * overlapping segments of fftlen samples, each segment is windowed and
+ * transformed, and the linear power of the segments is averaged.
+ *
+ * The result has the same scaling as squaring cpx_to_power() / fftlen, 
+ * so 10 * log10() of it matches the single FFT path when only one 
+ * segment fits in the block.
+ *
+ * @param idata - the normalized real samples of the block
+ * @param len - the number of samples in idata
+ * @param fftlen - the length of each segment
+ * @param hop - the distance between the start of consecutive segments
+ * @param segment - scratch buffer of at least fftlen scalars
+ * @param fftout - scratch buffer of at least fftlen complex values
+ * @param power - buffer of fftlen / 2 scalars to store the averaged power in
+ * @returns negative on error, otherwise the number of segments averaged
+ */
+int32_t psd_welch_power(kiss_fft_scalar *idata,
+					int32_t len,
+					int32_t fftlen,
+					int32_t hop,
+					kiss_fft_scalar *segment,
+					kiss_fft_cpx *fftout,
+					kiss_fft_scalar *power)
+{
+	int32_t i;
+	int32_t segments;
+	int32_t half = fftlen >> 1;
+	int32_t result;
+	kiss_fft_scalar scale;
+	kiss_fft_scalar *window;
+	struct wsa_fft_plan *plan;
+
+	if (fftlen <= 0 || fftlen > len)
+		return WSA_ERR_INVCAPTURESIZE;
+
+	segments = psd_welch_segment_count(len, fftlen, hop);
+
+	plan = wsa_fft_plan_new(fftlen, WSA_FFT_REAL);
+	window = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * fftlen);
+	if (plan == NULL || window == NULL) {
+		wsa_fft_plan_free(plan);
+		free(window);
+		return WSA_ERR_MALLOCFAILED;
+	}
+	window_hanning_table(window, fftlen);
+
+	result = psd_welch_accumulate(plan, idata, window, fftlen, hop, 0, segments, segment, fftout, power);
+	wsa_fft_plan_free(plan);
+	free(window);
+	if (result < 0)
+		return result;
+
+	// average the segments and normalize by the fft length
+	scale = (kiss_fft_scalar) (1.0 / ((double) segments * (double) fftlen * (double) fftlen));
+	for (i = 0; i < half; i++)
+		power[i] = power[i] * scale;
+
+	return segments;
+}
+
+/**
+ * computes a welch averaged power spectrum of complex samples, such as 
+ * the output of a wsa_ddc.  The spectrum is fft shifted: power[0] is 
+ * -fs / 2, power[fftlen / 2] is DC.  The scaling matches psd_welch_power().
+ *
+ * @param plan - a WSA_FFT_COMPLEX plan of fftlen points
+ * @param data - the complex samples
+ * @param window - a window_hanning_table() table of fftlen values
+ * @param len - the number of samples
+ * @param fftlen - the length of each segment
+ * @param hop - the distance between the start of consecutive segments
+ * @param segment - scratch buffer of at least fftlen complex values
+ * @param fftout - scratch buffer of at least fftlen complex values
+ * @param power - buffer of fftlen scalars to store the averaged power in
+ * @returns negative on error, otherwise the number of segments averaged
+ */
+int32_t psd_welch_power_cpx(struct wsa_fft_plan *plan,
+					kiss_fft_cpx *data,
+					kiss_fft_scalar const *window,
+					int32_t len,
+					int32_t fftlen,
+					int32_t hop,
+					kiss_fft_cpx *segment,
+					kiss_fft_cpx *fftout,
+					kiss_fft_scalar *power)
+{
+	int32_t i, seg, start;
+	int32_t segments;
+	int32_t half = fftlen >> 1;
+	kiss_fft_scalar scale;
+
+	if (fftlen <= 0 || fftlen > len || wsa_fft_plan_size(plan) != fftlen)
+		return WSA_ERR_INVCAPTURESIZE;
+
+	segments = psd_welch_segment_count(len, fftlen, hop);
+
+	for (i = 0; i < fftlen; i++)
+		power[i] = 0;
+
+	for (seg = 0; seg < segments; seg++) {
+		start = seg * hop;
+		for (i = 0; i < fftlen; i++) {
+			segment[i].r = data[start + i].r * window[i];
+			segment[i].i = data[start + i].i * window[i];
+		}
+
+		wsa_fft_execute(plan, segment, fftout);
+
+		// accumulate with the negative frequencies first
+		for (i = 0; i < fftlen; i++)
+			power[(i + fftlen - half) % fftlen] += (fftout[i].r * fftout[i].r) + (fftout[i].i * fftout[i].i);
+	}
+
+	// average the segments and normalize by the fft length
+	scale = (kiss_fft_scalar) (1.0 / ((double) segments * (double) fftlen * (double) fftlen));
+	for (i = 0; i < fftlen; i++)
+		power[i] = power[i] * scale;
+
+	return segments;
+}
+
+/**
+ * combines a new spectrum with a trace in place
+ *
+ * the trace is kept as linear power in acc, so combining a spectrum costs 
+ * no more than one log10 per bin, to write the dBm trace.  
+ * WSA_TRACE_AVERAGE keeps the arithmetic mean of the power in each bin, 
+ * which is the power of the RMS voltage, so WSA_TRACE_RMS is the same 
+ * trace; the name is kept for the analyzers that call power averaging 
+ * RMS averaging.  Neither averages the dB values, which would read about 
+ * 2.5 dB low on noise.  WSA_TRACE_EXPONENTIAL keeps an exponentially 
+ * weighted mean of the power.
+ *
+ * @param trace_mode - one of the WSA_TRACE_* modes
+ * @param weight - the averaging length: the new spectrum contributes 1 / weight
+ *		of the result. A weight of 1 or less (first trace) simply copies the spectrum.
+ * @param acc - the trace as linear power, updated in place
+ * @param trace - the trace in dBm, written from acc
+ * @param power - the new spectrum, as linear power in mW
+ * @param len - number of bins in the arrays
+ */
+void psd_trace_update(uint32_t trace_mode,
+					uint32_t weight,
+					float *acc,
+					float *trace,
+					float const *power,
+					uint32_t len)
+{
+	uint32_t i;
+	float k;
+
+	if (weight <= 1)
+		trace_mode = WSA_TRACE_CLEAR_WRITE;
+
+	k = 1.0f / (float) weight;
+
+	switch (trace_mode) {
+	case WSA_TRACE_AVERAGE:
+	case WSA_TRACE_RMS:
+	case WSA_TRACE_EXPONENTIAL:
+		for (i = 0; i < len; i++)
+			acc[i] = acc[i] + ((power[i] - acc[i]) * k);
+		break;
+
+	case WSA_TRACE_MAX_HOLD:
+		for (i = 0; i < len; i++)
+			acc[i] = (power[i] > acc[i]) ? power[i] : acc[i];
+		break;
+
+	case WSA_TRACE_MIN_HOLD:
+		for (i = 0; i < len; i++)
+			acc[i] = (power[i] < acc[i]) ? power[i] : acc[i];
+		break;
+
+	default:
+		memcpy(acc, power, sizeof(float) * len);
+		break;
+	}
+
+	for (i = 0; i < len; i++)
+		trace[i] = 10.0f * log10f(acc[i]);
+}
+
 // ////////////////////////////////////////////////////////////////////////////
 // Utility Functions                                                         //
 // ////////////////////////////////////////////////////////////////////////////
+/**
+ * finds the index of the largest value of an array.  Four running maxima
+ * are kept so the compiler can vectorize the scan.
+ *
+ * @param data - the array
+ * @param len - the number of values, at least 1
+ * @return - the index of the first occurrence of the largest value
+ */
+uint32_t psd_max_index(float const *data, uint32_t len)
+{
+	float lane[4];
+	float best;
+	uint32_t i, k;
+
+	lane[0] = lane[1] = lane[2] = lane[3] = data[0];
+	for (i = 0; i + 4 <= len; i += 4)
+		for (k = 0; k < 4; k++)
+			lane[k] = (data[i + k] > lane[k]) ? data[i + k] : lane[k];
+
+	best = lane[0];
+	for (k = 1; k < 4; k++)
+		if (lane[k] > best)
+			best = lane[k];
+	for (; i < len; i++)
+		if (data[i] > best)
+			best = data[i];
+
+	// the value is known, its first position is a cheap scan
+	for (i = 0; i < len; i++)
+		if (data[i] == best)
+			break;
+
+	return i;
+}
+
 /**
  * Find the peak value within the given spectral data
  * Note you must set the sample size, and acquire read status before 
@@ -284,20 +1046,14 @@ int16_t psd_peak_find(uint64_t fstart,
 				uint64_t *peak_freq,
 				float *peak_power)
 {
-	uint32_t i = 0;
-	uint64_t current_freq = fstart;
-	uint64_t rbw_cal = (fstop - fstart) / (uint64_t) data_size;
+	uint32_t i;
+
+	i = psd_max_index(spectra_data, data_size);
 	*peak_power = spectra_data[i];
-	*peak_freq = fstart;
-	for (i = 0; i < data_size; i++){
-		if (spectra_data[i] > *peak_power){
-			*peak_power = spectra_data[i];
-			
-			*peak_freq = current_freq;
-		}
-		current_freq = current_freq + (uint64_t) rbw_cal;
-		
-	}
+
+	// work the frequency out from the bin, stepping by a rounded rbw drifts
+	*peak_freq = fstart + (((fstop - fstart) * (uint64_t) i) / (uint64_t) data_size);
+
 	return 0;
 }
 
@@ -319,7 +1075,6 @@ int16_t psd_calculate_channel_power(uint32_t start_bin,
 {
 
 	float linear_sum = 0;
-	float tmp_float = 0;
 	uint32_t i = 0;  
 
 	// make sure that the stop bin is larger than the start bin
@@ -330,13 +1085,13 @@ int16_t psd_calculate_channel_power(uint32_t start_bin,
 	if (stop_bin > data_size)
 		return WSA_ERR_INVCHPOWERRANGE;
 
+	// the last bin is part of the range, but don't read past the data
+	if (stop_bin >= data_size)
+		stop_bin = data_size - 1;
+
 	// find the linear sum of the squares
-	for (i = 0; i < data_size; i++){
-		if (i >= start_bin && i <= stop_bin){
-			tmp_float = (float) (pow(10,  (spectral_data[i] / 20)));
-			linear_sum = linear_sum + (tmp_float * tmp_float);
-		}
-	}
+	for (i = start_bin; i <= stop_bin; i++)
+		linear_sum = linear_sum + (float) pow(10, spectral_data[i] / 10);
 	*channel_power = (float) (10 * log10(linear_sum));
 	return 0;
 }
@@ -359,7 +1114,6 @@ int16_t psd_calculate_absolute_power(uint32_t start_bin,
 {
 
 	float linear_sum = 0;
-	float tmp_float = 0;
 	uint32_t i = 0;  
 
 	// make sure that the stop bin is larger than the start bin
@@ -370,13 +1124,825 @@ int16_t psd_calculate_absolute_power(uint32_t start_bin,
 	if (stop_bin > data_size)
 		return WSA_ERR_INVCHPOWERRANGE;
 
+	// the last bin is part of the range, but don't read past the data
+	if (stop_bin >= data_size)
+		stop_bin = data_size - 1;
+
 	// find the linear sum of the squares
-	for (i = 0; i < data_size; i++){
-		if (i >= start_bin && i <= stop_bin){
-			tmp_float = (float) (pow(10,  (spectral_data[i] / 20)));
-			linear_sum = linear_sum + (tmp_float * tmp_float);
+	for (i = start_bin; i <= stop_bin; i++)
+		linear_sum = linear_sum + (float) pow(10, spectral_data[i] / 10);
+	*absolute_power = linear_sum;
+	return 0;
+}
+
+// ////////////////////////////////////////////////////////////////////////////
+// Spectrum Index Section                                                    //
+// ////////////////////////////////////////////////////////////////////////////
+/**
+ * allocates a spectrum index, which answers power queries over any range
+ * of bins of a spectrum in constant time
+ *
+ * @param capacity - the largest spectrum the index will hold, it grows if needed
+ * @return - the index, or NULL on failure
+ */
+struct psd_spectrum_index *psd_spectrum_index_new(uint32_t capacity)
+{
+	struct psd_spectrum_index *index;
+
+	index = malloc(sizeof(struct psd_spectrum_index));
+	if (index == NULL)
+		return NULL;
+
+	index->len = 0;
+	index->capacity = 0;
+	index->linear = NULL;
+	index->prefix = NULL;
+
+	if (capacity > 0 && psd_spectrum_index_reserve(index, capacity) < 0) {
+		psd_spectrum_index_free(index);
+		return NULL;
+	}
+
+	return index;
+}
+
+/**
+ * frees a spectrum index
+ *
+ * @param index - the index to free, may be NULL
+ */
+void psd_spectrum_index_free(struct psd_spectrum_index *index)
+{
+	if (index == NULL)
+		return;
+
+	if (index->prefix)
+		free(index->prefix);
+	if (index->linear)
+		free(index->linear);
+	free(index);
+}
+
+/**
+ * makes sure an index can hold a spectrum of the given size
+ *
+ * @param index - the index
+ * @param capacity - the number of bins
+ * @return - 0 on success, negative on error
+ */
+int16_t psd_spectrum_index_reserve(struct psd_spectrum_index *index, uint32_t capacity)
+{
+	float *linear;
+	double *prefix;
+
+	if (capacity <= index->capacity)
+		return 0;
+
+	linear = realloc(index->linear, sizeof(float) * capacity);
+	if (linear == NULL)
+		return WSA_ERR_MALLOCFAILED;
+	index->linear = linear;
+
+	prefix = realloc(index->prefix, sizeof(double) * (capacity + 1));
+	if (prefix == NULL)
+		return WSA_ERR_MALLOCFAILED;
+	index->prefix = prefix;
+
+	index->capacity = capacity;
+	return 0;
+}
+
+/**
+ * indexes a spectrum: converts every bin to linear power once and sums
+ * them, so the power of a range is the difference of two sums.  The 
+ * sums are kept in double precision so narrow channels next to strong 
+ * signals keep their accuracy.
+ *
+ * @param index - the index to fill, the previous spectrum is replaced
+ * @param spectral_data - the spectrum, in dBm
+ * @param data_size - the number of bins
+ * @return - 0 on success, negative on error
+ */
+int16_t psd_spectrum_index_build(struct psd_spectrum_index *index, float const *spectral_data, uint32_t data_size)
+{
+	const double db_to_ln = M_LN10 / 10;
+	double sum = 0;
+	uint32_t i;
+	int16_t result;
+
+	result = psd_spectrum_index_reserve(index, data_size);
+	if (result < 0)
+		return result;
+
+	// converting first leaves a loop the compiler can vectorize
+	for (i = 0; i < data_size; i++)
+		index->linear[i] = (float) exp(spectral_data[i] * db_to_ln);
+
+	index->prefix[0] = 0;
+	for (i = 0; i < data_size; i++) {
+		sum += index->linear[i];
+		index->prefix[i + 1] = sum;
+	}
+
+	index->len = data_size;
+	return 0;
+}
+
+/**
+ * retrieves the linear power (in mW) of a range of bins, with the same 
+ * range rules as psd_calculate_absolute_power()
+ *
+ * @param index - a built index
+ * @param start_bin - the first bin of the range
+ * @param stop_bin - the last bin of the range
+ * @param absolute_power - where to store the power, in mW
+ * @return - 0 on success, negative on error
+ */
+int16_t psd_index_absolute_power(struct psd_spectrum_index const *index,
+								uint32_t start_bin,
+								uint32_t stop_bin,
+								double *absolute_power)
+{
+	if (start_bin >= stop_bin || stop_bin > index->len)
+		return WSA_ERR_INVCHPOWERRANGE;
+
+	// the last bin is part of the range, but don't read past the data
+	if (stop_bin >= index->len)
+		stop_bin = index->len - 1;
+
+	*absolute_power = index->prefix[stop_bin + 1] - index->prefix[start_bin];
+	return 0;
+}
+
+/**
+ * retrieves the channel power (in dBm) of a range of bins, with the same
+ * range rules as psd_calculate_channel_power()
+ *
+ * @param index - a built index
+ * @param start_bin - the first bin of the channel
+ * @param stop_bin - the last bin of the channel
+ * @param channel_power - where to store the channel power, in dBm
+ * @return - 0 on success, negative on error
+ */
+int16_t psd_index_channel_power(struct psd_spectrum_index const *index,
+								uint32_t start_bin,
+								uint32_t stop_bin,
+								float *channel_power)
+{
+	double power;
+	int16_t result;
+
+	result = psd_index_absolute_power(index, start_bin, stop_bin, &power);
+	if (result < 0)
+		return result;
+
+	*channel_power = (float) (10 * log10(power));
+	return 0;
+}
+
+/**
+ * calculates the adjacent channel power ratio: the power of an adjacent
+ * channel relative to the main channel
+ *
+ * @param index - a built index
+ * @param main_start - the first bin of the main channel
+ * @param main_stop - the last bin of the main channel
+ * @param adj_start - the first bin of the adjacent channel
+ * @param adj_stop - the last bin of the adjacent channel
+ * @param acpr - where to store the ratio, in dB (negative when the adjacent channel is weaker)
+ * @return - 0 on success, negative on error
+ */
+int16_t psd_index_acpr(struct psd_spectrum_index const *index,
+								uint32_t main_start,
+								uint32_t main_stop,
+								uint32_t adj_start,
+								uint32_t adj_stop,
+								float *acpr)
+{
+	double main_power;
+	double adj_power;
+	int16_t result;
+
+	result = psd_index_absolute_power(index, main_start, main_stop, &main_power);
+	if (result < 0)
+		return result;
+
+	result = psd_index_absolute_power(index, adj_start, adj_stop, &adj_power);
+	if (result < 0)
+		return result;
+
+	*acpr = (float) (10 * log10(adj_power / main_power));
+	return 0;
+}
+
+/**
+ * finds the first bin at which the power summed from start_bin reaches 
+ * a target, using a binary search of the running sum
+ *
+ * @param index - a built index
+ * @param start_bin - the first bin of the range
+ * @param stop_bin - the last bin of the range
+ * @param target - the power to reach, in mW
+ * @return - the bin, stop_bin if the target is never reached
+ */
+static uint32_t psd_index_find_power(struct psd_spectrum_index const *index,
+								uint32_t start_bin,
+								uint32_t stop_bin,
+								double target)
+{
+	uint32_t low = start_bin;
+	uint32_t high = stop_bin;
+	uint32_t mid;
+	double base = index->prefix[start_bin];
+
+	while (low < high) {
+		mid = low + ((high - low) / 2);
+		if (index->prefix[mid + 1] - base >= target)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	return low;
+}
+
+/**
+ * finds the band of bins holding a percentage of the power of a range
+ *
+ * PSD_OBW_SYMMETRIC grows the band evenly about the center of the range
+ * until it holds the percentage.  PSD_OBW_PERCENTILE is the usual 
+ * definition: the band leaves (100 - percentage) / 2 of the power below
+ * and above it (0.5% each side for 99%).  Both take O(log n) once the 
+ * index is built.
+ *
+ * @param index - a built index
+ * @param start_bin - the first bin of the range
+ * @param stop_bin - the last bin of the range
+ * @param occupied_percentage - the percentage of the power in the band, 0 to 100
+ * @param method - PSD_OBW_SYMMETRIC or PSD_OBW_PERCENTILE
+ * @param obw_start - where to store the first bin of the band
+ * @param obw_stop - where to store the last bin of the band
+ * @return - 0 on success, negative on error
+ */
+int16_t psd_index_occupied_bandwidth(struct psd_spectrum_index const *index,
+								uint32_t start_bin,
+								uint32_t stop_bin,
+								float occupied_percentage,
+								uint32_t method,
+								uint32_t *obw_start,
+								uint32_t *obw_stop)
+{
+	double total;
+	double target;
+	double power;
+	uint32_t center, low, high, mid, max_half;
+	int16_t result;
+
+	if (occupied_percentage <= 0 || occupied_percentage > 100)
+		return WSA_ERR_INVCHPOWERRANGE;
+
+	result = psd_index_absolute_power(index, start_bin, stop_bin, &total);
+	if (result < 0)
+		return result;
+
+	if (stop_bin >= index->len)
+		stop_bin = index->len - 1;
+
+	if (method == PSD_OBW_PERCENTILE) {
+		target = total * (100 - occupied_percentage) / 200;
+		*obw_start = psd_index_find_power(index, start_bin, stop_bin, target);
+		*obw_stop = psd_index_find_power(index, start_bin, stop_bin, total - target);
+		return 0;
+	}
+
+	if (method != PSD_OBW_SYMMETRIC)
+		return WSA_ERR_INVCHPOWERRANGE;
+
+	// the band's power only grows with its half width, so search the half width
+	target = total * occupied_percentage / 100;
+	center = start_bin + ((stop_bin - start_bin) / 2);
+	max_half = (center - start_bin > stop_bin - center) ? center - start_bin : stop_bin - center;
+	low = 0;
+	high = max_half;
+	while (low < high) {
+		mid = low + ((high - low) / 2);
+		power = index->prefix[((center + mid > stop_bin) ? stop_bin : center + mid) + 1] - 
+			index->prefix[(mid > center - start_bin) ? start_bin : center - mid];
+		if (power >= target)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	*obw_start = (low > center - start_bin) ? start_bin : center - low;
+	*obw_stop = (center + low > stop_bin) ? stop_bin : center + low;
+	return 0;
+}
+
+/**
+ * calculates the occupied bandwidth of a captured spectrum
+ *
+ * @param fstart - the frequency of the first bin, in Hz
+ * @param fstop - the frequency at the end of the spectrum, in Hz
+ * @param data_size - the number of bins
+ * @param spectral_data - the spectrum, in dBm
+ * @param occupied_percentage - the percentage of the power in the band, 0 to 100
+ * @param method - PSD_OBW_SYMMETRIC or PSD_OBW_PERCENTILE
+ * @param occupied_bw - where to store the occupied bandwidth, in Hz
+ * @return - 0 on success, negative on error
+ */
+int16_t psd_occupied_bandwidth(uint64_t fstart,
+								uint64_t fstop,
+								uint32_t data_size,
+								float const *spectral_data,
+								float occupied_percentage,
+								uint32_t method,
+								uint64_t *occupied_bw)
+{
+	struct psd_spectrum_index *index;
+	uint32_t obw_start, obw_stop;
+	double bin_width;
+	int16_t result;
+
+	index = psd_spectrum_index_new(data_size);
+	if (index == NULL)
+		return WSA_ERR_MALLOCFAILED;
+
+	result = psd_spectrum_index_build(index, spectral_data, data_size);
+	if (result >= 0)
+		result = psd_index_occupied_bandwidth(index, 0, data_size, occupied_percentage, method, &obw_start, &obw_stop);
+	psd_spectrum_index_free(index);
+	if (result < 0)
+		return result;
+
+	bin_width = ((double) (fstop - fstart)) / data_size;
+	*occupied_bw = (uint64_t) ((obw_stop - obw_start + 1) * bin_width);
+	return 0;
+}
+
+// ////////////////////////////////////////////////////////////////////////////
+// Peak Search Section                                                       //
+// ////////////////////////////////////////////////////////////////////////////
+
+// orders peak candidates by power, strongest first, then by bin
+static int psd_peak_compare(const void *a, const void *b)
+{
+	const struct psd_peak *pa = (const struct psd_peak *) a;
+	const struct psd_peak *pb = (const struct psd_peak *) b;
+
+	if (pa->power > pb->power)
+		return -1;
+	if (pa->power < pb->power)
+		return 1;
+	if (pa->bin < pb->bin)
+		return -1;
+	return (pa->bin > pb->bin) ? 1 : 0;
+}
+
+/**
+ * checks which candidates the spectrum falls by at least the excursion 
+ * from on one side, before rising above them.  Reaching the end of the 
+ * spectrum counts as falling enough.  One scan with a stack of the 
+ * candidates not yet risen above does every candidate, however far apart
+ * they are: each candidate is pushed and popped once, and the lowest 
+ * value seen since a candidate is handed down the stack when those above
+ * it are popped.
+ *
+ * @param data - the spectrum, in dBm
+ * @param len - the number of bins
+ * @param candidates - the local maxima, in increasing bin order
+ * @param count - the number of candidates
+ * @param step - -1 to look below the peaks, 1 to look above them
+ * @param excursion - the drop required, in dB
+ * @param stack - scratch memory of count values
+ * @param lowest - scratch memory of count values
+ * @param pass - cleared for each candidate that doesn't fall enough
+ */
+static void psd_peak_excursion(float const *data, 
+				uint32_t len, 
+				struct psd_peak const *candidates, 
+				uint32_t count, 
+				int step, 
+				float excursion,
+				uint32_t *stack,
+				float *lowest,
+				uint8_t *pass)
+{
+	uint32_t top = 0;
+	uint32_t next = (step > 0) ? 0 : count - 1;
+	uint32_t n, i, c;
+	float low;
+
+	for (n = 0; n < len; n++) {
+		i = (step > 0) ? n : len - 1 - n;
+
+		// the candidates this bin rises above are done, low gathers the 
+		// lowest value since the one left on top of the stack
+		low = FLT_MAX;
+		while (top > 0 && candidates[stack[top - 1]].power < data[i]) {
+			c = stack[--top];
+			if (lowest[top] < low)
+				low = lowest[top];
+			if (candidates[c].power - low < excursion)
+				pass[c] = 0;
+			if (candidates[c].power < low)
+				low = candidates[c].power;
+		}
+		if (data[i] < low)
+			low = data[i];
+		if (top > 0 && low < lowest[top - 1])
+			lowest[top - 1] = low;
+
+		if (next < count && candidates[next].bin == i) {
+			stack[top] = next;
+			lowest[top] = FLT_MAX;
+			top++;
+			next += step;
 		}
 	}
-	*absolute_power = linear_sum;
+}
+
+/**
+ * refines a peak's position and level from its two neighbours
+ *
+ * @param data - the spectrum, in dBm
+ * @param len - the number of bins
+ * @param peak - the peak, its bin must be set
+ * @param interpolation - one of the PSD_PEAK_INTERP_* methods
+ * @param offset - where to store the position of the peak relative to its bin, -0.5 to 0.5
+ */
+static void psd_peak_interpolate(float const *data, uint32_t len, struct psd_peak *peak, uint32_t interpolation, double *offset)
+{
+	double a, b, c, denom, delta;
+
+	*offset = 0;
+	peak->power = data[peak->bin];
+	if (interpolation == PSD_PEAK_INTERP_NONE || peak->bin == 0 || peak->bin + 1 >= len)
+		return;
+
+	// a parabola through the dB values is a gaussian in linear power
+	a = data[peak->bin - 1];
+	b = data[peak->bin];
+	c = data[peak->bin + 1];
+	if (interpolation == PSD_PEAK_INTERP_PARABOLIC) {
+		a = pow(10, a / 10);
+		b = pow(10, b / 10);
+		c = pow(10, c / 10);
+	}
+
+	denom = a - (2 * b) + c;
+	if (denom >= 0)
+		return;
+
+	delta = 0.5 * (a - c) / denom;
+	if (delta > 0.5)
+		delta = 0.5;
+	else if (delta < -0.5)
+		delta = -0.5;
+
+	b = b - (0.25 * (a - c) * delta);
+	if (interpolation == PSD_PEAK_INTERP_PARABOLIC)
+		b = 10 * log10(b);
+
+	peak->power = (float) b;
+	*offset = delta;
+}
+
+/**
+ * finds the strongest peaks of a spectrum
+ *
+ * A peak is a local maximum at or above the threshold that stands out
+ * from the spectrum by at least the excursion on both sides: the 
+ * spectrum must fall by the excursion before rising above the peak, or
+ * reach its end without rising above it.  Peaks closer than 
+ * min_separation bins to a stronger peak are dropped.
+ *
+ * @param fstart - the frequency of the first bin, in Hz
+ * @param fstop - the frequency at the end of the spectrum, in Hz
+ * @param data_size - the number of bins
+ * @param spectral_data - the spectrum, in dBm
+ * @param threshold - the lowest level a peak can have, in dBm
+ * @param excursion - how far the spectrum must fall around a peak, in dB
+ * @param min_separation - the smallest distance between peaks, in bins
+ * @param interpolation - one of the PSD_PEAK_INTERP_* methods
+ * @param max_peaks - the size of peaks
+ * @param peaks - where to store the peaks, strongest first
+ * @param peak_count - where to store the number of peaks found
+ * @return - 0 on success, negative on error
+ */
+int16_t psd_peak_search(uint64_t fstart,
+				uint64_t fstop,
+				uint32_t data_size,
+				float const *spectral_data,
+				float threshold,
+				float excursion,
+				uint32_t min_separation,
+				uint32_t interpolation,
+				uint32_t max_peaks,
+				struct psd_peak *peaks,
+				uint32_t *peak_count)
+{
+	struct psd_peak *candidates;
+	uint32_t count = 0;
+	uint32_t found = 0;
+	uint32_t i, j;
+	double bin_width = ((double) (fstop - fstart)) / data_size;
+	double offset;
+	float left, right;
+	int far_enough;
+	uint32_t *stack;
+	float *lowest;
+	uint8_t *pass;
+
+	*peak_count = 0;
+	if (data_size == 0 || max_peaks == 0)
+		return 0;
+
+	// the largest value tells whether anything reaches the threshold at all
+	if (spectral_data[psd_max_index(spectral_data, data_size)] < threshold)
+		return 0;
+
+	candidates = malloc(sizeof(struct psd_peak) * ((data_size / 2) + 1));
+	if (candidates == NULL)
+		return WSA_ERR_MALLOCFAILED;
+
+	// every local maximum above the threshold
+	for (i = 0; i < data_size; i++) {
+		if (spectral_data[i] < threshold)
+			continue;
+
+		left = (i > 0) ? spectral_data[i - 1] : spectral_data[i] - 1;
+		right = (i + 1 < data_size) ? spectral_data[i + 1] : spectral_data[i] - 1;
+		if (spectral_data[i] > left && spectral_data[i] >= right) {
+			candidates[count].bin = i;
+			candidates[count].power = spectral_data[i];
+			count++;
+		}
+	}
+
+	// drop the ones that don't stand out on both sides
+	if (excursion > 0 && count > 0) {
+		stack = malloc((sizeof(uint32_t) + sizeof(float) + sizeof(uint8_t)) * count);
+		if (stack == NULL) {
+			free(candidates);
+			return WSA_ERR_MALLOCFAILED;
+		}
+		lowest = (float *) (stack + count);
+		pass = (uint8_t *) (lowest + count);
+		memset(pass, 1, count);
+
+		psd_peak_excursion(spectral_data, data_size, candidates, count, -1, excursion, stack, lowest, pass);
+		psd_peak_excursion(spectral_data, data_size, candidates, count, 1, excursion, stack, lowest, pass);
+
+		for (i = 0, j = 0; i < count; i++)
+			if (pass[i])
+				candidates[j++] = candidates[i];
+		count = j;
+		free(stack);
+	}
+
+	qsort(candidates, count, sizeof(struct psd_peak), psd_peak_compare);
+
+	// take the strongest ones that are far enough apart
+	for (i = 0; i < count && found < max_peaks; i++) {
+		far_enough = 1;
+		for (j = 0; j < found; j++) {
+			if ((candidates[i].bin > peaks[j].bin ? candidates[i].bin - peaks[j].bin : 
+				peaks[j].bin - candidates[i].bin) < min_separation) {
+				far_enough = 0;
+				break;
+			}
+		}
+		if (!far_enough)
+			continue;
+
+		peaks[found].bin = candidates[i].bin;
+		psd_peak_interpolate(spectral_data, data_size, &peaks[found], interpolation, &offset);
+		peaks[found].freq = (double) fstart + ((peaks[found].bin + offset) * bin_width);
+		found++;
+	}
+
+	free(candidates);
+
+	// interpolation can reorder peaks of nearly equal level
+	qsort(peaks, found, sizeof(struct psd_peak), psd_peak_compare);
+	*peak_count = found;
+
 	return 0;
-}
\ No newline at end of file
+}
+
+// ////////////////////////////////////////////////////////////////////////////
+// Envelope Section                                                          //
+// ////////////////////////////////////////////////////////////////////////////
+
+/**
+ * measures the rms and peak power of a real or I/Q signal over 
+ * consecutive intervals, without an fft.  The levels are offset so a CW 
+ * tone reads the same as its peak in the hanning windowed spectrum: the 
+ * mean square of a real tone is 9.03 dB above it and its peak square 
+ * 12.04 dB, the square magnitude of an I/Q tone 6.02 dB.
+ *
+ * @param idata - the I samples
+ * @param qdata - the Q samples, NULL for real data
+ * @param len - the number of samples
+ * @param interval - the samples per measurement, 0 or less for all of them;
+ *	the last interval is shorter when len isn't a multiple of it
+ * @param reflevel - the reference level of the samples, in dBm
+ * @param rms - where to store the rms power of each interval, in dBm
+ * @param peak - where to store the peak power of each interval, in dBm
+ * @return - the number of intervals measured
+ */
+int32_t psd_envelope(kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					int32_t len,
+					int32_t interval,
+					float reflevel,
+					float *rms,
+					float *peak)
+{
+	kiss_fft_scalar sum, max, power;
+	float rms_offset = (qdata == NULL) ? -9.03f : -6.02f;
+	float peak_offset = (qdata == NULL) ? -12.04f : -6.02f;
+	int32_t start, stop, i;
+	int32_t count = 0;
+
+	if (interval <= 0 || interval > len)
+		interval = len;
+
+	for (start = 0; start < len; start += interval) {
+		stop = (start + interval < len) ? start + interval : len;
+		sum = 0;
+		max = 0;
+		for (i = start; i < stop; i++) {
+			power = idata[i] * idata[i];
+			if (qdata)
+				power += qdata[i] * qdata[i];
+			sum += power;
+			max = (power > max) ? power : max;
+		}
+
+		sum /= (stop - start);
+		rms[count] = (float) (10 * log10((sum > PSD_MIN_POWER) ? sum : PSD_MIN_POWER)) + reflevel + rms_offset;
+		peak[count] = (float) (10 * log10((max > PSD_MIN_POWER) ? max : PSD_MIN_POWER)) + reflevel + peak_offset;
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * measures the rms and peak power of complex samples over consecutive 
+ * intervals, like psd_envelope() on I/Q data.  Use it on the output of a 
+ * wsa_ddc, which already brings a real tone to the level of its spectrum.
+ *
+ * @param data - the samples
+ * @param len - the number of samples
+ * @param interval - the samples per measurement, 0 or less for all of them
+ * @param reflevel - the reference level of the samples, in dBm
+ * @param rms - where to store the rms power of each interval, in dBm
+ * @param peak - where to store the peak power of each interval, in dBm
+ * @return - the number of intervals measured
+ */
+int32_t psd_envelope_cpx(kiss_fft_cpx const *data,
+					int32_t len,
+					int32_t interval,
+					float reflevel,
+					float *rms,
+					float *peak)
+{
+	kiss_fft_scalar sum, max, power;
+	int32_t start, stop, i;
+	int32_t count = 0;
+
+	if (interval <= 0 || interval > len)
+		interval = len;
+
+	for (start = 0; start < len; start += interval) {
+		stop = (start + interval < len) ? start + interval : len;
+		sum = 0;
+		max = 0;
+		for (i = start; i < stop; i++) {
+			power = (data[i].r * data[i].r) + (data[i].i * data[i].i);
+			sum += power;
+			max = (power > max) ? power : max;
+		}
+
+		sum /= (stop - start);
+		rms[count] = (float) (10 * log10((sum > PSD_MIN_POWER) ? sum : PSD_MIN_POWER)) + reflevel - 6.02f;
+		peak[count] = (float) (10 * log10((max > PSD_MIN_POWER) ? max : PSD_MIN_POWER)) + reflevel - 6.02f;
+		count++;
+	}
+
+	return count;
+}
+
+// ////////////////////////////////////////////////////////////////////////////
+// Output Section                                                            //
+// ////////////////////////////////////////////////////////////////////////////
+
+/**
+ * packs a spectrum in dBm into 16 bit centi-dB (hundredths of a dB).  
+ * Levels from -327.68 to 327.67 dBm are kept within 0.005 dB, others 
+ * are clamped to that range.
+ *
+ * @param data - the spectrum, in dBm
+ * @param len - the number of bins
+ * @param packed - where to store the packed bins
+ */
+void psd_pack_cdb16(float const *data, uint32_t len, int16_t *packed)
+{
+	float value;
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		value = data[i] * 100;
+		value = (value > 32767.0f) ? 32767.0f : value;
+		value = (value < -32768.0f) ? -32768.0f : value;
+		packed[i] = (int16_t) (value + ((value >= 0) ? 0.5f : -0.5f));
+	}
+}
+
+/**
+ * unpacks a spectrum packed by psd_pack_cdb16()
+ *
+ * @param packed - the packed bins
+ * @param len - the number of bins
+ * @param data - where to store the spectrum, in dBm
+ */
+void psd_unpack_cdb16(int16_t const *packed, uint32_t len, float *data)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		data[i] = packed[i] * 0.01f;
+}
+
+/**
+ * picks the offset and scale that pack a whole spectrum into 8 bits
+ * with the least error: 0 is its lowest level and 255 its highest, so 
+ * every bin is kept within (highest - lowest) / 510 dB
+ *
+ * @param data - the spectrum, in dBm
+ * @param len - the number of bins
+ * @param offset - where to store the level of 0, in dBm
+ * @param scale - where to store the dB per step
+ */
+void psd_u8_range(float const *data, uint32_t len, float *offset, float *scale)
+{
+	float low, high;
+	uint32_t i;
+
+	low = (len > 0) ? data[0] : 0;
+	high = low;
+	for (i = 1; i < len; i++) {
+		low = (data[i] < low) ? data[i] : low;
+		high = (data[i] > high) ? data[i] : high;
+	}
+
+	*offset = low;
+	*scale = (high - low) / 255;
+	if (*scale < PSD_U8_MIN_SCALE)
+		*scale = PSD_U8_MIN_SCALE;
+}
+
+/**
+ * packs a spectrum in dBm into 8 bit steps above an offset.  Levels from 
+ * offset to offset + 255 * scale are kept within scale / 2 dB, others 
+ * are clamped to that range.
+ *
+ * @param data - the spectrum, in dBm
+ * @param len - the number of bins
+ * @param offset - the level of 0, in dBm
+ * @param scale - the dB per step
+ * @param packed - where to store the packed bins
+ */
+void psd_pack_u8(float const *data, uint32_t len, float offset, float scale, uint8_t *packed)
+{
+	float inv = 1 / scale;
+	float value;
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		value = ((data[i] - offset) * inv) + 0.5f;
+		value = (value > 255.0f) ? 255.0f : value;
+		value = (value < 0.0f) ? 0.0f : value;
+		packed[i] = (uint8_t) value;
+	}
+}
+
+/**
+ * unpacks a spectrum packed by psd_pack_u8()
+ *
+ * @param packed - the packed bins
+ * @param len - the number of bins
+ * @param offset - the level of 0 the bins were packed with, in dBm
+ * @param scale - the dB per step the bins were packed with
+ * @param data - where to store the spectrum, in dBm
+ */
+void psd_unpack_u8(uint8_t const *packed, uint32_t len, float offset, float scale, float *data)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		data[i] = offset + (packed[i] * scale);
+}
@@ -0,0 +1,423 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "kiss_fft.h"
+#include "kiss_fftr.h"
+#include "wsa_fft.h"
+#include "wsa_error.h"
+#include "wsa_debug.h"
+#include "wsa_thread.h"
+
+#ifdef WSA_FFT_FFTW
+#include <fftw3.h>
+#endif
+
+// fixed point kiss, built in kiss_fft_fixed16.c and kiss_fft_fixed32.c
+void *wsa_kiss_fixed16_alloc(int nfft);
+void wsa_kiss_fixed16_real(void *cfg, const int16_t *in, int16_t *out);
+void *wsa_kiss_fixed32_alloc(int nfft);
+void wsa_kiss_fixed32_real(void *cfg, const int32_t *in, int32_t *out);
+
+/// an fft plan, holding whatever the backend needs to run the transform
+struct wsa_fft_plan {
+	uint32_t backend;
+	uint32_t type;
+	int32_t nfft;
+
+	/// kiss: complex transforms, and real transforms of odd length
+	kiss_fft_cfg kiss_cfg;
+
+	/// kiss: real transforms of even length
+	kiss_fftr_cfg kiss_real_cfg;
+
+	/// kiss: complex copy of the input of odd length real transforms
+	kiss_fft_cpx *scratch;
+
+	/// kiss: fixed point real transforms
+	void *kiss_fixed_cfg;
+
+#ifdef WSA_FFT_FFTW
+	fftwf_plan fftw_plan;
+#endif
+};
+
+/// the backend used by wsa_fft_plan_new()
+static uint32_t wsa_fft_backend = WSA_FFT_BACKEND_KISS;
+
+
+/**
+ * tells whether a backend was compiled into the library
+ *
+ * @param backend - one of the WSA_FFT_BACKEND_* values
+ * @return - 1 if the backend can be used, 0 if not
+ */
+uint8_t wsa_fft_backend_available(uint32_t backend)
+{
+	if (backend == WSA_FFT_BACKEND_KISS)
+		return 1;
+
+#ifdef WSA_FFT_FFTW
+	if (backend == WSA_FFT_BACKEND_FFTW)
+		return 1;
+#endif
+
+	return 0;
+}
+
+
+/**
+ * retrieves the name of a backend
+ *
+ * @param backend - one of the WSA_FFT_BACKEND_* values
+ * @return - the name of the backend
+ */
+const char *wsa_fft_backend_name(uint32_t backend)
+{
+	switch (backend) {
+	case WSA_FFT_BACKEND_KISS: return "kiss";
+	case WSA_FFT_BACKEND_FFTW: return "fftw";
+	default: return "unknown";
+	}
+}
+
+
+/**
+ * selects the backend wsa_fft_plan_new() uses.  Plans that already exist
+ * keep the backend they were made with.
+ *
+ * @param backend - one of the WSA_FFT_BACKEND_* values
+ * @return - 0 on success, negative if the backend isn't available
+ */
+int16_t wsa_fft_set_backend(uint32_t backend)
+{
+	if (!wsa_fft_backend_available(backend))
+		return WSA_ERR_INVFFTBACKEND;
+
+	wsa_fft_backend = backend;
+	return 0;
+}
+
+
+/**
+ * retrieves the backend wsa_fft_plan_new() uses
+ *
+ * @return - one of the WSA_FFT_BACKEND_* values
+ */
+uint32_t wsa_fft_get_backend(void)
+{
+	return wsa_fft_backend;
+}
+
+
+/**
+ * makes a plan for transforms of one size with the selected backend
+ *
+ * @param nfft - the number of points in the transform
+ * @param type - one of the WSA_FFT_* plan types
+ * @return - the plan, or NULL on failure
+ */
+struct wsa_fft_plan *wsa_fft_plan_new(int32_t nfft, uint32_t type)
+{
+	return wsa_fft_plan_backend_new(wsa_fft_backend, nfft, type);
+}
+
+
+/**
+ * makes a plan for transforms of one size with a specific backend. 
+ * The kiss transforms work in memory kept in the plan, so a plan must only 
+ * be executed by one thread at a time; threads that transform at the same 
+ * time each make their own plan.  FFTW plans are made and destroyed 
+ * under wsa_mutex_global(), as FFTW's planner is not thread safe, so plans
+ * can be made and freed from any thread.
+ *
+ * @param backend - one of the WSA_FFT_BACKEND_* values
+ * @param nfft - the number of points in the transform
+ * @param type - one of the WSA_FFT_* plan types
+ * @return - the plan, or NULL on failure
+ */
+struct wsa_fft_plan *wsa_fft_plan_backend_new(uint32_t backend, int32_t nfft, uint32_t type)
+{
+	struct wsa_fft_plan *plan;
+	int failed = 0;
+
+	if (nfft < 1 || type > WSA_FFT_REAL_FIXED32 || !wsa_fft_backend_available(backend))
+		return NULL;
+
+	// only kiss does fixed point, and only for even lengths
+	if (type == WSA_FFT_REAL_FIXED16 || type == WSA_FFT_REAL_FIXED32) {
+		if (nfft & 1)
+			return NULL;
+		backend = WSA_FFT_BACKEND_KISS;
+	}
+
+	plan = malloc(sizeof(struct wsa_fft_plan));
+	if (plan == NULL)
+		return NULL;
+
+	plan->backend = backend;
+	plan->type = type;
+	plan->nfft = nfft;
+	plan->kiss_cfg = NULL;
+	plan->kiss_real_cfg = NULL;
+	plan->scratch = NULL;
+	plan->kiss_fixed_cfg = NULL;
+
+#ifdef WSA_FFT_FFTW
+	plan->fftw_plan = NULL;
+	if (backend == WSA_FFT_BACKEND_FFTW) {
+		float *rin = NULL;
+		fftwf_complex *in;
+		fftwf_complex *out;
+
+		// the plan is only made with these, the caller's arrays are used when executing
+		in = fftwf_malloc(sizeof(fftwf_complex) * nfft);
+		out = fftwf_malloc(sizeof(fftwf_complex) * nfft);
+		if (type == WSA_FFT_REAL)
+			rin = fftwf_malloc(sizeof(float) * nfft);
+
+		if (in && out && (rin || type != WSA_FFT_REAL)) {
+			wsa_mutex_lock(wsa_mutex_global());
+			if (type == WSA_FFT_REAL)
+				plan->fftw_plan = fftwf_plan_dft_r2c_1d(nfft, rin, out, FFTW_ESTIMATE | FFTW_UNALIGNED);
+			else
+				plan->fftw_plan = fftwf_plan_dft_1d(nfft, in, out, 
+					(type == WSA_FFT_COMPLEX) ? FFTW_FORWARD : FFTW_BACKWARD, 
+					FFTW_ESTIMATE | FFTW_UNALIGNED);
+			wsa_mutex_unlock(wsa_mutex_global());
+		}
+
+		if (rin)
+			fftwf_free(rin);
+		if (out)
+			fftwf_free(out);
+		if (in)
+			fftwf_free(in);
+
+		if (plan->fftw_plan == NULL)
+			failed = 1;
+	}
+#endif
+
+	if (type == WSA_FFT_REAL_FIXED16 || type == WSA_FFT_REAL_FIXED32) {
+		if (type == WSA_FFT_REAL_FIXED16)
+			plan->kiss_fixed_cfg = wsa_kiss_fixed16_alloc(nfft);
+		else
+			plan->kiss_fixed_cfg = wsa_kiss_fixed32_alloc(nfft);
+		if (plan->kiss_fixed_cfg == NULL)
+			failed = 1;
+	} else if (backend == WSA_FFT_BACKEND_KISS) {
+		if (type == WSA_FFT_REAL && (nfft & 1) == 0) {
+			plan->kiss_real_cfg = kiss_fftr_alloc(nfft, 0, 0, 0);
+			if (plan->kiss_real_cfg == NULL)
+				failed = 1;
+		} else {
+			// kiss can only do even length real transforms, so odd ones go through a complex fft
+			plan->kiss_cfg = kiss_fft_alloc(nfft, (type == WSA_FFT_COMPLEX_INVERSE) ? 1 : 0, 0, 0);
+			if (type == WSA_FFT_REAL)
+				plan->scratch = malloc(sizeof(kiss_fft_cpx) * nfft);
+			if (plan->kiss_cfg == NULL || (type == WSA_FFT_REAL && plan->scratch == NULL))
+				failed = 1;
+		}
+	}
+
+	if (failed) {
+		doutf(DHIGH, "wsa_fft_plan_backend_new: failed to plan a %d point %s fft\n", (int) nfft, wsa_fft_backend_name(backend));
+		wsa_fft_plan_free(plan);
+		return NULL;
+	}
+
+	return plan;
+}
+
+
+/**
+ * frees a plan
+ *
+ * @param plan - the plan to free, may be NULL
+ */
+void wsa_fft_plan_free(struct wsa_fft_plan *plan)
+{
+	if (plan == NULL)
+		return;
+
+#ifdef WSA_FFT_FFTW
+	if (plan->fftw_plan) {
+		wsa_mutex_lock(wsa_mutex_global());
+		fftwf_destroy_plan(plan->fftw_plan);
+		wsa_mutex_unlock(wsa_mutex_global());
+	}
+#endif
+
+	if (plan->kiss_cfg)
+		free(plan->kiss_cfg);
+	if (plan->kiss_real_cfg)
+		free(plan->kiss_real_cfg);
+	if (plan->scratch)
+		free(plan->scratch);
+	if (plan->kiss_fixed_cfg)
+		free(plan->kiss_fixed_cfg);
+	free(plan);
+}
+
+
+/**
+ * retrieves the number of points a plan transforms
+ *
+ * @param plan - the plan
+ * @return - the fft size
+ */
+int32_t wsa_fft_plan_size(struct wsa_fft_plan *plan)
+{
+	return plan->nfft;
+}
+
+
+/**
+ * retrieves the type of transform a plan does
+ *
+ * @param plan - the plan
+ * @return - one of the WSA_FFT_* plan types
+ */
+uint32_t wsa_fft_plan_type(struct wsa_fft_plan *plan)
+{
+	return plan->type;
+}
+
+
+/**
+ * runs a complex transform
+ *
+ * @param plan - a WSA_FFT_COMPLEX or WSA_FFT_COMPLEX_INVERSE plan
+ * @param in - nfft complex input values
+ * @param out - nfft complex output values, must not be the same as in
+ */
+void wsa_fft_execute(struct wsa_fft_plan *plan, kiss_fft_cpx *in, kiss_fft_cpx *out)
+{
+#ifdef WSA_FFT_FFTW
+	if (plan->backend == WSA_FFT_BACKEND_FFTW) {
+		fftwf_execute_dft(plan->fftw_plan, (fftwf_complex *) in, (fftwf_complex *) out);
+		return;
+	}
+#endif
+
+	kiss_fft(plan->kiss_cfg, in, out);
+}
+
+
+/**
+ * runs a real transform.  Only the non negative frequencies are computed, 
+ * out[0] is DC and out[nfft / 2] is the nyquist frequency.
+ *
+ * @param plan - a WSA_FFT_REAL plan
+ * @param in - nfft real input values
+ * @param out - nfft / 2 + 1 complex output values
+ */
+void wsa_fft_execute_real(struct wsa_fft_plan *plan, kiss_fft_scalar *in, kiss_fft_cpx *out)
+{
+	int32_t i;
+
+#ifdef WSA_FFT_FFTW
+	if (plan->backend == WSA_FFT_BACKEND_FFTW) {
+		fftwf_execute_dft_r2c(plan->fftw_plan, in, (fftwf_complex *) out);
+		return;
+	}
+#endif
+
+	if (plan->kiss_real_cfg) {
+		kiss_fftr(plan->kiss_real_cfg, in, out);
+		return;
+	}
+
+	for (i = 0; i < plan->nfft; i++) {
+		plan->scratch[i].r = in[i];
+		plan->scratch[i].i = 0;
+	}
+	kiss_fft(plan->kiss_cfg, plan->scratch, plan->scratch);
+	memcpy(out, plan->scratch, sizeof(kiss_fft_cpx) * ((plan->nfft >> 1) + 1));
+}
+
+
+/**
+ * runs a 16 bit fixed point real transform.  The output is scaled by 
+ * 1 / nfft so it can't overflow, which leaves about 90 dB between a full
+ * scale input and the rounding noise of the output.
+ *
+ * @param plan - a WSA_FFT_REAL_FIXED16 plan
+ * @param in - nfft real input values
+ * @param out - nfft / 2 + 1 complex output values, stored as interleaved 
+ *	real and imaginary parts
+ */
+void wsa_fft_execute_real_fixed16(struct wsa_fft_plan *plan, int16_t *in, int16_t *out)
+{
+	wsa_kiss_fixed16_real(plan->kiss_fixed_cfg, in, out);
+}
+
+
+/**
+ * runs a 32 bit fixed point real transform.  The output is scaled by 
+ * 1 / nfft so it can't overflow.
+ *
+ * @param plan - a WSA_FFT_REAL_FIXED32 plan
+ * @param in - nfft real input values
+ * @param out - nfft / 2 + 1 complex output values, stored as interleaved 
+ *	real and imaginary parts
+ */
+void wsa_fft_execute_real_fixed32(struct wsa_fft_plan *plan, int32_t *in, int32_t *out)
+{
+	wsa_kiss_fixed32_real(plan->kiss_fixed_cfg, in, out);
+}
+
+
+/**
+ * times real transforms of one size, to find out which backend is the
+ * fastest for the fft sizes a sweep uses
+ *
+ * @param backend - one of the WSA_FFT_BACKEND_* values
+ * @param nfft - the number of points in the transform
+ * @param iterations - the number of transforms to time
+ * @param usec - where to store the average time of a transform, in microseconds
+ * @return - 0 on success, negative on error
+ */
+int16_t wsa_fft_benchmark(uint32_t backend, int32_t nfft, int32_t iterations, double *usec)
+{
+	struct wsa_fft_plan *plan;
+	kiss_fft_scalar *in;
+	kiss_fft_cpx *out;
+	double start;
+	int32_t i;
+
+	if (!wsa_fft_backend_available(backend))
+		return WSA_ERR_INVFFTBACKEND;
+
+	if (iterations < 1)
+		iterations = 1;
+
+	plan = wsa_fft_plan_backend_new(backend, nfft, WSA_FFT_REAL);
+	in = malloc(sizeof(kiss_fft_scalar) * nfft);
+	out = malloc(sizeof(kiss_fft_cpx) * ((nfft >> 1) + 1));
+	if (plan == NULL || in == NULL || out == NULL) {
+		wsa_fft_plan_free(plan);
+		if (in)
+			free(in);
+		if (out)
+			free(out);
+		return WSA_ERR_MALLOCFAILED;
+	}
+
+	for (i = 0; i < nfft; i++)
+		in[i] = (kiss_fft_scalar) ((i * 7919) % 8192) / 8192;
+
+	// one untimed run to warm up the caches
+	wsa_fft_execute_real(plan, in, out);
+
+	start = wsa_monotonic_time();
+	for (i = 0; i < iterations; i++)
+		wsa_fft_execute_real(plan, in, out);
+	*usec = ((wsa_monotonic_time() - start) * 1000000.0) / (double) iterations;
+
+	wsa_fft_plan_free(plan);
+	free(out);
+	free(in);
+
+	return 0;
+}
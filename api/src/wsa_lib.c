@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "wsa_client.h"
 #include "wsa_error.h"
@@ -1205,6 +1206,50 @@ int32_t wsa_decode_i_only_frame(uint32_t stream_id, uint8_t *data_buf, int16_t *
 	return i/4;
 }
 
+/**
+ * Works out the time stamp of a sample from the time stamp of an earlier
+ * or later one
+ *
+ * @param start - the time stamp of the reference sample
+ * @param offset - the number of samples from the reference sample, 
+ *		negative for earlier samples
+ * @param sample_rate - the sample rate, in Hz
+ * @param time_stamp - where to store the time stamp of the sample
+ *
+ * @return None
+ */
+void wsa_time_add_samples(struct wsa_time const *start, int64_t offset, double sample_rate, 
+						  struct wsa_time *time_stamp)
+{
+	int64_t psec;
+	int64_t sec;
+
+	psec = (int64_t) start->psec + (int64_t) floor((((double) offset) * WSA_PSEC_PER_SEC / sample_rate) + 0.5);
+	sec = (int64_t) start->sec + (psec / (int64_t) WSA_PSEC_PER_SEC);
+	psec = psec % (int64_t) WSA_PSEC_PER_SEC;
+	if (psec < 0) {
+		psec += WSA_PSEC_PER_SEC;
+		sec--;
+	}
+
+	time_stamp->sec = (uint32_t) sec;
+	time_stamp->psec = (uint64_t) psec;
+}
+
+/**
+ * Calculates the time between two time stamps
+ *
+ * @param end - the later time stamp
+ * @param start - the earlier time stamp
+ *
+ * @return The time from start to end in seconds, negative if end is earlier
+ */
+double wsa_time_diff(struct wsa_time const *end, struct wsa_time const *start)
+{
+	return ((double) end->sec - (double) start->sec) + 
+		(((double) end->psec - (double) start->psec) / WSA_PSEC_PER_SEC);
+}
+
 /**
  * Decodes the raw receiver context packet and store it in the receiver 
  * structure
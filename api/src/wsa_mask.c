@@ -0,0 +1,345 @@
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#include "wsa_mask.h"
+#include "wsa_error.h"
+#include "wsa_debug.h"
+
+
+/**
+ * creates an empty mask, with no limit lines
+ *
+ * @return - the mask, or NULL on failure
+ */
+struct wsa_mask *wsa_mask_new(void)
+{
+	struct wsa_mask *mask;
+
+	mask = malloc(sizeof(struct wsa_mask));
+	if (mask == NULL)
+		return NULL;
+
+	memset(mask, 0, sizeof(struct wsa_mask));
+
+	return mask;
+}
+
+
+/**
+ * destroys a mask
+ *
+ * @param mask - the mask to destroy, may be NULL
+ */
+void wsa_mask_free(struct wsa_mask *mask)
+{
+	if (mask == NULL)
+		return;
+
+	free(mask->upper);
+	free(mask->lower);
+	free(mask->upper_limit);
+	free(mask->lower_limit);
+	free(mask);
+}
+
+
+/**
+ * sets one of the limit lines of a mask.  The line is linear in dB 
+ * between its points, and does not apply outside of them; two points at 
+ * the same frequency make a step.
+ *
+ * @param mask - the mask
+ * @param limit - WSA_MASK_UPPER or WSA_MASK_LOWER
+ * @param points - the corners of the line, in increasing frequency order
+ * @param count - the number of points, 0 to remove the line
+ * @return - 0 on success, negative on error
+ */
+int16_t wsa_mask_set_limit(struct wsa_mask *mask, uint32_t limit, 
+	struct wsa_mask_point const *points, uint32_t count)
+{
+	struct wsa_mask_point *copy = NULL;
+	uint32_t i;
+
+	if (limit != WSA_MASK_UPPER && limit != WSA_MASK_LOWER)
+		return WSA_ERR_INVMASK;
+
+	for (i = 1; i < count; i++)
+		if (points[i].freq < points[i - 1].freq)
+			return WSA_ERR_INVMASK;
+
+	if (count) {
+		copy = malloc(sizeof(struct wsa_mask_point) * count);
+		if (copy == NULL)
+			return WSA_ERR_MALLOCFAILED;
+		memcpy(copy, points, sizeof(struct wsa_mask_point) * count);
+	}
+
+	if (limit == WSA_MASK_UPPER) {
+		free(mask->upper);
+		mask->upper = copy;
+		mask->upper_count = count;
+	} else {
+		free(mask->lower);
+		mask->lower = copy;
+		mask->lower_count = count;
+	}
+
+	// the compiled limits no longer match the lines
+	mask->len = 0;
+
+	return 0;
+}
+
+
+/**
+ * samples a limit line at every bin of a frequency axis
+ *
+ * @param points - the corners of the line
+ * @param count - the number of points
+ * @param fstart - the frequency of the first bin, in Hz
+ * @param bin_width - the width of a bin, in Hz
+ * @param len - the number of bins
+ * @param outside - the limit used where the line does not apply
+ * @param limits - where to store the limits
+ */
+static void wsa_mask_sample_line(struct wsa_mask_point const *points, uint32_t count,
+	uint64_t fstart, double bin_width, uint32_t len, float outside, float *limits)
+{
+	uint32_t i;
+	uint32_t j = 0;
+	double freq;
+	double span;
+
+	for (i = 0; i < len; i++) {
+		freq = (double) fstart + (i * bin_width);
+
+		if (count == 0 || freq < (double) points[0].freq || freq > (double) points[count - 1].freq) {
+			limits[i] = outside;
+			continue;
+		}
+
+		// the bins are in order, so the segment only ever moves forward
+		while (j + 1 < count && freq >= (double) points[j + 1].freq)
+			j++;
+
+		if (j + 1 >= count) {
+			limits[i] = points[count - 1].power;
+			continue;
+		}
+
+		span = (double) (points[j + 1].freq - points[j].freq);
+		limits[i] = (float) (points[j].power + 
+			(points[j + 1].power - points[j].power) * ((freq - (double) points[j].freq) / span));
+	}
+}
+
+
+/**
+ * compiles the limit lines of a mask into one upper and one lower limit 
+ * per bin of a spectrum.  Nothing is done if the mask was already 
+ * compiled for the same axis.
+ *
+ * @param mask - the mask
+ * @param fstart - the frequency of the first bin, in Hz
+ * @param fstop - the frequency at the end of the spectrum, in Hz
+ * @param len - the number of bins
+ * @return - 0 on success, negative on error
+ */
+int16_t wsa_mask_compile(struct wsa_mask *mask, uint64_t fstart, uint64_t fstop, uint32_t len)
+{
+	float *upper;
+	float *lower;
+	double bin_width;
+
+	if (len == 0 || fstop <= fstart)
+		return WSA_ERR_INVMASK;
+
+	if (mask->len == len && mask->fstart == fstart && mask->fstop == fstop)
+		return 0;
+
+	if (len > mask->capacity) {
+		upper = realloc(mask->upper_limit, sizeof(float) * len);
+		if (upper == NULL)
+			return WSA_ERR_MALLOCFAILED;
+		mask->upper_limit = upper;
+
+		lower = realloc(mask->lower_limit, sizeof(float) * len);
+		if (lower == NULL)
+			return WSA_ERR_MALLOCFAILED;
+		mask->lower_limit = lower;
+
+		mask->capacity = len;
+	}
+
+	bin_width = ((double) (fstop - fstart)) / len;
+	wsa_mask_sample_line(mask->upper, mask->upper_count, fstart, bin_width, len, 
+		FLT_MAX, mask->upper_limit);
+	wsa_mask_sample_line(mask->lower, mask->lower_count, fstart, bin_width, len, 
+		-FLT_MAX, mask->lower_limit);
+
+	mask->fstart = fstart;
+	mask->fstop = fstop;
+	mask->len = len;
+	doutf(DMED, "wsa_mask_compile: compiled %u bins\n", len);
+
+	return 0;
+}
+
+
+/**
+ * finds the smallest of a - b over two arrays.  Four running minima are 
+ * kept so the compiler can vectorize the scan.
+ *
+ * @param a - the first array
+ * @param b - the second array
+ * @param len - the number of values
+ * @return - the smallest difference, FLT_MAX if len is 0
+ */
+static float wsa_mask_min_difference(float const *a, float const *b, uint32_t len)
+{
+	float lane[4];
+	float diff;
+	float best;
+	uint32_t i, k;
+
+	lane[0] = lane[1] = lane[2] = lane[3] = FLT_MAX;
+	for (i = 0; i + 4 <= len; i += 4) {
+		for (k = 0; k < 4; k++) {
+			diff = a[i + k] - b[i + k];
+			lane[k] = (diff < lane[k]) ? diff : lane[k];
+		}
+	}
+
+	best = lane[0];
+	for (k = 1; k < 4; k++)
+		if (lane[k] < best)
+			best = lane[k];
+	for (; i < len; i++)
+		if (a[i] - b[i] < best)
+			best = a[i] - b[i];
+
+	return best;
+}
+
+
+/**
+ * checks a spectrum against a compiled mask
+ *
+ * The margin of a bin is how far it is inside the mask, in dB; it is 
+ * negative where a limit is failed.  A passing spectrum is checked in a 
+ * single pass, the bins are only walked again to collect the violations 
+ * when something fails.
+ *
+ * @param mask - the mask, compiled for the spectrum's axis
+ * @param data - the spectrum, in dBm, with as many bins as the mask was compiled for
+ * @param violations - where to store the runs of failing bins, may be NULL
+ * @param max_violations - the size of violations
+ * @param violation_count - where to store the number of runs of failing bins,
+ *	which can be more than max_violations
+ * @param worst_margin - where to store the smallest margin of any bin, 
+ *	FLT_MAX if the mask has no limit lines
+ * @return - 0 on success, negative on error
+ */
+int16_t wsa_mask_check(struct wsa_mask *mask, float const *data, 
+	struct wsa_mask_violation *violations, uint32_t max_violations,
+	uint32_t *violation_count, float *worst_margin)
+{
+	struct wsa_mask_violation *current = NULL;
+	struct wsa_mask_violation scratch;
+	float worst = FLT_MAX;
+	float margin;
+	float upper_margin;
+	float lower_margin;
+	double bin_width;
+	uint32_t count = 0;
+	uint32_t limits;
+	uint32_t i;
+
+	*violation_count = 0;
+	*worst_margin = FLT_MAX;
+	if (mask->len == 0)
+		return WSA_ERR_INVMASK;
+
+	if (mask->upper_count)
+		worst = wsa_mask_min_difference(mask->upper_limit, data, mask->len);
+	if (mask->lower_count) {
+		margin = wsa_mask_min_difference(data, mask->lower_limit, mask->len);
+		if (margin < worst)
+			worst = margin;
+	}
+
+	*worst_margin = worst;
+	if (worst >= 0)
+		return 0;
+
+	// something failed, find the runs of failing bins
+	bin_width = ((double) (mask->fstop - mask->fstart)) / mask->len;
+	for (i = 0; i < mask->len; i++) {
+		upper_margin = mask->upper_count ? mask->upper_limit[i] - data[i] : FLT_MAX;
+		lower_margin = mask->lower_count ? data[i] - mask->lower_limit[i] : FLT_MAX;
+
+		limits = 0;
+		if (upper_margin < 0)
+			limits |= WSA_MASK_UPPER;
+		if (lower_margin < 0)
+			limits |= WSA_MASK_LOWER;
+
+		if (!limits) {
+			current = NULL;
+			continue;
+		}
+
+		margin = (upper_margin < lower_margin) ? upper_margin : lower_margin;
+
+		if (current == NULL) {
+			current = (violations && count < max_violations) ? &violations[count] : &scratch;
+			current->start_bin = i;
+			current->fstart = mask->fstart + (uint64_t) (i * bin_width);
+			current->limits = 0;
+			current->worst_bin = i;
+			current->worst_margin = margin;
+			count++;
+		}
+
+		current->stop_bin = i;
+		current->fstop = mask->fstart + (uint64_t) (i * bin_width);
+		current->limits |= limits;
+		if (margin < current->worst_margin) {
+			current->worst_bin = i;
+			current->worst_margin = margin;
+		}
+	}
+
+	*violation_count = count;
+
+	return 0;
+}
+
+
+/**
+ * checks the last spectrum captured with a power spectrum config against 
+ * a mask, compiling the mask for the config's frequency axis if it isn't 
+ * already.  See wsa_mask_check() for the results.
+ *
+ * @param mask - the mask
+ * @param cfg - the power spectrum config holding the spectrum
+ * @param violations - where to store the runs of failing bins, may be NULL
+ * @param max_violations - the size of violations
+ * @param violation_count - where to store the number of runs of failing bins
+ * @param worst_margin - where to store the smallest margin of any bin
+ * @return - 0 on success, negative on error
+ */
+int16_t wsa_mask_evaluate(struct wsa_mask *mask, struct wsa_power_spectrum_config *cfg,
+	struct wsa_mask_violation *violations, uint32_t max_violations,
+	uint32_t *violation_count, float *worst_margin)
+{
+	int16_t result;
+
+	result = wsa_mask_compile(mask, cfg->fstart, cfg->fstop, cfg->buflen);
+	if (result < 0)
+		return result;
+
+	return wsa_mask_check(mask, cfg->buf, violations, max_violations, 
+		violation_count, worst_margin);
+}
@@ -0,0 +1,446 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "wsa_spectrogram.h"
+#include "wsa_api.h"
+#include "wsa_dsp.h"
+#include "wsa_error.h"
+#include "wsa_debug.h"
+
+/// the smallest power converted to dB, to keep empty bins finite
+#define WSA_SPECTROGRAM_MIN_POWER 1e-20
+
+
+/**
+ * creates a spectrogram fed with spectra, such as the consecutive sweeps
+ * of a power spectrum config
+ *
+ * @param width - the number of values in each spectrum
+ * @param capacity - the number of rows kept
+ * @param decimation - the number of spectra averaged into each row, 0 or 1 for none
+ * @return - the spectrogram, or NULL on invalid parameters or failure
+ */
+struct wsa_spectrogram *wsa_spectrogram_new(uint32_t width, uint32_t capacity, uint32_t decimation)
+{
+	struct wsa_spectrogram *sg;
+
+	if (width == 0 || capacity == 0)
+		return NULL;
+
+	sg = malloc(sizeof(struct wsa_spectrogram));
+	if (sg == NULL)
+		return NULL;
+
+	memset(sg, 0, sizeof(struct wsa_spectrogram));
+	sg->width = width;
+	sg->capacity = capacity;
+	sg->decimation = (decimation > 1) ? decimation : 1;
+	sg->rows = malloc(sizeof(float) * width * capacity);
+	sg->time_stamps = malloc(sizeof(struct wsa_time) * capacity);
+	sg->accumulator = malloc(sizeof(double) * width);
+	if (sg->rows == NULL || sg->time_stamps == NULL || sg->accumulator == NULL) {
+		wsa_spectrogram_free(sg);
+		return NULL;
+	}
+
+	wsa_spectrogram_reset(sg);
+
+	return sg;
+}
+
+
+/**
+ * creates a spectrogram fed with the samples of a continuous stream.  
+ * Each spectrum is an fft of fft_size samples, hanning windowed; the 
+ * spectra of real samples are fft_size / 2 wide, those of I/Q samples 
+ * fft_size wide and fft shifted.
+ *
+ * @param fft_size - the number of samples in each fft
+ * @param overlap - the overlap between consecutive ffts, in percent (0 to 99)
+ * @param iq - 1 for I/Q samples, 0 for real samples
+ * @param sample_rate - the sample rate, in Hz, to time stamp rows with
+ * @param capacity - the number of rows kept
+ * @param decimation - the number of spectra averaged into each row, 0 or 1 for none
+ * @return - the spectrogram, or NULL on invalid parameters or failure
+ */
+struct wsa_spectrogram *wsa_spectrogram_new_stream(uint32_t fft_size,
+					uint32_t overlap,
+					uint8_t iq,
+					double sample_rate,
+					uint32_t capacity,
+					uint32_t decimation)
+{
+	struct wsa_spectrogram *sg;
+
+	if (fft_size < 2 || overlap >= 100 || sample_rate <= 0)
+		return NULL;
+
+	sg = wsa_spectrogram_new(iq ? fft_size : (fft_size >> 1), capacity, decimation);
+	if (sg == NULL)
+		return NULL;
+
+	sg->fft_size = fft_size;
+	sg->hop = (fft_size * (100 - overlap)) / 100;
+	if (sg->hop < 1)
+		sg->hop = 1;
+	sg->iq = iq ? 1 : 0;
+	sg->sample_rate = sample_rate;
+	sg->plan = wsa_fft_plan_new((int32_t) fft_size, iq ? WSA_FFT_COMPLEX : WSA_FFT_REAL);
+	sg->fftout = malloc(sizeof(kiss_fft_cpx) * fft_size);
+	sg->power = malloc(sizeof(kiss_fft_scalar) * fft_size);
+	sg->window = malloc(sizeof(kiss_fft_scalar) * fft_size);
+	if (iq)
+		sg->segment_cpx = malloc(sizeof(kiss_fft_cpx) * fft_size);
+	else
+		sg->segment = malloc(sizeof(kiss_fft_scalar) * fft_size);
+
+	if (sg->plan == NULL || sg->fftout == NULL || sg->power == NULL || sg->window == NULL || 
+		(sg->segment == NULL && sg->segment_cpx == NULL)) {
+		wsa_spectrogram_free(sg);
+		return NULL;
+	}
+	window_hanning_table(sg->window, (int) fft_size);
+
+	return sg;
+}
+
+
+/**
+ * destroys a spectrogram
+ *
+ * @param sg - the spectrogram, may be NULL
+ */
+void wsa_spectrogram_free(struct wsa_spectrogram *sg)
+{
+	if (sg == NULL)
+		return;
+
+	wsa_fft_plan_free(sg->plan);
+	free(sg->qdata);
+	free(sg->idata);
+	free(sg->i32_buffer);
+	free(sg->q16_buffer);
+	free(sg->i16_buffer);
+	free(sg->power);
+	free(sg->fftout);
+	free(sg->segment_cpx);
+	free(sg->segment);
+	free(sg->window);
+	free(sg->pending_cpx);
+	free(sg->pending);
+	free(sg->accumulator);
+	free(sg->time_stamps);
+	free(sg->rows);
+	free(sg);
+}
+
+
+/**
+ * empties a spectrogram: drops its rows, the row being averaged and any 
+ * samples waiting for a complete fft
+ *
+ * @param sg - the spectrogram
+ */
+void wsa_spectrogram_reset(struct wsa_spectrogram *sg)
+{
+	uint32_t i;
+
+	sg->rows_written = 0;
+	sg->accumulated = 0;
+	sg->pending_len = 0;
+	for (i = 0; i < sg->width; i++)
+		sg->accumulator[i] = 0;
+}
+
+
+/**
+ * writes the averaged spectra out as the next row of the ring
+ *
+ * @param sg - the spectrogram
+ * @param reflevel - the level to add to the row, in dB
+ */
+static void wsa_spectrogram_write_row(struct wsa_spectrogram *sg, float reflevel)
+{
+	uint32_t slot = (uint32_t) (sg->rows_written % sg->capacity);
+	float *row = sg->rows + ((size_t) slot * sg->width);
+	double power;
+	uint32_t i;
+
+	for (i = 0; i < sg->width; i++) {
+		power = sg->accumulator[i] / sg->accumulated;
+		if (power < WSA_SPECTROGRAM_MIN_POWER)
+			power = WSA_SPECTROGRAM_MIN_POWER;
+		row[i] = (float) (10 * log10(power)) + reflevel;
+		sg->accumulator[i] = 0;
+	}
+
+	sg->time_stamps[slot] = sg->row_time;
+	sg->accumulated = 0;
+	sg->rows_written++;
+}
+
+
+/**
+ * adds a spectrum to a spectrogram created with wsa_spectrogram_new()
+ *
+ * @param sg - the spectrogram
+ * @param data - the spectrum, in dBm
+ * @param len - the number of values in data, which must be the width of the spectrogram
+ * @param time_stamp - the time of the spectrum
+ * @return - the number of rows written (0 or 1), negative on error
+ */
+int32_t wsa_spectrogram_add_spectrum(struct wsa_spectrogram *sg, 
+					float const *data, 
+					uint32_t len, 
+					struct wsa_time const *time_stamp)
+{
+	uint32_t i;
+
+	if (len != sg->width)
+		return WSA_ERR_INVCAPTURESIZE;
+
+	if (sg->accumulated == 0)
+		sg->row_time = *time_stamp;
+
+	for (i = 0; i < len; i++)
+		sg->accumulator[i] += pow(10, data[i] / 10.0);
+	sg->accumulated++;
+
+	if (sg->accumulated < sg->decimation)
+		return 0;
+
+	wsa_spectrogram_write_row(sg, 0);
+
+	return 1;
+}
+
+
+/**
+ * makes room for more pending samples
+ *
+ * @param sg - the spectrogram
+ * @param size - the number of samples needed
+ * @return - 0 on success, negative on failure
+ */
+static int16_t wsa_spectrogram_reserve(struct wsa_spectrogram *sg, uint32_t size)
+{
+	kiss_fft_scalar *pending;
+	kiss_fft_cpx *pending_cpx;
+
+	if (size <= sg->pending_size)
+		return 0;
+
+	if (sg->iq) {
+		pending_cpx = realloc(sg->pending_cpx, sizeof(kiss_fft_cpx) * size);
+		if (pending_cpx == NULL)
+			return WSA_ERR_MALLOCFAILED;
+		sg->pending_cpx = pending_cpx;
+	} else {
+		pending = realloc(sg->pending, sizeof(kiss_fft_scalar) * size);
+		if (pending == NULL)
+			return WSA_ERR_MALLOCFAILED;
+		sg->pending = pending;
+	}
+	sg->pending_size = size;
+
+	return 0;
+}
+
+
+/**
+ * adds samples to a spectrogram created with wsa_spectrogram_new_stream().
+ * Blocks are joined into one stream, so an fft can span two of them, 
+ * unless the time stamp of a block shows samples were lost before it.
+ *
+ * @param sg - the spectrogram
+ * @param idata - the I samples
+ * @param qdata - the Q samples, ignored for real samples
+ * @param len - the number of samples
+ * @param time_stamp - the time of the first sample
+ * @param reflevel - the reference level of the samples, in dBm
+ * @return - the number of rows written, negative on error
+ */
+int32_t wsa_spectrogram_add_samples(struct wsa_spectrogram *sg,
+					kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					uint32_t len,
+					struct wsa_time const *time_stamp,
+					float reflevel)
+{
+	struct wsa_time expected;
+	kiss_fft_scalar scale;
+	uint32_t pos = 0;
+	int32_t rows = 0;
+	uint32_t i;
+	int16_t result;
+
+	if (sg->plan == NULL || (sg->iq && qdata == NULL))
+		return WSA_ERR_INVNUMBER;
+
+	// start over after a gap in the stream
+	if (sg->pending_len) {
+		wsa_time_add_samples(&sg->pending_time, sg->pending_len, sg->sample_rate, &expected);
+		if (fabs(wsa_time_diff(time_stamp, &expected)) * sg->sample_rate > 0.5) {
+			doutf(DMED, "wsa_spectrogram_add_samples: dropped %u samples before a gap\n", sg->pending_len);
+			sg->pending_len = 0;
+		}
+	}
+	if (sg->pending_len == 0)
+		sg->pending_time = *time_stamp;
+
+	result = wsa_spectrogram_reserve(sg, sg->pending_len + len);
+	if (result < 0)
+		return result;
+
+	if (sg->iq) {
+		for (i = 0; i < len; i++) {
+			sg->pending_cpx[sg->pending_len + i].r = idata[i];
+			sg->pending_cpx[sg->pending_len + i].i = qdata[i];
+		}
+	} else {
+		memcpy(sg->pending + sg->pending_len, idata, sizeof(kiss_fft_scalar) * len);
+	}
+	sg->pending_len += len;
+
+	scale = (kiss_fft_scalar) (1.0 / ((double) sg->fft_size * (double) sg->fft_size));
+	for (pos = 0; pos + sg->fft_size <= sg->pending_len; pos += sg->hop) {
+		if (sg->iq) {
+			psd_welch_power_cpx(sg->plan, sg->pending_cpx + pos, sg->window, (int32_t) sg->fft_size, 
+				(int32_t) sg->fft_size, (int32_t) sg->fft_size, sg->segment_cpx, sg->fftout, sg->power);
+		} else {
+			psd_welch_accumulate(sg->plan, sg->pending + pos, sg->window, (int32_t) sg->fft_size, 
+				(int32_t) sg->hop, 0, 1, sg->segment, sg->fftout, sg->power);
+			for (i = 0; i < sg->width; i++)
+				sg->power[i] *= scale;
+		}
+
+		if (sg->accumulated == 0)
+			wsa_time_add_samples(&sg->pending_time, pos, sg->sample_rate, &sg->row_time);
+
+		for (i = 0; i < sg->width; i++)
+			sg->accumulator[i] += sg->power[i];
+		sg->accumulated++;
+
+		if (sg->accumulated == sg->decimation) {
+			wsa_spectrogram_write_row(sg, reflevel);
+			rows++;
+		}
+	}
+
+	// keep what the next fft still needs
+	if (pos) {
+		if (sg->iq)
+			memmove(sg->pending_cpx, sg->pending_cpx + pos, sizeof(kiss_fft_cpx) * (sg->pending_len - pos));
+		else
+			memmove(sg->pending, sg->pending + pos, sizeof(kiss_fft_scalar) * (sg->pending_len - pos));
+		sg->pending_len -= pos;
+		wsa_time_add_samples(&sg->pending_time, pos, sg->sample_rate, &sg->pending_time);
+	}
+
+	return rows;
+}
+
+
+/**
+ * reads data packets from a running stream (see wsa_stream_start()) into
+ * a spectrogram created with wsa_spectrogram_new_stream(), using the VRT
+ * time stamps of the packets and the reference level of their context
+ *
+ * @param dev - the device streaming
+ * @param sg - the spectrogram
+ * @param samples_per_packet - the samples per packet of the stream
+ * @param packets - the number of data packets to read
+ * @return - the number of rows written, WSA_ERR_INVSTREAMTYPE if the data 
+ * stream does not match the I/Q setting of the spectrogram, negative on 
+ * other errors
+ */
+int32_t wsa_spectrogram_read_stream(struct wsa_device *dev, 
+					struct wsa_spectrogram *sg, 
+					int32_t samples_per_packet, 
+					int32_t packets)
+{
+	struct wsa_vrt_packet_header header;
+	struct wsa_vrt_packet_trailer trailer;
+	struct wsa_receiver_packet receiver;
+	struct wsa_digitizer_packet digitizer;
+	struct wsa_extension_packet extension;
+	int32_t rows = 0;
+	int32_t result;
+
+	if (samples_per_packet <= 0)
+		return WSA_ERR_INVNUMBER;
+
+	// the decode buffers stay with the spectrogram for the next call
+	if ((uint32_t) samples_per_packet > sg->decode_size) {
+		free(sg->qdata);
+		free(sg->idata);
+		free(sg->i32_buffer);
+		free(sg->q16_buffer);
+		free(sg->i16_buffer);
+		sg->i16_buffer = malloc(sizeof(int16_t) * samples_per_packet);
+		sg->q16_buffer = malloc(sizeof(int16_t) * samples_per_packet);
+		sg->i32_buffer = malloc(sizeof(int32_t) * samples_per_packet);
+		sg->idata = malloc(sizeof(kiss_fft_scalar) * samples_per_packet);
+		sg->qdata = malloc(sizeof(kiss_fft_scalar) * samples_per_packet);
+		sg->decode_size = (uint32_t) samples_per_packet;
+		if (sg->i16_buffer == NULL || sg->q16_buffer == NULL || sg->i32_buffer == NULL || 
+			sg->idata == NULL || sg->qdata == NULL) {
+			sg->decode_size = 0;
+			return WSA_ERR_MALLOCFAILED;
+		}
+	}
+
+	while (packets > 0) {
+		result = wsa_read_vrt_packet(dev, &header, &trailer, &receiver, &digitizer, &extension,
+			sg->i16_buffer, sg->q16_buffer, sg->i32_buffer, samples_per_packet, 5000);
+		if (result < 0)
+			return result;
+
+		if (header.stream_id == DIGITIZER_STREAM_ID &&
+			(digitizer.indicator_field & REF_LEVEL_INDICATOR_MASK) == REF_LEVEL_INDICATOR_MASK)
+			sg->reflevel = (float) digitizer.reference_level;
+
+		if (header.packet_type != IF_PACKET_TYPE)
+			continue;
+		packets--;
+
+		// I/Q spectrograms need both channels, real ones a single channel
+		if ((header.stream_id == I16Q16_DATA_STREAM_ID) != (sg->iq != 0))
+			return WSA_ERR_INVSTREAMTYPE;
+
+		normalize_iq_data(header.samples_per_packet, header.stream_id, sg->i16_buffer, sg->q16_buffer, 
+			sg->i32_buffer, sg->idata, sg->qdata);
+		result = wsa_spectrogram_add_samples(sg, sg->idata, sg->qdata, header.samples_per_packet, 
+			&header.time_stamp, sg->reflevel);
+		if (result < 0)
+			return result;
+		rows += result;
+	}
+
+	return rows;
+}
+
+
+/**
+ * finds a row of a spectrogram in its ring.  The row stays valid until 
+ * capacity more rows are written.
+ *
+ * @param sg - the spectrogram
+ * @param row - the number of the row, counting from 0 for the first one written
+ * @param time_stamp - where to store the time of the row, may be NULL
+ * @return - the row, or NULL if it hasn't been written or was overwritten
+ */
+float *wsa_spectrogram_get_row(struct wsa_spectrogram *sg, uint64_t row, struct wsa_time *time_stamp)
+{
+	uint32_t slot;
+
+	if (row >= sg->rows_written || sg->rows_written - row > sg->capacity)
+		return NULL;
+
+	slot = (uint32_t) (row % sg->capacity);
+	if (time_stamp)
+		*time_stamp = sg->time_stamps[slot];
+
+	return sg->rows + ((size_t) slot * sg->width);
+}
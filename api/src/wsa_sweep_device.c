@@ -18,6 +18,8 @@
 #include "kiss_fft.h"
 #include "wsa_dsp.h"
 #include "wsa_debug.h"
+#include "wsa_error.h"
+#include "wsa_thread.h"
 #ifndef _TIMES_H
 #define _TIMES_H
 
@@ -82,12 +84,231 @@ typedef long long suseconds_t ;
 /// sample types
 #define SAMPLETYPE_IQ 1
 #define SAMPLETYPE_I_ONLY 2
+#define SAMPLETYPE_I32 3
 
 /// error values
 #define EFREQOUTOFRANGE 1
 #define EUNSUPPORTED 2
 #define EINVCAPTSIZE 3
 #define ENOMEM 4
+#define EINVPARAM 5
+
+/// largest welch segment overlap accepted, in percent
+#define WSA_MAX_WELCH_OVERLAP 90
+
+/// most threads a power spectrum config will use
+#define WSA_MAX_THREADS 64
+
+/// the smallest power converted to dB (-200 dB), so bins the fixed point 
+/// fft rounds to zero stay finite
+#define WSA_MIN_POWER 1e-20f
+
+/// the number of welch segments each job sums, fixed so that the way the 
+/// segments are added up doesn't depend on the number of threads
+#define WSA_SEGMENTS_PER_JOB 4
+
+/// the sweep time model the planner minimizes, and devices start from: 
+/// the time to retune and settle at each step, the overhead of each 
+/// packet, and the time to move a byte of samples over the network (about
+/// 100 MB/s on gigabit ethernet)
+#define WSA_PLAN_RETUNE_TIME 0.001
+#define WSA_PLAN_PACKET_TIME 0.00002
+#define WSA_PLAN_BYTE_TIME (1.0 / 100e6)
+
+/// how many observed steps the starting sweep time model counts for when
+/// it is fitted to a device
+#define WSA_TIMING_PRIOR_STEPS 10
+
+/// the part of the bandwidth the device's decimation filter keeps, in percent
+#define WSA_DECIMATED_USABLE 80
+
+/// where the spectrum of a captured block goes in the buffer
+struct wsa_block_info {
+	float reflevel;
+	uint8_t invert;
+	uint32_t istart;
+	uint32_t ilen;
+	uint32_t buf_offset;
+	uint32_t step;
+};
+
+/// a batch of captured blocks that the workers turn into spectrum
+struct wsa_block_batch {
+	struct wsa_power_spectrum_config *cfg;
+	uint32_t trace_weight;
+
+	/// samples in each block, and the welch layout of those samples
+	int32_t block_len;
+	int32_t hop;
+	int32_t segments;
+	int32_t jobs_per_block;
+
+	/// blocks in the batch, and how many fit
+	int32_t count;
+	int32_t max_count;
+
+	/// the blocks last handed to the workers
+	int32_t started;
+
+	/// the samples of each block (max_count * block_len), normalized for 
+	/// the floating point fft or raw for the fixed point one (32 bit for 
+	/// HDR), with the Q samples apart for I/Q data
+	kiss_fft_scalar *idata;
+	kiss_fft_scalar *qdata;
+	int16_t *i16data;
+	int32_t *i32data;
+
+	/// 1 for I/Q data, whose spectrum has fft_size bins instead of fft_size / 2
+	uint8_t iq;
+	int32_t bins;
+
+	/// the power summed by each job (max_count * jobs_per_block * bins)
+	kiss_fft_scalar *partial;
+
+	/// the window of the floating point fft, and per worker fft plans and 
+	/// scratch memory (workers * fft_size)
+	kiss_fft_scalar *scalar_window;
+	struct wsa_fft_plan **plans;
+	kiss_fft_scalar *segment;
+	kiss_fft_cpx *cpx_segment;
+	kiss_fft_cpx *fftout;
+
+	/// the fixed point window, and per worker scratch memory (workers * (fft_size + 2))
+	int16_t *window;
+	int32_t *fixed_segment;
+	int32_t *fixed_fftout;
+
+	struct wsa_block_info *info;
+
+	/// the segment jobs of each block still running; the job that brings 
+	/// a block's count to 0 finishes the block
+	int32_t *jobs_left;
+	struct wsa_mutex *lock;
+
+	/// set by a job that fails
+	int32_t error;
+};
+
+/// the memory a capture works in, kept by the config between captures
+struct wsa_capture_workspace {
+	/// what the memory was sized for
+	uint32_t samples_per_packet;
+	uint32_t packets_per_block;
+	uint32_t fft_size;
+	uint32_t welch_overlap;
+	uint32_t fixed_point;
+	int32_t workers;
+	uint8_t pipelined;
+
+	/// the samples of the packet being read
+	int16_t *i16_buffer;
+	int16_t *q16_buffer;
+	int32_t *i32_buffer;
+
+	/// removes the DC offset and I/Q imbalance of I/Q packets as they are 
+	/// decoded, estimated afresh for each step.  A tone within a bin of 
+	/// the center of a step is taken for DC.
+	struct psd_iq_corrector corrector;
+
+	/// the batch being read into, and the one the workers process while 
+	/// it is when the capture is pipelined
+	struct wsa_block_batch batches[2];
+};
+
+/// an adaptive sweep: the steps of the full sweep list, where each goes 
+/// in the buffer and what it looked like when last swept, and the steps 
+/// of the list loaded on the device
+struct wsa_adaptive_sweep {
+	/// how much a step must change to be swept again, in dB, the most 
+	/// sweeps a step is left out for, and the sweeps between full sweeps
+	float threshold;
+	uint32_t max_age;
+	uint32_t refresh;
+
+	/// the plan and buffer the steps were laid out for
+	struct wsa_sweep_plan *plan;
+	uint32_t buflen;
+	uint32_t step_count;
+
+	/// the plan entry and center frequency of each step, NULL for the DD step
+	struct wsa_sweep_plan **entries;
+	uint64_t *fcenter;
+
+	/// where each step goes in the buffer, known after a full sweep
+	uint32_t *buf_offset;
+	uint32_t *ilen;
+	uint8_t known;
+
+	/// the sweep each step was last swept in, and whether it changed then
+	uint32_t *last_swept;
+	uint8_t *changed;
+
+	/// the total power of each step, and of its strongest bin, when last swept, in dB
+	float *power;
+	float *peak;
+
+	/// the steps of the next sweep, in sweep order, and the steps of the 
+	/// list on the device when it isn't the full list
+	uint32_t *order;
+	uint32_t order_len;
+	uint32_t *loaded;
+	uint32_t loaded_len;
+	uint8_t reduced;
+
+	/// how long loading the last reduced list took, and the full list, in seconds
+	double load_time;
+	double full_load_time;
+
+	/// the sweeps done, and the last full one
+	uint32_t sweeps;
+	uint32_t last_full;
+};
+
+/// the most plans kept around once no config uses them
+#define WSA_PLAN_CACHE_SIZE 16
+
+/// a sweep plan and the layout of the spectrum it produces, shared by 
+/// every config that asks for the same sweep, and never changed once made
+struct wsa_shared_plan {
+	/// what was asked for
+	uint64_t fstart;
+	uint64_t fstop;
+	uint64_t requested_rbw;
+	uint32_t mode;
+	uint32_t welch_segments;
+	uint32_t welch_overlap;
+	char model[MAX_STR_LEN];
+
+	/// the number of configs using the plan
+	int32_t refs;
+
+	/// the plan, and the settings it results in
+	struct wsa_sweep_plan *sweep_plan;
+	uint64_t rbw;
+	uint32_t packet_total;
+	uint32_t packets_per_block;
+	uint32_t samples_per_packet;
+	uint32_t fft_size;
+	uint32_t decimation;
+	uint32_t buflen;
+	uint8_t only_dd;
+
+	/// the usable bins of a block's spectrum, upright [0] or inverted [1],
+	/// and of the DD block, which always goes at the start of the buffer
+	uint32_t istart[2];
+	uint32_t ilen[2];
+	uint32_t dd_istart;
+	uint32_t dd_ilen;
+
+	/// the frequency of each bin of the buffer
+	double *freqs;
+
+	/// the next plan in the cache, most recently used first
+	struct wsa_shared_plan *next;
+};
+
+/// the plans made so far, guarded by wsa_mutex_global()
+static struct wsa_shared_plan *wsa_plan_cache = NULL;
 
 /*
  * define internal functions
@@ -95,6 +316,17 @@ typedef long long suseconds_t ;
 static int wsa_plan_sweep(struct wsa_power_spectrum_config *);
 static int wsa_sweep_plan_load(struct wsa_sweep_device *, struct wsa_power_spectrum_config *);
 static struct wsa_sweep_device_properties *wsa_get_sweep_device_properties(uint32_t);
+static struct wsa_sweep_device_properties *wsa_config_properties(struct wsa_power_spectrum_config *, struct wsa_sweep_device_properties *);
+static void wsa_sweep_plan_free(struct wsa_sweep_plan *);
+static int wsa_capture_workspace_prepare(struct wsa_power_spectrum_config *);
+static int wsa_shared_plan_get(struct wsa_power_spectrum_config *, char const *);
+static void wsa_shared_plan_release(struct wsa_shared_plan *);
+static void wsa_sweep_timing_observe(struct wsa_sweep_timing *, struct wsa_sweep_device_properties *, uint32_t, uint32_t, double);
+static void wsa_sweep_timing_fit(struct wsa_sweep_timing *);
+static void wsa_capture_workspace_free(struct wsa_capture_workspace *);
+static void wsa_adaptive_sweep_free(struct wsa_adaptive_sweep *);
+static int wsa_adaptive_load(struct wsa_sweep_device *, struct wsa_power_spectrum_config *);
+static double wsa_step_time(struct wsa_sweep_timing const *, struct wsa_sweep_device_properties *, uint32_t, uint32_t);
 
 
 /// a list of properties that are attributed to each mode
@@ -130,6 +362,40 @@ static struct wsa_sweep_device_properties wsa_sweep_device_properties[] = {
 		62500*KHZ, 50*MHZ, 31250*KHZ, 0*MHZ, 50*MHZ, 
 		1, 1
 	},
+
+	// the I/Q modes span the whole sample rate, with DC (the center 
+	// frequency) in the middle of the fft shifted spectrum
+
+	// ZIF
+	{ 
+		MODE_ZIF, SAMPLETYPE_IQ, 0,
+		50ULL*MHZ, 27ULL*GHZ, 10,
+		125*MHZ, 100*MHZ, 62500*KHZ, 12500*KHZ, 112500*KHZ, 
+		4, 512
+	},
+
+	// HDR, with 32 bit samples
+	{ 
+		MODE_HDR, SAMPLETYPE_I32, 0,
+		50ULL*MHZ, 27ULL*GHZ, 10,
+		162760, 100*KHZ, 81666, 31666, 131666, 
+		1, 1
+	},
+
+	// DECSH and DECSHN, the superhet passband brought down to I/Q and 
+	// decimated by the device, described at their smallest decimation
+	{ 
+		MODE_DECSH, SAMPLETYPE_IQ, 0,
+		50ULL*MHZ, 27ULL*GHZ, 10,
+		31250*KHZ, 25*MHZ, 15625*KHZ, 3125*KHZ, 28125*KHZ, 
+		4, 512
+	},
+	{ 
+		MODE_DECSHN, SAMPLETYPE_IQ, 0,
+		50ULL*MHZ, 27ULL*GHZ, 10,
+		31250*KHZ, 10*MHZ, 15625*KHZ, 10625*KHZ, 20625*KHZ, 
+		4, 512
+	},
 	// list terminator
 	{ 
 		0, 0, 0, 0,
@@ -201,13 +467,27 @@ static const char *mode_const_to_string(uint32_t modeint)
 	return NULL;
 }
 
+
+/**
+ * the number of bins in the spectrum of an fft of a mode's samples
+ *
+ * @param prop - the properties of the mode
+ * @param fft_size - the fft size
+ * @return - fft_size for I/Q samples, fft_size / 2 for real ones (whose 
+ *	spectrum mirrors the other half)
+ */
+static uint32_t wsa_spectrum_bins(struct wsa_sweep_device_properties *prop, uint32_t fft_size)
+{
+	return (prop->sample_type == SAMPLETYPE_IQ) ? fft_size : (fft_size >> 1);
+}
+
 /**
  * creates a new sweep plan entry and initializes it with values given
  *
  * @param device - a pointer to the wsa we've connected to
  * @return - a pointer to the allocated sweep plan struct, or NULL on failure
  */
-struct wsa_sweep_plan *wsa_sweep_plan_entry_new(uint64_t fcstart, uint64_t fcstop, uint32_t fstep, uint32_t spp, uint32_t ppb, uint8_t dd_mode)
+struct wsa_sweep_plan *wsa_sweep_plan_entry_new(uint64_t fcstart, uint64_t fcstop, uint32_t fstep, uint32_t spp, uint32_t ppb, uint32_t decimation, uint8_t dd_mode)
 {
 	struct wsa_sweep_plan *plan;
 
@@ -223,6 +503,7 @@ struct wsa_sweep_plan *wsa_sweep_plan_entry_new(uint64_t fcstart, uint64_t fcsto
 	plan->fstep = fstep;
 	plan->spp = spp;
 	plan->ppb = ppb;
+	plan->decimation = decimation;
 	plan->dd_mode = dd_mode;
 
 	return plan;
@@ -246,6 +527,7 @@ struct wsa_sweep_device *wsa_sweep_device_new(struct wsa_device *device)
 
 	// initialize everything in the struct
 	sweepdev->real_device = device;
+	wsa_sweep_timing_reset(sweepdev);
 
 	return sweepdev;
 }
@@ -284,10 +566,9 @@ int wsa_power_spectrum_alloc(
 )
 {
 	struct wsa_power_spectrum_config *pscfg;
+	uint32_t i;
 	int result;
 
-	// right now, we don't need sweep_device or mode, so just pretend to use it to get rid of compile warnings
-	sweep_device = sweep_device;
 	// alloc some memory for it
 	pscfg = malloc(sizeof(struct wsa_power_spectrum_config));
 	if (pscfg == NULL){
@@ -298,29 +579,74 @@ int wsa_power_spectrum_alloc(
 
 	// init things in it that must be initted
 	pscfg->sweep_plan = NULL;
+	pscfg->shared_plan = NULL;
+	pscfg->freqs = NULL;
 	pscfg->buf = NULL;
+	pscfg->back_buf = NULL;
+	pscfg->trace_acc = NULL;
+	pscfg->welch_segments = 1;
+	pscfg->welch_overlap = 0;
+	pscfg->trace_mode = WSA_TRACE_CLEAR_WRITE;
+	pscfg->trace_average = 1;
+	pscfg->trace_count = 0;
+	pscfg->fixed_point = 0;
+	pscfg->decimation = 1;
+	pscfg->threads = 1;
+	pscfg->pipeline = 0;
+	pscfg->worker_pool = NULL;
+	pscfg->workspace = NULL;
+	pscfg->step_callback = NULL;
+	pscfg->step_arg = NULL;
+	pscfg->steps_done = 0;
+	pscfg->adaptive = NULL;
+	pscfg->output_format = WSA_OUTPUT_FLOAT;
+	pscfg->cdb16_buf = NULL;
+	pscfg->u8_buf = NULL;
+	pscfg->u8_offset = 0;
+	pscfg->u8_scale = 0;
+	pscfg->u8_auto = 0;
 
 	// copy the sweep settings into the cfg object
 	pscfg->mode = mode_string_to_const(mode);
 	pscfg->fstart = fstart;
 	pscfg->fstop = fstop;
 	pscfg->rbw = (uint64_t) rbw;
+	pscfg->requested_rbw = (uint64_t) rbw;
 
 	// figure out a way to get that spectrum
 
-	result = wsa_plan_sweep(pscfg);
+	result = wsa_shared_plan_get(pscfg, sweep_device->real_device->descr.dev_model);
 	if (result < 0){
+		wsa_power_spectrum_free(pscfg);
 		return result;
 	}
 
 	// now allocate enough buffer for the spectrum
-	pscfg->buflen = (uint32_t) ((pscfg->fstop - pscfg->fstart) / pscfg->rbw);
-
 	pscfg->buf = malloc(sizeof(float) * pscfg->buflen);
 	if (pscfg->buf == NULL) {
-		free(pscfg);
+		wsa_power_spectrum_free(pscfg);
+		return -1;
+	}
+
+	pscfg->trace_acc = malloc(sizeof(float) * pscfg->buflen);
+	if (pscfg->trace_acc == NULL) {
+		wsa_power_spectrum_free(pscfg);
 		return -1;
 	}
+
+	// poison the buffer once, captures only overwrite it
+	for (i = 0; i < pscfg->buflen; i++) {
+		pscfg->buf[i] = 77;
+		pscfg->trace_acc[i] = 0;
+	}
+
+	// and set up everything the captures work in
+	result = wsa_capture_workspace_prepare(pscfg);
+	if (result < 0) {
+		wsa_power_spectrum_free(pscfg);
+		return result;
+	}
+
 	*pscfgptr = pscfg;
 	return 0;
 }
@@ -333,10 +659,36 @@ int wsa_power_spectrum_alloc(
  */
 void wsa_power_spectrum_free(struct wsa_power_spectrum_config *cfg)
 {
-	struct wsa_sweep_plan *plan, *next;
+	// let go of the plan, if there is one
+	wsa_shared_plan_release(cfg->shared_plan);
+
+	// stop the workers, and free what they worked in
+	wsa_worker_pool_free(cfg->worker_pool);
+	wsa_capture_workspace_free(cfg->workspace);
+	wsa_adaptive_sweep_free(cfg->adaptive);
+
+	// free the buffers
+	if (cfg->buf)
+		free(cfg->buf);
+	free(cfg->back_buf);
+	free(cfg->trace_acc);
+	free(cfg->cdb16_buf);
+	free(cfg->u8_buf);
+
+	// free the struct
+	free(cfg);
+}
+
+
+/**
+ * frees a list of sweep plan entries
+ *
+ * @param plan - the first entry of the list, may be NULL
+ */
+static void wsa_sweep_plan_free(struct wsa_sweep_plan *plan)
+{
+	struct wsa_sweep_plan *next;
 
-	// free the plan, if there is one
-	plan = cfg->sweep_plan;
 	for (;;) {
 		// list is null terminated
 		if (plan == NULL)
@@ -351,285 +703,2011 @@ void wsa_power_spectrum_free(struct wsa_power_spectrum_config *cfg)
 		// go to next item
 		plan = next;
 	}
-
-	// free the buffer
-	if (cfg->buf)
-		free(cfg->buf);
-
-	// free the struct
-	free(cfg);
 }
 
-/**
- * Configure the WSA to the configuration in the power spectrum config structure
- *
- * @param sweep_device - the sweep device to use
- * @param cfg - the power spectrum config to use
- */
-void wsa_configure_sweep(struct wsa_sweep_device *sweep_device, struct wsa_power_spectrum_config *pscfg)
-{
-	// load the sweep plan
-	wsa_sweep_plan_load(sweep_device, pscfg);
-}
 
 /**
- * captures some power spectrum using the configuration supplied
+ * sets up welch averaging: every block is split into overlapping segments
+ * of fft_size samples whose power is averaged, which lowers the variance 
+ * of the spectrum without changing the rbw.  The sweep is re-planned so 
+ * that each block holds enough packets, so wsa_configure_sweep() must be 
+ * called again before the next capture.  A new plan restarts the trace, 
+ * and if it changes the length of the spectrum the buffers are replaced.
+ * A failed re-plan leaves the config untouched.
  *
- * @param sweep_device - the sweep device to use
- * @param cfg - the power spectrum config to use
- * @param buf - if buf is not NULL, a pointer to the allocated memory is stored there for convience
- * @return - 0 on success, negative on error
+ * @param cfg - the power spectrum config to change
+ * @param segments - the minimum number of segments per block, 1 disables welch averaging
+ * @param overlap - the overlap between consecutive segments, in percent
+ * @returns - negative on error, 0 on success
  */
-int wsa_capture_power_spectrum(
-	struct wsa_sweep_device *sweep_device,
-	struct wsa_power_spectrum_config *cfg,
-	float **buf
-)
+int wsa_power_spectrum_set_averaging(struct wsa_power_spectrum_config *cfg, uint32_t segments, uint32_t overlap)
 {
+	struct wsa_power_spectrum_config saved;
+	float *buf = NULL;
+	float *trace_acc = NULL;
+	int16_t *cdb16_buf = NULL;
+	uint8_t *u8_buf = NULL;
 	uint32_t i;
-	int16_t result;
-	const uint32_t total_samples = cfg->samples_per_packet * cfg->packets_per_block;
-	struct wsa_device *dev = sweep_device->real_device;
-	struct wsa_vrt_packet_header header;
-	struct wsa_vrt_packet_trailer trailer;
-	struct wsa_receiver_packet receiver;
-	struct wsa_digitizer_packet digitizer;
-	struct wsa_extension_packet sweep;
-	int16_t *i16_buffer;
-	int16_t *tmp_buffer;
-	int16_t *q16_buffer;
-	int32_t *i32_buffer;
-	kiss_fft_scalar *idata;
-	kiss_fft_cpx *fftout;
-	float pkt_reflevel = 0;
-	uint64_t pkt_fcenter = 0;
-	uint32_t buf_offset = 0;
-	kiss_fft_scalar tmpscalar;
-	uint32_t packet_count;
-	struct wsa_sweep_device_properties *prop;
-	struct wsa_sweep_device_properties *dd_prop;
-	uint32_t istart, istop, ilen;
-	uint32_t spp, fftlen;
-	int16_t dd_packet = 0;
-	int32_t ppb_count = 0;
-	int32_t offset = 0;
-	int x;
-	
-	// do a malloc to allocate data for each buffer
-	i16_buffer = (int16_t *) malloc(sizeof(int16_t) * total_samples);
-	tmp_buffer = (int16_t *) malloc(sizeof(int16_t) * cfg->samples_per_packet);
-	doutf(DHIGH, "wsa_capture_power_spectrum: Created I Data buffer sized: %d\n", (int) total_samples);
-	idata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * total_samples);
-	fftout = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * total_samples);
-
-
-	// assign their convienence pointer
-	if (*buf)
-		*buf = cfg->buf;
+	int result;
 
-	// poison our buffer
-	for (i=0; i<cfg->buflen; i++)
-		cfg->buf[i] = 77;
+	if (segments < 1 || overlap > WSA_MAX_WELCH_OVERLAP)
+		return -EINVPARAM;
 
-	// try to get device properties for this mode
-	prop = wsa_get_sweep_device_properties(cfg->mode);
+	saved = *cfg;
+	cfg->welch_segments = segments;
+	cfg->welch_overlap = overlap;
 
-	if (prop == NULL) {
-		fprintf(stderr, "error: unsupported rfe mode: %d - %s\n", cfg->mode, mode_const_to_string(cfg->mode));
-		return -EUNSUPPORTED;
+	// the number of packets in each block depends on the segments, so plan again
+	result = wsa_shared_plan_get(cfg, saved.shared_plan->model);
+	if (result < 0) {
+		*cfg = saved;
+		return result;
 	}
-	// get the properties for DD mode
-	dd_prop = wsa_get_sweep_device_properties(8);
-	
-	// start the sweep
-	wsa_sweep_start(sweep_device->real_device);
-	
-	// read out all the data
-	packet_count = 0;
-	
-	while(1) {
-		if (packet_count < cfg->packets_per_block && cfg->sweep_plan->dd_mode == 1)
-			dd_packet = 1;
-		else
-			dd_packet = 0;
-		// poison the buffers if last packet was a data packet
-		if (header.packet_type == IF_PACKET_TYPE) {
-			for(i=0; i<total_samples; i++)
-				i16_buffer[i] = 9999;
-		}
-
-		// read a packet
-		result = wsa_read_vrt_packet(
-			dev,
-			&header, &trailer, &receiver, &digitizer, &sweep,
-			tmp_buffer, q16_buffer, i32_buffer,
-			cfg->samples_per_packet,
-			5000);
 
-		
-		if (result < 0) {
-			fprintf(stderr, "error: wsa_read_vrt_packet(): %d\n", result);
-			return result;
+	// the plan may have picked another fft size, and so another spectrum length
+	if (cfg->buflen != saved.buflen) {
+		buf = (float *) malloc(sizeof(float) * cfg->buflen);
+		trace_acc = (float *) malloc(sizeof(float) * cfg->buflen);
+		if (saved.cdb16_buf)
+			cdb16_buf = (int16_t *) malloc(sizeof(int16_t) * cfg->buflen);
+		if (saved.u8_buf)
+			u8_buf = (uint8_t *) malloc(sizeof(uint8_t) * cfg->buflen);
+		if (buf == NULL || trace_acc == NULL || (saved.cdb16_buf && cdb16_buf == NULL)
+			|| (saved.u8_buf && u8_buf == NULL)) {
+			free(buf);
+			free(trace_acc);
+			free(cdb16_buf);
+			free(u8_buf);
+			wsa_shared_plan_release(cfg->shared_plan);
+			*cfg = saved;
+			return -ENOMEM;
 		}
 
-		//  capture receiver context packets we need
-		if (header.stream_id == RECEIVER_STREAM_ID) {
-			// grab the center frequency for each capture
-			if ((receiver.indicator_field & FREQ_INDICATOR_MASK) == FREQ_INDICATOR_MASK) {
-				pkt_fcenter = (uint64_t) receiver.freq;
-				
-			}
+		for (i = 0; i < cfg->buflen; i++) {
+			buf[i] = 77;
+			trace_acc[i] = 0;
 		}
 
-		// data packets need to be parsed
-		if (header.packet_type == IF_PACKET_TYPE) {
-			doutf(DHIGH, "wsa_capture_power_spectrum: Recieved data packet %0.2f \n", (float) pkt_fcenter);
-			pkt_reflevel = (float) digitizer.reference_level;
+		free(cfg->buf);
+		free(cfg->trace_acc);
+		free(cfg->cdb16_buf);
+		free(cfg->u8_buf);
+		cfg->buf = buf;
+		cfg->trace_acc = trace_acc;
+		cfg->cdb16_buf = cdb16_buf;
+		cfg->u8_buf = u8_buf;
+
+		// a continuous capture allocates it again at the new length
+		free(cfg->back_buf);
+		cfg->back_buf = NULL;
+	}
 
-			// increase packet count
-			ppb_count++;
-			packet_count++;
+	// captures of the old plan don't combine with the new one
+	if (cfg->shared_plan != saved.shared_plan)
+		cfg->trace_count = 0;
+	wsa_shared_plan_release(saved.shared_plan);
 
-			// calculate buffer offset
-			offset = cfg->samples_per_packet * ppb_count;
-			for (x = 0; x < (int) cfg->samples_per_packet; x++)
-				idata[x] = ((float) tmp_buffer[x]) / 8192;
+	return wsa_capture_workspace_prepare(cfg);
+}
 
-			// move temporary buffer into the i16 buffer
-			if (ppb_count == cfg->packets_per_block){
-				ppb_count = 0;
-				
-				spp = header.samples_per_packet * cfg->packets_per_block;
 
-				/*
-				 * for now, we assume it's an I16 packet
-				 */
+/**
+ * selects how consecutive captures are combined into the config's buffer.
+ * Changing the mode restarts the trace.
+ *
+ * @param cfg - the power spectrum config to change
+ * @param trace_mode - one of the WSA_TRACE_* modes
+ * @param average - the number of captures the exponential mode averages over
+ * @returns - negative on error, 0 on success
+ */
+int wsa_power_spectrum_set_trace_mode(struct wsa_power_spectrum_config *cfg, uint32_t trace_mode, uint32_t average)
+{
+	if (trace_mode > WSA_TRACE_MIN_HOLD)
+		return -EUNSUPPORTED;
+
+	if (average < 1)
+		return -EINVPARAM;
 
-				// window and normalize the data
-				window_hanning_scalar_array(idata, spp);
+	cfg->trace_mode = trace_mode;
+	cfg->trace_average = average;
+	cfg->trace_count = 0;
 
-				// fft this data
-				rfft(idata, fftout, spp);
+	return 0;
+}
 
-				fftlen = spp >> 1;
 
-				/*
-				 * we used to be in superhet mode, but after a complex FFT, we have twice 
-				 * the spectrum at twice the RBW.
-				 * our fcenter is now moved from center to $passband_center so our start and stop 
-				 * indexes are calculated given that fact
-				 */
+/**
+ * restarts the trace, the next capture overwrites the buffer
+ *
+ * @param cfg - the power spectrum config to reset
+ */
+void wsa_power_spectrum_reset_trace(struct wsa_power_spectrum_config *cfg)
+{
+	cfg->trace_count = 0;
+}
 
-				// check for inversion and calculate indexes of our good data
-				if (trailer.spectral_inversion_indicator && dd_packet == 0) {
-					reverse_cpx(fftout, fftlen);
 
-					istart =  (prop->full_bw - prop->usable_right) / ((uint32_t) cfg->rbw);
-					istop = (prop->full_bw - prop->usable_left) / ( (uint32_t) cfg->rbw);
+/**
+ * calculates how many workers the pool of a config needs
+ *
+ * @param cfg - the power spectrum config
+ * @return - the number of workers
+ */
+static int32_t wsa_pool_size(struct wsa_power_spectrum_config *cfg)
+{
+	// the thread reading packets doesn't compute while the capture is pipelined
+	return (int32_t) cfg->threads + (cfg->pipeline ? 1 : 0);
+}
 
-				} else {
 
-					istart = prop->usable_left / ((uint32_t) cfg->rbw);
-					istop = prop->usable_right / ((uint32_t) cfg->rbw);
-				}
+/**
+ * sets how many threads compute the spectra of a capture.  Blocks from 
+ * different sweep steps, and the welch segments of each block, are 
+ * processed in parallel while the next packets are being read.  The 
+ * result is the same for any number of threads.
+ *
+ * @param cfg - the power spectrum config to change
+ * @param threads - the number of threads, 0 uses one per processor
+ * @returns - negative on error, 0 on success
+ */
+int wsa_power_spectrum_set_threads(struct wsa_power_spectrum_config *cfg, uint32_t threads)
+{
+	if (threads == 0)
+		threads = (uint32_t) wsa_cpu_count();
 
-				ilen = istop - istart;
-				// make sure we don't copy beyond end of buffer
-				if ((buf_offset + ilen) >= cfg->buflen) {
-					// reduce istop by how much it's past
-					istop = istop - ((buf_offset + ilen) - cfg->buflen);
-					ilen = istop - istart;
-				}
-				
-				// if we are in DD mode, the start and stop will be different
-				if (dd_packet == 1){
-					istart = (uint32_t) (((float)cfg->fstart /  (float) prop->full_bw) * (spp / 2));
+	if (threads > WSA_MAX_THREADS)
+		return -EINVPARAM;
 
-					doutf(DHIGH, "wsa_capture_power_spectrum: calculated istart %0.2f \n", (float) istart);
-					if (cfg->fstop >  (float) prop->min_tunable)
-						istop = (uint32_t) (0.8 * spp / 2);
-					else
-						istop = (uint32_t) (((float)cfg->fstop /  (float) prop->full_bw) * (spp / 2)) - 1;
+	cfg->threads = threads;
 
-					buf_offset = 0;
-					ilen = istop - istart;
+	return wsa_capture_workspace_prepare(cfg);
+}
 
-				}
-				
-				// for the usable section, convert to power, apply reflevel and copy into buffer
-				for (i=0; i<ilen; i++) {
-					if (i + istart > (spp / 2))
-						break;
-					tmpscalar = cpx_to_power(fftout[i + istart]) / spp;
 
-					tmpscalar = 2 * power_to_logpower(tmpscalar);
-					if (buf_offset + i > cfg->buflen)
-						break;
-					cfg->buf[buf_offset + i] = tmpscalar + pkt_reflevel - (float) KISS_FFT_OFFSET;
+/**
+ * pipelines a capture: the blocks are handed to the workers in batches,
+ * and the next batch is read while the previous one is being processed, 
+ * so the sweep takes about as long as the slower of reading and 
+ * computing rather than both.  The batches are still added to the buffer 
+ * in order.  An extra worker is started, so the threads set with 
+ * wsa_power_spectrum_set_threads() all compute while packets are read.
+ *
+ * @param cfg - the power spectrum config to change
+ * @param enable - 1 to pipeline captures, 0 to alternate reading and computing
+ * @returns - negative on error, 0 on success
+ */
+int wsa_power_spectrum_set_pipeline(struct wsa_power_spectrum_config *cfg, uint8_t enable)
+{
+	cfg->pipeline = enable ? 1 : 0;
 
-				}
+	return wsa_capture_workspace_prepare(cfg);
+}
 
-				buf_offset = buf_offset + ilen;
 
-			}
+/**
+ * selects a fixed point fft for the raw integer samples, instead of 
+ * normalizing them to floating point.  The blocks are kept as the raw 
+ * samples, which halves the memory the 16 bit samples of SH and SHN use. 
+ * The 32 bit fft gives the same spectrum as floating point; the 16 bit 
+ * one is the fastest on processors with slow floating point, but its 
+ * rounding noise limits the dynamic range to about 90 dB below full 
+ * scale, less for fine rbws.  Only the modes with real samples (SH, SHN 
+ * and the 32 bit samples of HDR) can use it.
+ *
+ * @param cfg - the power spectrum config to change
+ * @param bits - 16 or 32 for a fixed point fft, 0 for floating point
+ * @returns - negative on error, 0 on success
+ */
+int wsa_power_spectrum_set_fixed_point(struct wsa_power_spectrum_config *cfg, uint32_t bits)
+{
+	if (bits != 0 && bits != 16 && bits != 32)
+		return -EINVPARAM;
 
-			if (packet_count >= cfg->packet_total)
-				break;
-		}
-	}
+	// the fixed point fft is real, for the samples of the I only modes and HDR
+	if (bits != 0 && wsa_get_sweep_device_properties(cfg->mode)->sample_type == SAMPLETYPE_IQ)
+		return -EUNSUPPORTED;
 
-	free(fftout);
-	free(idata);
-	free(tmp_buffer);
-	free(i16_buffer);
+	cfg->fixed_point = bits;
 
-	return 0;
+	return wsa_capture_workspace_prepare(cfg);
 }
 
 
 /**
- * retrieves the appropriate property struct for the mode requested
+ * keeps a packed copy of the spectrum alongside the float buffer, written 
+ * as each block is converted to dB.  WSA_OUTPUT_CDB16 keeps the levels in 
+ * hundredths of a dB, within 0.005 dB.  WSA_OUTPUT_U8 keeps them in steps
+ * of scale dB above offset dBm, within scale / 2 dB; a scale of 0 picks 
+ * the offset and scale from each trace, once it is complete.
  *
- * @param mode - a string holding the mode
- * @return - pointer to the properties struct, or NULL if not supported
+ * @param cfg - the power spectrum config
+ * @param format - WSA_OUTPUT_FLOAT (no packed copy), WSA_OUTPUT_CDB16 or WSA_OUTPUT_U8
+ * @param offset - for WSA_OUTPUT_U8, the level of 0 in dBm
+ * @param scale - for WSA_OUTPUT_U8, the dB per step, or 0 to pick it from each trace
+ * @return - 0 on success, negative on error
  */
-static struct wsa_sweep_device_properties *wsa_get_sweep_device_properties(uint32_t mode)
+int wsa_power_spectrum_set_output(struct wsa_power_spectrum_config *cfg, uint32_t format, float offset, float scale)
 {
-	struct wsa_sweep_device_properties *ptr;
+	if (format != WSA_OUTPUT_FLOAT && format != WSA_OUTPUT_CDB16 && format != WSA_OUTPUT_U8)
+		return -EINVPARAM;
+	if (format == WSA_OUTPUT_U8 && scale < 0)
+		return -EINVPARAM;
+
+	if (format == WSA_OUTPUT_CDB16 && cfg->cdb16_buf == NULL) {
+		cfg->cdb16_buf = (int16_t *) malloc(sizeof(int16_t) * cfg->buflen);
+		if (cfg->cdb16_buf == NULL)
+			return -ENOMEM;
+	}
+	if (format == WSA_OUTPUT_U8 && cfg->u8_buf == NULL) {
+		cfg->u8_buf = (uint8_t *) malloc(sizeof(uint8_t) * cfg->buflen);
+		if (cfg->u8_buf == NULL)
+			return -ENOMEM;
+	}
 
-	// loop through properties and find ours
-	for (ptr = wsa_sweep_device_properties; ptr->mode; ptr++) {
+	cfg->output_format = format;
+	cfg->u8_auto = (format == WSA_OUTPUT_U8 && scale == 0) ? 1 : 0;
+	cfg->u8_offset = offset;
+	cfg->u8_scale = scale;
 
-		// if this is our mode, return a pointer to the entry
-		if (ptr->mode == mode)
-			return ptr;
-	}
+	// start the packed copy from what the buffer holds now
+	if (format == WSA_OUTPUT_CDB16)
+		psd_pack_cdb16(cfg->buf, cfg->buflen, cfg->cdb16_buf);
+	else if (format == WSA_OUTPUT_U8 && !cfg->u8_auto)
+		psd_pack_u8(cfg->buf, cfg->buflen, cfg->u8_offset, cfg->u8_scale, cfg->u8_buf);
 
-	// couldn't find it, return null
-	return NULL;
+	return 0;
 }
 
 
 /**
- * given a desired sweep configuration, this functions figures out how to achieve it
+ * sets a function to call as each step of a capture is done, so early 
+ * parts of a wide sweep can be used before the rest is captured.  It is
+ * called from the thread capturing, in sweep order, with the range of 
+ * the buffer the step filled in, which stays as it is until the next 
+ * capture.  cfg->steps_done counts the steps done in the current 
+ * capture, out of cfg->step_count.
  *
- * @param sweep_device - the sweep device object we're operating on
- * @param pscfg - the config object which describes what we're trying to sweep
- * @return - negative on error, zero on success
+ * @param cfg - the power spectrum config
+ * @param callback - the function to call, or NULL for none
+ * @param arg - passed to the callback
  */
-static int wsa_plan_sweep(struct wsa_power_spectrum_config *pscfg)
+void wsa_power_spectrum_set_step_callback(struct wsa_power_spectrum_config *cfg, 
+	wsa_power_spectrum_step_callback callback, void *arg)
 {
-	struct wsa_sweep_device_properties *prop;
-	struct wsa_sweep_plan *plan;
-	uint64_t fcstart, fcstop;
-	float tmpfreq;
-	uint32_t fstep;
-	uint32_t half_usable_bw;
-	uint8_t dd_mode = 0;
+	cfg->step_callback = callback;
+	cfg->step_arg = arg;
+}
+
+
+/**
+ * frees the state of an adaptive sweep
+ *
+ * @param as - the state, may be NULL
+ */
+static void wsa_adaptive_sweep_free(struct wsa_adaptive_sweep *as)
+{
+	if (as == NULL)
+		return;
+
+	free(as->entries);
+	free(as->fcenter);
+	free(as->buf_offset);
+	free(as->ilen);
+	free(as->last_swept);
+	free(as->changed);
+	free(as->power);
+	free(as->peak);
+	free(as->order);
+	free(as->loaded);
+	free(as);
+}
+
+
+/**
+ * makes captures re-sweep only the steps worth sweeping again: those 
+ * whose spectrum changed by more than threshold dB in any bin the last 
+ * time they were swept, and those not swept for max_age sweeps.  The 
+ * other steps keep their last spectrum in the buffer.  Every refresh 
+ * sweeps, and whenever the sweep plan changes, the full list is swept, 
+ * which is also how the steps are laid out in the buffer; the first 
+ * capture is always a full one.  When no step needs sweeping, the 
+ * stalest one is, so each capture makes progress.  Since every reload 
+ * of the sweep list costs round trips to the device, the full list is 
+ * swept instead whenever the device's sweep time model says that is 
+ * quicker.
+ *
+ * The sweep list on the device is rebuilt for each capture, so the step
+ * callback gets the steps swept, numbered as in the full sweep.  Trace
+ * modes combine each capture with the steps it sweeps.  Continuous 
+ * captures always sweep the full list.
+ *
+ * @param cfg - the power spectrum config
+ * @param threshold - the change that gets a step swept again, in dB, 0 to sweep every step every time
+ * @param max_age - the most sweeps a step is left out for, 0 for no limit
+ * @param refresh - sweep the full list every refresh sweeps, 0 for never after the first
+ * @return - 0 on success, negative on error
+ */
+int wsa_power_spectrum_set_adaptive(struct wsa_power_spectrum_config *cfg, 
+	float threshold, uint32_t max_age, uint32_t refresh)
+{
+	struct wsa_adaptive_sweep *as = cfg->adaptive;
+
+	if (threshold < 0)
+		return -EINVPARAM;
+
+	// sweeping every step is the same as not being adaptive, but the 
+	// device may still hold a reduced list, the next full sweep reloads it
+	if (threshold == 0) {
+		if (as) {
+			as->threshold = 0;
+			as->max_age = 0;
+			as->refresh = 1;
+		}
+		return 0;
+	}
+
+	if (as == NULL) {
+		as = (struct wsa_adaptive_sweep *) malloc(sizeof(struct wsa_adaptive_sweep));
+		if (as == NULL)
+			return -ENOMEM;
+		memset(as, 0, sizeof(struct wsa_adaptive_sweep));
+		cfg->adaptive = as;
+	}
+
+	as->threshold = threshold;
+	as->max_age = max_age;
+	as->refresh = refresh;
+
+	return 0;
+}
+
+
+/**
+ * calculates how much weight the next capture gets in the trace
+ *
+ * @param cfg - the power spectrum config
+ * @return - the averaging weight to pass to psd_trace_update()
+ */
+static uint32_t wsa_trace_weight(struct wsa_power_spectrum_config *cfg)
+{
+	uint32_t weight = cfg->trace_count + 1;
+
+	// exponential averaging stops growing the window once it is full
+	if (cfg->trace_mode == WSA_TRACE_EXPONENTIAL && weight > cfg->trace_average)
+		weight = cfg->trace_average;
+
+	return weight;
+}
+
+/**
+ * Configure the WSA to the configuration in the power spectrum config structure
+ *
+ * @param sweep_device - the sweep device to use
+ * @param cfg - the power spectrum config to use
+ */
+void wsa_configure_sweep(struct wsa_sweep_device *sweep_device, struct wsa_power_spectrum_config *pscfg)
+{
+	// load the sweep plan
+	wsa_sweep_plan_load(sweep_device, pscfg);
+
+	// which is the full list, whatever an adaptive sweep loaded before
+	if (pscfg->adaptive)
+		pscfg->adaptive->reduced = 0;
+}
+
+static void wsa_block_batch_finish(void *arg, int32_t index, int32_t worker);
+
+/**
+ * worker job: sums the power of a run of welch segments of one block, 
+ * and finishes the block if it was the last of its runs to complete
+ *
+ * @param arg - the batch being processed
+ * @param index - the job, jobs_per_block jobs per block
+ * @param worker - the worker running the job, selects the scratch memory
+ */
+static void wsa_block_batch_segments(void *arg, int32_t index, int32_t worker)
+{
+	struct wsa_block_batch *batch = (struct wsa_block_batch *) arg;
+	int32_t fftlen = (int32_t) batch->cfg->fft_size;
+	int32_t block = index / batch->jobs_per_block;
+	int32_t first = (index % batch->jobs_per_block) * WSA_SEGMENTS_PER_JOB;
+	int32_t count = batch->segments - first;
+	int32_t result;
+	int last;
+
+	if (count > WSA_SEGMENTS_PER_JOB)
+		count = WSA_SEGMENTS_PER_JOB;
+
+	if (batch->cfg->fixed_point)
+		result = psd_welch_accumulate_fixed(batch->plans[worker],
+			batch->i16data ? batch->i16data + (block * batch->block_len) : NULL,
+			batch->i32data ? batch->i32data + (block * batch->block_len) : NULL,
+			batch->window, fftlen, batch->hop, first, count,
+			batch->fixed_segment + (worker * (fftlen + 2)),
+			batch->fixed_fftout + (worker * (fftlen + 2)),
+			batch->partial + (index * batch->bins));
+	else if (batch->iq)
+		result = psd_welch_accumulate_cpx(batch->plans[worker],
+			batch->idata + (block * batch->block_len),
+			batch->qdata + (block * batch->block_len),
+			batch->scalar_window, fftlen, batch->hop, first, count,
+			batch->cpx_segment + (worker * fftlen),
+			batch->fftout + (worker * fftlen),
+			batch->partial + (index * batch->bins));
+	else
+		result = psd_welch_accumulate(batch->plans[worker],
+			batch->idata + (block * batch->block_len),
+			batch->scalar_window, fftlen, batch->hop, first, count,
+			batch->segment + (worker * fftlen),
+			batch->fftout + (worker * fftlen),
+			batch->partial + (index * batch->bins));
+	wsa_mutex_lock(batch->lock);
+	// keep the first error, the other workers may still be running
+	if (result < 0 && batch->error == 0)
+		batch->error = result;
+	last = (--batch->jobs_left[block] == 0);
+	wsa_mutex_unlock(batch->lock);
+
+	if (last)
+		wsa_block_batch_finish(batch, block, worker);
+}
+
+
+/**
+ * worker job: adds up the segment sums of a block in order, scales the 
+ * usable part of the spectrum to mW and combines it with the trace
+ *
+ * @param arg - the batch being processed
+ * @param index - the block
+ * @param worker - unused
+ */
+static void wsa_block_batch_finish(void *arg, int32_t index, int32_t worker)
+{
+	struct wsa_block_batch *batch = (struct wsa_block_batch *) arg;
+	struct wsa_block_info *info = &batch->info[index];
+	uint32_t fftlen = (uint32_t) batch->bins;
+	kiss_fft_scalar *power = batch->partial + (index * batch->jobs_per_block * fftlen);
+	kiss_fft_scalar *partial;
+	kiss_fft_scalar scale;
+	float level;
+	int32_t job;
+	uint32_t i;
+
+	worker = worker;
+
+	for (job = 1; job < batch->jobs_per_block; job++) {
+		partial = power + (job * fftlen);
+		for (i = 0; i < fftlen; i++)
+			power[i] += partial[i];
+	}
+
+	// average the segments and normalize by the fft length
+	scale = (kiss_fft_scalar) (1.0 / ((double) batch->segments * (double) batch->cfg->fft_size * (double) batch->cfg->fft_size));
+	for (i = 0; i < fftlen; i++)
+		power[i] = power[i] * scale;
+
+	if (info->invert)
+		reverse_scalar_array(power, fftlen);
+
+	// for the usable section, apply reflevel
+	level = info->reflevel - (float) KISS_FFT_OFFSET;
+	scale = (kiss_fft_scalar) pow(10.0, level / 10.0);
+	for (i = 0; i < info->ilen; i++) {
+		if (power[i + info->istart] < WSA_MIN_POWER)
+			power[i + info->istart] = WSA_MIN_POWER;
+		power[i + info->istart] = power[i + info->istart] * scale;
+	}
+
+	// combine it with the trace, and write the trace to the buffer in dBm
+	psd_trace_update(batch->cfg->trace_mode, batch->trace_weight, 
+		batch->cfg->trace_acc + info->buf_offset, batch->cfg->buf + info->buf_offset, 
+		power + info->istart, info->ilen);
+
+	// and keep the packed copy up to date
+	if (batch->cfg->output_format == WSA_OUTPUT_CDB16)
+		psd_pack_cdb16(batch->cfg->buf + info->buf_offset, info->ilen, batch->cfg->cdb16_buf + info->buf_offset);
+	else if (batch->cfg->output_format == WSA_OUTPUT_U8 && !batch->cfg->u8_auto)
+		psd_pack_u8(batch->cfg->buf + info->buf_offset, info->ilen, batch->cfg->u8_offset, 
+			batch->cfg->u8_scale, batch->cfg->u8_buf + info->buf_offset);
+}
+
+
+/**
+ * hands the blocks of a batch to the workers and empties it, without 
+ * waiting for their spectra
+ *
+ * @param pool - the workers
+ * @param batch - the batch to process
+ */
+static void wsa_block_batch_start(struct wsa_worker_pool *pool, struct wsa_block_batch *batch)
+{
+	int32_t i;
+
+	for (i = 0; i < batch->count; i++)
+		batch->jobs_left[i] = batch->jobs_per_block;
+	batch->error = 0;
+	batch->started = batch->count;
+
+	wsa_worker_pool_start(pool, wsa_block_batch_segments, batch, batch->count * batch->jobs_per_block);
+	batch->count = 0;
+}
+
+
+/**
+ * waits for the spectra of a batch handed to the workers
+ *
+ * @param pool - the workers
+ * @param batch - the batch being processed, or NULL if there is none
+ * @return - 0 on success, negative on error
+ */
+static int32_t wsa_block_batch_wait(struct wsa_worker_pool *pool, struct wsa_block_batch *batch)
+{
+	if (batch == NULL)
+		return 0;
+
+	wsa_worker_pool_wait(pool);
+
+	return batch->error;
+}
+
+
+/**
+ * computes the spectra of all the blocks in a batch and empties it
+ *
+ * @param pool - the workers
+ * @param batch - the batch to process
+ * @return - 0 on success, negative on error
+ */
+static int32_t wsa_block_batch_process(struct wsa_worker_pool *pool, struct wsa_block_batch *batch)
+{
+	if (batch->count == 0)
+		return 0;
+
+	wsa_block_batch_start(pool, batch);
+
+	return wsa_block_batch_wait(pool, batch);
+}
+
+
+/**
+ * counts the steps of a processed batch as done, and hands their 
+ * spectra to the step callback, in sweep order
+ *
+ * @param batch - the batch, processed without error
+ */
+static void wsa_block_batch_deliver(struct wsa_block_batch *batch)
+{
+	struct wsa_power_spectrum_config *cfg = batch->cfg;
+	struct wsa_block_info *info;
+	double bin = (double) (cfg->fstop - cfg->fstart) / cfg->buflen;
+	int32_t i;
+
+	for (i = 0; i < batch->started; i++) {
+		info = &batch->info[i];
+		if (cfg->step_callback && info->ilen > 0)
+			cfg->step_callback(cfg, info->step,
+				cfg->fstart + (uint64_t) (bin * info->buf_offset), 
+				cfg->fstart + (uint64_t) (bin * (info->buf_offset + info->ilen)),
+				cfg->buf + info->buf_offset, info->ilen, cfg->step_arg);
+		cfg->steps_done++;
+	}
+	batch->started = 0;
+}
+
+
+/**
+ * looks up which part of a block's spectrum is usable and where it goes
+ * in the buffer
+ *
+ * @param cfg - the power spectrum config
+ * @param dd_packet - 1 if the block was captured in DD mode
+ * @param info - the block's info, invert and buf_offset must be set
+ */
+static void wsa_block_locate(struct wsa_power_spectrum_config *cfg,
+	int16_t dd_packet,
+	struct wsa_block_info *info)
+{
+	struct wsa_shared_plan *plan = cfg->shared_plan;
+
+	if (dd_packet == 1) {
+		info->istart = plan->dd_istart;
+		info->ilen = plan->dd_ilen;
+		info->buf_offset = 0;
+	} else {
+		info->istart = plan->istart[info->invert];
+		info->ilen = plan->ilen[info->invert];
+	}
+
+	// never write past the buffer
+	if (info->buf_offset + info->ilen > cfg->buflen)
+		info->ilen = (info->buf_offset < cfg->buflen) ? cfg->buflen - info->buf_offset : 0;
+}
+
+
+/**
+ * frees a capture workspace
+ *
+ * @param ws - the workspace, may be NULL
+ */
+static void wsa_capture_workspace_free(struct wsa_capture_workspace *ws)
+{
+	struct wsa_block_batch *batch;
+	int32_t w;
+
+	if (ws == NULL)
+		return;
+
+	// the second batch only owns its blocks
+	if (ws->pipelined) {
+		free(ws->batches[1].info);
+		free(ws->batches[1].idata);
+		free(ws->batches[1].qdata);
+		free(ws->batches[1].i16data);
+		free(ws->batches[1].i32data);
+	}
+
+	batch = &ws->batches[0];
+	if (batch->plans) {
+		for (w = 0; w < ws->workers; w++)
+			wsa_fft_plan_free(batch->plans[w]);
+		free(batch->plans);
+	}
+	if (batch->lock)
+		wsa_mutex_free(batch->lock);
+	free(batch->jobs_left);
+	free(batch->info);
+	free(batch->partial);
+	free(batch->idata);
+	free(batch->qdata);
+	free(batch->scalar_window);
+	free(batch->segment);
+	free(batch->cpx_segment);
+	free(batch->fftout);
+	free(batch->i16data);
+	free(batch->i32data);
+	free(batch->window);
+	free(batch->fixed_segment);
+	free(batch->fixed_fftout);
+
+	free(ws->i32_buffer);
+	free(ws->q16_buffer);
+	free(ws->i16_buffer);
+	free(ws);
+}
+
+
+/**
+ * allocates the memory for the captures of a config: the packet buffers,
+ * and batches of one block per worker, each block split in runs of welch
+ * segments
+ *
+ * @param cfg - the power spectrum config
+ * @param workers - the number of workers computing spectra
+ * @param pipelined - 1 for a second batch to read into while the first is processed
+ * @return - the workspace, or NULL if out of memory
+ */
+static struct wsa_capture_workspace *wsa_capture_workspace_new(struct wsa_power_spectrum_config *cfg, int32_t workers, uint8_t pipelined)
+{
+	struct wsa_capture_workspace *ws;
+	struct wsa_block_batch *batch;
+	struct wsa_sweep_device_properties *prop = wsa_get_sweep_device_properties(cfg->mode);
+	uint32_t total_samples = cfg->samples_per_packet * cfg->packets_per_block;
+	uint32_t plan_type;
+	int32_t w;
+	int failed;
+
+	ws = (struct wsa_capture_workspace *) malloc(sizeof(struct wsa_capture_workspace));
+	if (ws == NULL)
+		return NULL;
+	memset(ws, 0, sizeof(struct wsa_capture_workspace));
+
+	ws->samples_per_packet = cfg->samples_per_packet;
+	ws->packets_per_block = cfg->packets_per_block;
+	ws->fft_size = cfg->fft_size;
+	ws->welch_overlap = cfg->welch_overlap;
+	ws->fixed_point = cfg->fixed_point;
+	ws->workers = workers;
+	psd_iq_corrector_init(&ws->corrector, 1.0f / cfg->packets_per_block);
+
+	ws->i16_buffer = (int16_t *) malloc(sizeof(int16_t) * cfg->samples_per_packet);
+	ws->q16_buffer = (int16_t *) malloc(sizeof(int16_t) * cfg->samples_per_packet);
+	ws->i32_buffer = (int32_t *) malloc(sizeof(int32_t) * cfg->samples_per_packet);
+	failed = (ws->i16_buffer == NULL || ws->q16_buffer == NULL || ws->i32_buffer == NULL);
+
+	// describe the batches
+	batch = &ws->batches[0];
+	batch->cfg = cfg;
+	batch->block_len = (int32_t) total_samples;
+	batch->hop = (int32_t) ((cfg->fft_size * (100 - cfg->welch_overlap)) / 100);
+	if (batch->hop < 1)
+		batch->hop = 1;
+	batch->segments = psd_welch_segment_count(batch->block_len, (int32_t) cfg->fft_size, batch->hop);
+	batch->jobs_per_block = (batch->segments + WSA_SEGMENTS_PER_JOB - 1) / WSA_SEGMENTS_PER_JOB;
+	batch->max_count = workers;
+	batch->iq = (prop->sample_type == SAMPLETYPE_IQ) ? 1 : 0;
+	batch->bins = (int32_t) wsa_spectrum_bins(prop, cfg->fft_size);
+
+	batch->partial = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * batch->bins * batch->jobs_per_block * batch->max_count);
+	batch->info = (struct wsa_block_info *) malloc(sizeof(struct wsa_block_info) * batch->max_count);
+	batch->jobs_left = (int32_t *) malloc(sizeof(int32_t) * batch->max_count);
+	batch->lock = wsa_mutex_new();
+	failed = failed || batch->partial == NULL || batch->info == NULL || batch->jobs_left == NULL || batch->lock == NULL;
+	if (cfg->fixed_point) {
+		if (prop->sample_type == SAMPLETYPE_I32)
+			batch->i32data = (int32_t *) malloc(sizeof(int32_t) * total_samples * batch->max_count);
+		else
+			batch->i16data = (int16_t *) malloc(sizeof(int16_t) * total_samples * batch->max_count);
+		batch->window = (int16_t *) malloc(sizeof(int16_t) * cfg->fft_size);
+		batch->fixed_segment = (int32_t *) malloc(sizeof(int32_t) * (cfg->fft_size + 2) * workers);
+		batch->fixed_fftout = (int32_t *) malloc(sizeof(int32_t) * (cfg->fft_size + 2) * workers);
+		failed = failed || (batch->i16data == NULL && batch->i32data == NULL) || batch->window == NULL || batch->fixed_segment == NULL || batch->fixed_fftout == NULL;
+		if (batch->window)
+			window_hanning_fixed(batch->window, (int) cfg->fft_size);
+		plan_type = (cfg->fixed_point == 16) ? WSA_FFT_REAL_FIXED16 : WSA_FFT_REAL_FIXED32;
+	} else if (batch->iq) {
+		batch->idata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * total_samples * batch->max_count);
+		batch->qdata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * total_samples * batch->max_count);
+		batch->cpx_segment = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * cfg->fft_size * workers);
+		batch->fftout = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * cfg->fft_size * workers);
+		failed = failed || batch->idata == NULL || batch->qdata == NULL || batch->cpx_segment == NULL || batch->fftout == NULL;
+		plan_type = WSA_FFT_COMPLEX;
+	} else {
+		batch->idata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * total_samples * batch->max_count);
+		batch->segment = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * cfg->fft_size * workers);
+		batch->fftout = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * cfg->fft_size * workers);
+		failed = failed || batch->idata == NULL || batch->segment == NULL || batch->fftout == NULL;
+		plan_type = WSA_FFT_REAL;
+	}
+	if (!cfg->fixed_point) {
+		batch->scalar_window = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * cfg->fft_size);
+		failed = failed || batch->scalar_window == NULL;
+		if (batch->scalar_window)
+			window_hanning_table(batch->scalar_window, (int) cfg->fft_size);
+	}
+	batch->plans = (struct wsa_fft_plan **) malloc(sizeof(struct wsa_fft_plan *) * workers);
+	if (batch->plans == NULL) {
+		failed = 1;
+	} else {
+		for (w = 0; w < workers; w++) {
+			batch->plans[w] = wsa_fft_plan_new((int32_t) cfg->fft_size, plan_type);
+			if (batch->plans[w] == NULL)
+				failed = 1;
+		}
+	}
+
+	// a second batch to read blocks into while the first is processed, 
+	// sharing everything but the blocks
+	if (pipelined) {
+		ws->pipelined = 1;
+		ws->batches[1] = ws->batches[0];
+		ws->batches[1].info = (struct wsa_block_info *) malloc(sizeof(struct wsa_block_info) * batch->max_count);
+		ws->batches[1].idata = NULL;
+		ws->batches[1].qdata = NULL;
+		ws->batches[1].i16data = NULL;
+		ws->batches[1].i32data = NULL;
+		if (cfg->fixed_point && batch->i32data)
+			ws->batches[1].i32data = (int32_t *) malloc(sizeof(int32_t) * total_samples * batch->max_count);
+		else if (cfg->fixed_point)
+			ws->batches[1].i16data = (int16_t *) malloc(sizeof(int16_t) * total_samples * batch->max_count);
+		else
+			ws->batches[1].idata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * total_samples * batch->max_count);
+		if (batch->iq)
+			ws->batches[1].qdata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * total_samples * batch->max_count);
+		failed = failed || ws->batches[1].info == NULL || (ws->batches[1].idata == NULL && ws->batches[1].i16data == NULL && ws->batches[1].i32data == NULL)
+			|| (batch->iq && ws->batches[1].qdata == NULL);
+	}
+
+	if (failed) {
+		doutf(DHIGH, "wsa_capture_workspace_new: Failed to allocate the capture workspace\n");
+		wsa_capture_workspace_free(ws);
+		return NULL;
+	}
+
+	doutf(DHIGH, "wsa_capture_workspace_new: Created %d blocks of %d samples\n", (int) (batch->max_count * (pipelined + 1)), (int) total_samples);
+
+	return ws;
+}
+
+
+/**
+ * makes sure the workers and the workspace of a config fit its current 
+ * settings, replacing them if they don't, so captures with unchanged 
+ * settings allocate nothing
+ *
+ * @param cfg - the power spectrum config
+ * @return - 0 on success, negative on error
+ */
+static int wsa_capture_workspace_prepare(struct wsa_power_spectrum_config *cfg)
+{
+	struct wsa_capture_workspace *ws = cfg->workspace;
+	int32_t workers;
+	uint8_t pipelined;
+
+	// start the workers
+	if (cfg->worker_pool && wsa_worker_pool_size(cfg->worker_pool) != wsa_pool_size(cfg)) {
+		wsa_worker_pool_free(cfg->worker_pool);
+		cfg->worker_pool = NULL;
+	}
+	if (cfg->worker_pool == NULL) {
+		cfg->worker_pool = wsa_worker_pool_new(wsa_pool_size(cfg));
+		if (cfg->worker_pool == NULL)
+			return -ENOMEM;
+	}
+	workers = wsa_worker_pool_size(cfg->worker_pool);
+
+	// overlapping needs a worker besides the thread reading the packets
+	pipelined = (cfg->pipeline && workers > 1) ? 1 : 0;
+
+	if (ws && ws->samples_per_packet == cfg->samples_per_packet
+		&& ws->packets_per_block == cfg->packets_per_block
+		&& ws->fft_size == cfg->fft_size
+		&& ws->welch_overlap == cfg->welch_overlap
+		&& ws->fixed_point == cfg->fixed_point
+		&& ws->workers == workers
+		&& ws->pipelined == pipelined)
+		return 0;
+
+	wsa_capture_workspace_free(ws);
+	cfg->workspace = wsa_capture_workspace_new(cfg, workers, pipelined);
+	if (cfg->workspace == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+
+/**
+ * lays out the steps of an adaptive sweep for the config's current sweep
+ * plan, unless they already are.  The steps are counted the way the plan
+ * counts its packets; a plan they don't add up for is always swept in 
+ * full.
+ *
+ * @param cfg - the power spectrum config, with cfg->adaptive set
+ * @return - 0 on success, negative on error
+ */
+static int wsa_adaptive_prepare(struct wsa_power_spectrum_config *cfg)
+{
+	struct wsa_adaptive_sweep *as = cfg->adaptive;
+	struct wsa_sweep_plan *entry;
+	uint32_t steps;
+	uint32_t n;
+	uint32_t k;
+
+	if (as->plan == cfg->sweep_plan && as->buflen == cfg->buflen)
+		return 0;
+
+	// count the steps
+	steps = (cfg->sweep_plan->dd_mode == 1) ? 1 : 0;
+	if (!cfg->only_dd) {
+		for (entry = cfg->sweep_plan; entry; entry = entry->next_entry) {
+			if (entry->fcstop <= entry->fcstart + entry->fstep)
+				steps++;
+			else
+				steps += (uint32_t) ((entry->fcstop - entry->fcstart) / entry->fstep) + 1;
+		}
+	}
+
+	free(as->entries);
+	free(as->fcenter);
+	free(as->buf_offset);
+	free(as->ilen);
+	free(as->last_swept);
+	free(as->changed);
+	free(as->power);
+	free(as->peak);
+	free(as->order);
+	free(as->loaded);
+	as->entries = (struct wsa_sweep_plan **) malloc(sizeof(struct wsa_sweep_plan *) * steps);
+	as->fcenter = (uint64_t *) malloc(sizeof(uint64_t) * steps);
+	as->buf_offset = (uint32_t *) malloc(sizeof(uint32_t) * steps);
+	as->ilen = (uint32_t *) malloc(sizeof(uint32_t) * steps);
+	as->last_swept = (uint32_t *) malloc(sizeof(uint32_t) * steps);
+	as->changed = (uint8_t *) malloc(sizeof(uint8_t) * steps);
+	as->power = (float *) malloc(sizeof(float) * steps);
+	as->peak = (float *) malloc(sizeof(float) * steps);
+	as->order = (uint32_t *) malloc(sizeof(uint32_t) * steps);
+	as->loaded = (uint32_t *) malloc(sizeof(uint32_t) * steps);
+	as->plan = NULL;
+	as->known = 0;
+	as->reduced = 0;
+	if (as->entries == NULL || as->fcenter == NULL || as->buf_offset == NULL || as->ilen == NULL
+		|| as->last_swept == NULL || as->changed == NULL || as->power == NULL || as->peak == NULL
+		|| as->order == NULL || as->loaded == NULL) {
+		as->step_count = 0;
+		return -ENOMEM;
+	}
+
+	// and note where each one is tuned to
+	k = 0;
+	if (cfg->sweep_plan->dd_mode == 1) {
+		as->entries[k] = NULL;
+		as->fcenter[k] = 0;
+		k++;
+	}
+	if (!cfg->only_dd) {
+		for (entry = cfg->sweep_plan; entry; entry = entry->next_entry) {
+			if (entry->fcstop <= entry->fcstart + entry->fstep)
+				n = 1;
+			else
+				n = (uint32_t) ((entry->fcstop - entry->fcstart) / entry->fstep) + 1;
+			for (; n > 0; n--) {
+				as->entries[k] = entry;
+				as->fcenter[k] = (k > 0 && as->entries[k - 1] == entry) ? as->fcenter[k - 1] + entry->fstep : entry->fcstart;
+				k++;
+			}
+		}
+	}
+
+	for (k = 0; k < steps; k++) {
+		as->buf_offset[k] = 0;
+		as->ilen[k] = 0;
+		as->last_swept[k] = 0;
+		as->changed[k] = 0;
+		as->power[k] = 0;
+		as->peak[k] = 0;
+	}
+
+	as->plan = cfg->sweep_plan;
+	as->buflen = cfg->buflen;
+	as->step_count = (steps * cfg->packets_per_block == cfg->packet_total) ? steps : 0;
+
+	return 0;
+}
+
+
+/**
+ * picks the steps the next capture of an adaptive sweep covers, and 
+ * loads them onto the device if they aren't the list it holds.  Loading 
+ * a list takes a round trip to the device for each setting, so the full 
+ * list is swept instead whenever the device's sweep time model says that
+ * is quicker.
+ *
+ * @param sweep_device - the sweep device to use
+ * @param cfg - the power spectrum config, with cfg->adaptive set
+ * @return - 0 on success, negative on error
+ */
+static int wsa_adaptive_select(struct wsa_sweep_device *sweep_device, struct wsa_power_spectrum_config *cfg)
+{
+	struct wsa_adaptive_sweep *as = cfg->adaptive;
+	struct wsa_sweep_device_properties prop;
+	double step_time;
+	double start;
+	uint32_t stalest = 0;
+	uint8_t full;
+	uint8_t loaded;
+	uint32_t k;
+	int result;
+
+	result = wsa_adaptive_prepare(cfg);
+	if (result < 0)
+		return result;
+
+	// nothing known yet, or time for a refresh, is a full sweep
+	full = !as->known || as->step_count <= 1 
+		|| (as->refresh > 0 && as->sweeps - as->last_full >= as->refresh);
+
+	as->order_len = 0;
+	loaded = 0;
+	if (!full) {
+		for (k = 0; k < as->step_count; k++) {
+			if (as->changed[k] || (as->max_age > 0 && as->sweeps - as->last_swept[k] >= as->max_age))
+				as->order[as->order_len++] = k;
+			if (as->last_swept[k] < as->last_swept[stalest])
+				stalest = k;
+		}
+
+		step_time = wsa_step_time(&sweep_device->timing, wsa_config_properties(cfg, &prop),
+			cfg->samples_per_packet, cfg->packets_per_block);
+
+		// with nothing to sweep, sweep the stalest step, or what the device has if that's quicker
+		if (as->order_len == 0) {
+			if (as->reduced && as->loaded_len * step_time < as->load_time + step_time) {
+				memcpy(as->order, as->loaded, sizeof(uint32_t) * as->loaded_len);
+				as->order_len = as->loaded_len;
+			} else {
+				as->order[as->order_len++] = stalest;
+			}
+		}
+
+		loaded = as->reduced && as->loaded_len == as->order_len
+			&& memcmp(as->loaded, as->order, sizeof(uint32_t) * as->order_len) == 0;
+
+		if (as->order_len >= as->step_count
+			|| (as->reduced ? as->full_load_time : 0) + as->step_count * step_time 
+				<= (loaded ? 0 : as->load_time) + as->order_len * step_time)
+			full = 1;
+	}
+
+	if (full) {
+		as->order_len = as->step_count;
+		for (k = 0; k < as->step_count; k++)
+			as->order[k] = k;
+		if (as->reduced) {
+			start = wsa_monotonic_time();
+			result = wsa_sweep_plan_load(sweep_device, cfg);
+			as->full_load_time = wsa_monotonic_time() - start;
+			as->reduced = 0;
+		}
+		return result;
+	}
+
+	// the device may already hold these steps
+	if (loaded)
+		return 0;
+
+	start = wsa_monotonic_time();
+	result = wsa_adaptive_load(sweep_device, cfg);
+	as->load_time = wsa_monotonic_time() - start;
+	as->reduced = 1;
+
+	// the device holds some unknown part of the list, which nothing matches
+	if (result < 0) {
+		as->loaded_len = 0;
+		return result;
+	}
+	memcpy(as->loaded, as->order, sizeof(uint32_t) * as->order_len);
+	as->loaded_len = as->order_len;
+
+	return result;
+}
+
+
+/**
+ * compares the steps a capture of an adaptive sweep covered with what 
+ * they were before, and keeps them for the next comparison.  A step 
+ * changed if its total power or its strongest bin did, which, unlike the
+ * bins themselves, noise hardly moves.
+ *
+ * @param cfg - the power spectrum config, with cfg->adaptive set
+ */
+static void wsa_adaptive_update(struct wsa_power_spectrum_config *cfg)
+{
+	struct wsa_adaptive_sweep *as = cfg->adaptive;
+	float const *data;
+	double total;
+	float power;
+	float peak;
+	uint32_t i;
+	uint32_t k;
+	uint32_t x;
+
+	for (i = 0; i < as->order_len; i++) {
+		k = as->order[i];
+		data = cfg->buf + as->buf_offset[k];
+
+		total = 0;
+		peak = (as->ilen[k] > 0) ? data[0] : 0;
+		for (x = 0; x < as->ilen[k]; x++) {
+			total += pow(10.0, data[x] / 10.0);
+			if (data[x] > peak)
+				peak = data[x];
+		}
+		power = (total > 0) ? (float) (10.0 * log10(total)) : 0;
+
+		as->changed[k] = as->known && (fabs(power - as->power[k]) > as->threshold 
+			|| fabs(peak - as->peak[k]) > as->threshold);
+		as->power[k] = power;
+		as->peak[k] = peak;
+		as->last_swept[k] = as->sweeps;
+	}
+
+	if (!as->reduced) {
+		as->known = (as->step_count > 0) ? 1 : 0;
+		as->last_full = as->sweeps;
+	}
+	as->sweeps++;
+}
+
+
+/**
+ * reads the packets of one pass of the sweep list, which must be 
+ * running, and combines their spectra with the trace in the buffer
+ *
+ * @param sweep_device - the sweep device to use
+ * @param cfg - the power spectrum config to use, with its workspace prepared
+ * @return - 0 on success, negative on error
+ */
+static int wsa_capture_sweep(
+	struct wsa_sweep_device *sweep_device,
+	struct wsa_power_spectrum_config *cfg
+)
+{
+	uint32_t i;
+	int16_t result = 0;
+	const uint32_t total_samples = cfg->samples_per_packet * cfg->packets_per_block;
+	struct wsa_device *dev = sweep_device->real_device;
+	struct wsa_vrt_packet_header header;
+	struct wsa_vrt_packet_trailer trailer;
+	struct wsa_receiver_packet receiver;
+	struct wsa_digitizer_packet digitizer;
+	struct wsa_extension_packet sweep;
+	struct wsa_capture_workspace *ws = cfg->workspace;
+	kiss_fft_scalar *idata;
+	kiss_fft_scalar *qdata;
+	int16_t *i16data;
+	int32_t *i32data;
+	struct wsa_block_batch *batch = &ws->batches[0];
+	struct wsa_block_batch *running = NULL;
+	int16_t wait_result;
+	struct wsa_block_info *info;
+	float pkt_reflevel = 0;
+	uint64_t pkt_fcenter = 0;
+	uint32_t buf_offset = 0;
+	uint32_t packet_count;
+	int16_t dd_packet = 0;
+	int32_t ppb_count = 0;
+	int32_t offset = 0;
+	int x;
+	struct wsa_sweep_device_properties dprop;
+	struct wsa_sweep_device_properties *prop = wsa_config_properties(cfg, &dprop);
+	struct wsa_time block_time;
+	uint32_t blocks = 0;
+	struct wsa_adaptive_sweep *as = cfg->adaptive;
+	uint32_t packet_total = cfg->packet_total;
+	uint32_t step = 0;
+
+	// an adaptive sweep may have loaded only some of the steps, and lays out the rest
+	if (as && as->step_count == 0)
+		as = NULL;
+	if (as && as->reduced)
+		packet_total = as->order_len * cfg->packets_per_block;
+
+	// no step is done yet
+	cfg->steps_done = 0;
+
+	for (i = 0; i < 2; i++) {
+		ws->batches[i].count = 0;
+		ws->batches[i].started = 0;
+		ws->batches[i].error = 0;
+
+		// how much this capture counts in the trace
+		ws->batches[i].trace_weight = wsa_trace_weight(cfg);
+	}
+
+	// read out all the data
+	packet_count = 0;
+	
+	while(1) {
+		// the step the next packet belongs to
+		step = packet_count / cfg->packets_per_block;
+		if (as && as->reduced)
+			step = as->order[(step < as->order_len) ? step : as->order_len - 1];
+
+		if (step == 0 && cfg->sweep_plan->dd_mode == 1)
+			dd_packet = 1;
+		else
+			dd_packet = 0;
+		// read a packet
+		result = wsa_read_vrt_packet(
+			dev,
+			&header, &trailer, &receiver, &digitizer, &sweep,
+			ws->i16_buffer, ws->q16_buffer, ws->i32_buffer,
+			cfg->samples_per_packet,
+			5000);
+
+		
+		if (result < 0) {
+			fprintf(stderr, "error: wsa_read_vrt_packet(): %d\n", result);
+			break;
+		}
+
+		//  capture receiver context packets we need
+		if (header.stream_id == RECEIVER_STREAM_ID) {
+			// grab the center frequency for each capture
+			if ((receiver.indicator_field & FREQ_INDICATOR_MASK) == FREQ_INDICATOR_MASK) {
+				pkt_fcenter = (uint64_t) receiver.freq;
+				
+			}
+		}
+
+		// data packets need to be parsed
+		if (header.packet_type == IF_PACKET_TYPE) {
+			doutf(DHIGH, "wsa_capture_power_spectrum: Recieved data packet %0.2f \n", (float) pkt_fcenter);
+			pkt_reflevel = (float) digitizer.reference_level;
+
+			// I/Q modes need both channels, the others a single channel
+			if ((header.stream_id == I16Q16_DATA_STREAM_ID) != (batch->iq != 0)) {
+				result = WSA_ERR_INVSTREAMTYPE;
+				fprintf(stderr, "error: wsa_capture_power_spectrum(): %d\n", result);
+				break;
+			}
+
+			// increase packet count
+			ppb_count++;
+			packet_count++;
+
+			// time the steps, to fit the device's sweep time model
+			if (ppb_count == 1) {
+				if (blocks++ > 0)
+					wsa_sweep_timing_observe(&sweep_device->timing, prop, cfg->samples_per_packet, 
+						cfg->packets_per_block, wsa_time_diff(&header.time_stamp, &block_time));
+				block_time = header.time_stamp;
+			}
+
+			// calculate buffer offset, and copy the packet to its place in the block
+			offset = cfg->samples_per_packet * (ppb_count - 1);
+			if (cfg->fixed_point && batch->i32data) {
+				i32data = batch->i32data + (batch->count * total_samples);
+				memcpy(i32data + offset, ws->i32_buffer, sizeof(int32_t) * cfg->samples_per_packet);
+			} else if (cfg->fixed_point) {
+				i16data = batch->i16data + (batch->count * total_samples);
+				memcpy(i16data + offset, ws->i16_buffer, sizeof(int16_t) * cfg->samples_per_packet);
+			} else if (batch->iq) {
+				idata = batch->idata + (batch->count * total_samples);
+				qdata = batch->qdata + (batch->count * total_samples);
+				if (ppb_count == 1)
+					psd_iq_corrector_reset(&ws->corrector);
+				psd_iq_correct_i16(&ws->corrector, ws->i16_buffer, ws->q16_buffer, 8192, 
+					idata + offset, qdata + offset, (int32_t) cfg->samples_per_packet);
+			} else if (header.stream_id == I32_DATA_STREAM_ID) {
+				idata = batch->idata + (batch->count * total_samples);
+				for (x = 0; x < (int) cfg->samples_per_packet; x++)
+					idata[offset + x] = ((float) ws->i32_buffer[x]) / 8388608;
+			} else {
+				idata = batch->idata + (batch->count * total_samples);
+				for (x = 0; x < (int) cfg->samples_per_packet; x++)
+					idata[offset + x] = ((float) ws->i16_buffer[x]) / 8192;
+			}
+
+			// once the block is complete, work out where its spectrum goes
+			if (ppb_count == cfg->packets_per_block){
+				ppb_count = 0;
+
+				info = &batch->info[batch->count];
+				info->reflevel = pkt_reflevel;
+				info->invert = (trailer.spectral_inversion_indicator && dd_packet == 0) ? 1 : 0;
+				info->buf_offset = buf_offset;
+				info->step = step;
+				if (as && as->reduced)
+					info->buf_offset = as->buf_offset[step];
+				wsa_block_locate(cfg, dd_packet, info);
+				buf_offset = info->buf_offset + info->ilen;
+				if (as && step < as->step_count) {
+					as->buf_offset[step] = info->buf_offset;
+					as->ilen[step] = info->ilen;
+				}
+
+				// hand the blocks to the workers once every worker has one
+				batch->count++;
+				if (batch->count == batch->max_count) {
+					if (ws->pipelined) {
+						// the previous batch must be done before the workers take this one,
+						// which keeps the buffer updates in order
+						result = (int16_t) wsa_block_batch_wait(cfg->worker_pool, running);
+						if (result >= 0) {
+							if (running)
+								wsa_block_batch_deliver(running);
+							wsa_block_batch_start(cfg->worker_pool, batch);
+							running = batch;
+							batch = (batch == &ws->batches[0]) ? &ws->batches[1] : &ws->batches[0];
+						}
+					} else {
+						result = (int16_t) wsa_block_batch_process(cfg->worker_pool, batch);
+						if (result >= 0)
+							wsa_block_batch_deliver(batch);
+					}
+					if (result < 0) {
+						fprintf(stderr, "error: psd_welch_accumulate(): %d\n", result);
+						break;
+					}
+				}
+			}
+
+			if (packet_count >= packet_total)
+				break;
+		}
+	}
+
+	// the workers must be done with the batch in flight, whatever happened
+	wait_result = (int16_t) wsa_block_batch_wait(cfg->worker_pool, running);
+	if (result >= 0 && wait_result < 0) {
+		result = wait_result;
+		fprintf(stderr, "error: psd_welch_accumulate(): %d\n", result);
+	}
+
+	if (result >= 0 && running)
+		wsa_block_batch_deliver(running);
+
+	// finish the blocks left over
+	if (result >= 0) {
+		result = (int16_t) wsa_block_batch_process(cfg->worker_pool, batch);
+		if (result < 0)
+			fprintf(stderr, "error: psd_welch_accumulate(): %d\n", result);
+		else
+			wsa_block_batch_deliver(batch);
+	}
+
+	if (result < 0)
+		return result;
+
+	// update the sweep time model with the steps of this sweep
+	wsa_sweep_timing_fit(&sweep_device->timing);
+
+	// one more capture is part of the trace
+	cfg->trace_count++;
+
+	// an 8 bit copy that fits each trace can only be packed once the trace is complete
+	if (cfg->output_format == WSA_OUTPUT_U8 && cfg->u8_auto) {
+		psd_u8_range(cfg->buf, cfg->buflen, &cfg->u8_offset, &cfg->u8_scale);
+		psd_pack_u8(cfg->buf, cfg->buflen, cfg->u8_offset, cfg->u8_scale, cfg->u8_buf);
+	}
+
+	return 0;
+}
+
+
+
+
+/**
+ * checks that a config can be captured, and makes sure its workspace is
+ * ready
+ *
+ * @param cfg - the power spectrum config to use
+ * @return - 0 on success, negative on error
+ */
+static int wsa_capture_prepare(struct wsa_power_spectrum_config *cfg)
+{
+	// the mode must be one we can sweep
+	if (wsa_get_sweep_device_properties(cfg->mode) == NULL) {
+		fprintf(stderr, "error: unsupported rfe mode: %d - %s\n", cfg->mode, mode_const_to_string(cfg->mode));
+		return -EUNSUPPORTED;
+	}
+
+	if (cfg->fft_size == 0 || cfg->fft_size > cfg->samples_per_packet * cfg->packets_per_block)
+		return -EINVCAPTSIZE;
+
+	// everything the capture works in was set up with the config
+	return wsa_capture_workspace_prepare(cfg);
+}
+
+
+/**
+ * captures some power spectrum using the configuration supplied
+ *
+ * @param sweep_device - the sweep device to use
+ * @param cfg - the power spectrum config to use
+ * @param buf - if buf is not NULL, a pointer to the allocated memory is stored there for convience
+ * @return - 0 on success, negative on error
+ */
+int wsa_capture_power_spectrum(
+	struct wsa_sweep_device *sweep_device,
+	struct wsa_power_spectrum_config *cfg,
+	float **buf
+)
+{
+	int result;
+
+	result = wsa_capture_prepare(cfg);
+	if (result < 0)
+		return result;
+
+	// assign their convienence pointer
+	if (buf)
+		*buf = cfg->buf;
+
+	// an adaptive sweep picks the steps worth sweeping
+	if (cfg->adaptive) {
+		result = wsa_adaptive_select(sweep_device, cfg);
+		if (result < 0)
+			return result;
+	}
+
+	// start the sweep
+	wsa_sweep_start(sweep_device->real_device);
+
+	result = wsa_capture_sweep(sweep_device, cfg);
+	if (result >= 0 && cfg->adaptive)
+		wsa_adaptive_update(cfg);
+
+	return result;
+}
+
+
+/**
+ * captures power spectra continuously: the sweep list is started once 
+ * and left repeating, so the device never waits between sweeps, and each
+ * spectrum is handed to the callback as soon as its last packet is in.  
+ * The buffer given to the callback stays untouched until the callback 
+ * for the next sweep returns, since the next sweep is written to a 
+ * second buffer in the meantime.  cfg->buf is the buffer given to the 
+ * callback while it runs, and the last one delivered once this returns.
+ * Return nonzero from the callback to stop sweeping.
+ *
+ * @param sweep_device - the sweep device to use
+ * @param cfg - the power spectrum config to use, configured with wsa_configure_sweep()
+ * @param callback - called with each complete spectrum
+ * @param arg - passed to the callback
+ * @return - 0 once the callback stops the sweep, negative on error
+ */
+int wsa_capture_power_spectrum_continuous(
+	struct wsa_sweep_device *sweep_device,
+	struct wsa_power_spectrum_config *cfg,
+	wsa_power_spectrum_callback callback,
+	void *arg
+)
+{
+	struct wsa_device *dev = sweep_device->real_device;
+	uint32_t sweeps = 0;
+	float *done;
+	int result;
+	int stop = 0;
+
+	result = wsa_capture_prepare(cfg);
+	if (result < 0)
+		return result;
+
+	// the buffer the next sweep is written to while the last one is in use
+	if (cfg->back_buf == NULL) {
+		cfg->back_buf = (float *) malloc(sizeof(float) * cfg->buflen);
+		if (cfg->back_buf == NULL)
+			return -ENOMEM;
+		memcpy(cfg->back_buf, cfg->buf, sizeof(float) * cfg->buflen);
+	}
+
+	// all of the sweep list, if an adaptive sweep loaded only some of it
+	if (cfg->adaptive && cfg->adaptive->reduced) {
+		result = wsa_sweep_plan_load(sweep_device, cfg);
+		if (result < 0)
+			return result;
+		cfg->adaptive->reduced = 0;
+	}
+
+	// keep repeating the sweep list until it is stopped
+	result = wsa_set_sweep_iteration(dev, 0);
+	if (result < 0)
+		return result;
+	wsa_sweep_start(dev);
+
+	while (!stop) {
+		result = wsa_capture_sweep(sweep_device, cfg);
+		if (result < 0)
+			break;
+
+		// start the next sweep from this one's trace, in the other buffer
+		done = cfg->buf;
+		if (cfg->trace_mode != WSA_TRACE_CLEAR_WRITE)
+			memcpy(cfg->back_buf, done, sizeof(float) * cfg->buflen);
+		stop = callback(cfg, done, sweeps++, arg);
+		cfg->buf = cfg->back_buf;
+		cfg->back_buf = done;
+	}
+
+	// the next sweep goes on top of the last one delivered
+	if (sweeps > 0) {
+		done = cfg->buf;
+		cfg->buf = cfg->back_buf;
+		cfg->back_buf = done;
+	}
+
+	// stop the device and drop the packets of the sweep in progress
+	wsa_sweep_stop(dev);
+	wsa_set_sweep_iteration(dev, 1);
+
+	return result;
+}
+
+
+/**
+ * retrieves the appropriate property struct for the mode requested
+ *
+ * @param mode - a string holding the mode
+ * @return - pointer to the properties struct, or NULL if not supported
+ */
+static struct wsa_sweep_device_properties *wsa_get_sweep_device_properties(uint32_t mode)
+{
+	struct wsa_sweep_device_properties *ptr;
+
+	// loop through properties and find ours
+	for (ptr = wsa_sweep_device_properties; ptr->mode; ptr++) {
+
+		// if this is our mode, return a pointer to the entry
+		if (ptr->mode == mode)
+			return ptr;
+	}
+
+	// couldn't find it, return null
+	return NULL;
+}
+
+
+/**
+ * the decimation a mode's properties describe its samples at
+ *
+ * @param prop - the properties of the mode
+ * @return - the smallest decimation for the decimated modes, 1 for the others
+ */
+static uint32_t wsa_properties_decimation(struct wsa_sweep_device_properties *prop)
+{
+	if (prop->mode == MODE_DECSH || prop->mode == MODE_DECSHN)
+		return prop->min_decimation;
+
+	return 1;
+}
+
+
+/**
+ * works out the properties of a mode's samples at a decimation.  The 
+ * device's decimation filter keeps WSA_DECIMATED_USABLE percent of the 
+ * decimated bandwidth around the center frequency, and never more than 
+ * the mode's own usable bandwidth.
+ *
+ * @param prop - the properties of the mode
+ * @param decimation - the decimation
+ * @param dprop - where to store the properties of the decimated samples
+ */
+static void wsa_decimated_properties(struct wsa_sweep_device_properties *prop, 
+	uint32_t decimation, 
+	struct wsa_sweep_device_properties *dprop)
+{
+	uint32_t base = wsa_properties_decimation(prop);
+	uint32_t half_usable;
+
+	*dprop = *prop;
+	if (decimation <= base)
+		return;
+
+	dprop->full_bw = (uint32_t) (((uint64_t) prop->full_bw * base) / decimation);
+	half_usable = (uint32_t) (((uint64_t) dprop->full_bw * WSA_DECIMATED_USABLE) / 200);
+	if (half_usable > (prop->usable_bw >> 1))
+		half_usable = prop->usable_bw >> 1;
+
+	dprop->usable_bw = half_usable << 1;
+	dprop->passband_center = dprop->full_bw >> 1;
+	dprop->usable_left = dprop->passband_center - half_usable;
+	dprop->usable_right = dprop->passband_center + half_usable;
+}
+
+
+/**
+ * retrieves the properties of the samples a config captures, at the 
+ * decimation it was planned with
+ *
+ * @param cfg - the power spectrum config
+ * @param dprop - where to store the properties
+ * @return - dprop, or NULL if the mode is not supported
+ */
+static struct wsa_sweep_device_properties *wsa_config_properties(struct wsa_power_spectrum_config *cfg, 
+	struct wsa_sweep_device_properties *dprop)
+{
+	struct wsa_sweep_device_properties *prop = wsa_get_sweep_device_properties(cfg->mode);
+
+	if (prop == NULL)
+		return NULL;
+
+	wsa_decimated_properties(prop, cfg->decimation, dprop);
+
+	return dprop;
+}
+
+
+/**
+ * sets a sweep time model to the starting one, which nothing was fitted to
+ *
+ * @param timing - the model
+ */
+static void wsa_sweep_timing_defaults(struct wsa_sweep_timing *timing)
+{
+	memset(timing, 0, sizeof(struct wsa_sweep_timing));
+	timing->retune_time = WSA_PLAN_RETUNE_TIME;
+	timing->packet_time = WSA_PLAN_PACKET_TIME;
+	timing->byte_time = WSA_PLAN_BYTE_TIME;
+}
+
+
+/**
+ * forgets the sweeps a device's sweep time model was fitted to, for 
+ * instance after its network connection changed
+ *
+ * @param sweep_device - the sweep device
+ */
+void wsa_sweep_timing_reset(struct wsa_sweep_device *sweep_device)
+{
+	wsa_sweep_timing_defaults(&sweep_device->timing);
+}
+
+
+/**
+ * breaks the time one step of a sweep takes into the terms of the sweep
+ * time model
+ *
+ * @param prop - the properties of the mode being swept
+ * @param spp - the samples per packet
+ * @param ppb - the packets per block
+ * @param terms - set to what the retune, packet and byte times are multiplied by
+ * @return - the time to capture the samples, in seconds
+ */
+static double wsa_step_terms(struct wsa_sweep_device_properties *prop, uint32_t spp, uint32_t ppb, double *terms)
+{
+	double samples = (double) spp * (double) ppb;
+	double sample_bytes = (prop->sample_type == SAMPLETYPE_I_ONLY) ? 2 : 4;
+	double sample_rate = (prop->sample_type == SAMPLETYPE_IQ) ? (double) prop->full_bw : 2.0 * prop->full_bw;
+
+	terms[0] = 1;
+	terms[1] = ppb;
+	terms[2] = samples * sample_bytes;
+
+	return samples / sample_rate;
+}
+
+
+/**
+ * estimates how long one step of a sweep takes: retuning, capturing the 
+ * block, and sending its packets
+ *
+ * @param timing - the sweep time model
+ * @param prop - the properties of the mode being swept
+ * @param spp - the samples per packet
+ * @param ppb - the packets per block
+ * @return - the time in seconds
+ */
+static double wsa_step_time(struct wsa_sweep_timing const *timing, struct wsa_sweep_device_properties *prop, uint32_t spp, uint32_t ppb)
+{
+	double terms[3];
+	double capture = wsa_step_terms(prop, spp, ppb, terms);
+
+	return capture
+		+ (terms[0] * timing->retune_time)
+		+ (terms[1] * timing->packet_time)
+		+ (terms[2] * timing->byte_time);
+}
+
+
+/**
+ * adds a step a device took to the sums its sweep time model is fitted to
+ *
+ * @param timing - the model
+ * @param prop - the properties of the mode being swept
+ * @param spp - the samples per packet
+ * @param ppb - the packets per block
+ * @param step - the seconds between the start of this step's block and the next one's
+ */
+static void wsa_sweep_timing_observe(struct wsa_sweep_timing *timing, struct wsa_sweep_device_properties *prop, 
+	uint32_t spp, uint32_t ppb, double step)
+{
+	struct wsa_sweep_timing start;
+	double terms[3];
+	double y;
+	int j, k;
+
+	if (step <= 0)
+		return;
+
+	// fit scale factors for the starting times, which keeps the sums well 
+	// conditioned
+	wsa_sweep_timing_defaults(&start);
+	y = step - wsa_step_terms(prop, spp, ppb, terms);
+	terms[0] *= start.retune_time;
+	terms[1] *= start.packet_time;
+	terms[2] *= start.byte_time;
+
+	for (j = 0; j < 3; j++) {
+		for (k = 0; k < 3; k++)
+			timing->zz[j][k] += terms[j] * terms[k];
+		timing->zy[j] += terms[j] * y;
+		timing->z[j] += terms[j];
+	}
+	timing->steps++;
+}
+
+
+/**
+ * fits a sweep time model to the steps observed: a least squares fit of 
+ * the retune, packet and byte times, pulled towards the starting times 
+ * as if they had been seen WSA_TIMING_PRIOR_STEPS times, so that times a
+ * device's sweeps don't tell apart keep their starting values
+ *
+ * @param timing - the model
+ */
+static void wsa_sweep_timing_fit(struct wsa_sweep_timing *timing)
+{
+	struct wsa_sweep_timing start;
+	double a[3][4];
+	double scale[3];
+	double mean;
+	double tmp;
+	int j, k, row, pivot;
+
+	if (timing->steps == 0)
+		return;
+
+	// the normal equations, with the prior on each scale factor weighted 
+	// by the size of its term
+	for (j = 0; j < 3; j++) {
+		for (k = 0; k < 3; k++)
+			a[j][k] = timing->zz[j][k];
+		mean = timing->z[j] / timing->steps;
+		a[j][j] += WSA_TIMING_PRIOR_STEPS * mean * mean;
+		a[j][3] = timing->zy[j] + (WSA_TIMING_PRIOR_STEPS * mean * mean);
+	}
+
+	// gaussian elimination with partial pivoting
+	for (j = 0; j < 3; j++) {
+		pivot = j;
+		for (row = j + 1; row < 3; row++)
+			if (fabs(a[row][j]) > fabs(a[pivot][j]))
+				pivot = row;
+		if (a[pivot][j] == 0)
+			return;
+		for (k = 0; k < 4; k++) {
+			tmp = a[j][k];
+			a[j][k] = a[pivot][k];
+			a[pivot][k] = tmp;
+		}
+		for (row = j + 1; row < 3; row++) {
+			tmp = a[row][j] / a[j][j];
+			for (k = j; k < 4; k++)
+				a[row][k] -= tmp * a[j][k];
+		}
+	}
+	for (j = 2; j >= 0; j--) {
+		scale[j] = a[j][3];
+		for (k = j + 1; k < 3; k++)
+			scale[j] -= a[j][k] * scale[k];
+		scale[j] /= a[j][j];
+
+		// none of the times can be negative
+		if (scale[j] < 0)
+			scale[j] = 0;
+	}
+
+	wsa_sweep_timing_defaults(&start);
+	timing->retune_time = start.retune_time * scale[0];
+	timing->packet_time = start.packet_time * scale[1];
+	timing->byte_time = start.byte_time * scale[2];
+}
+
+
+/**
+ * estimates how long a device takes to do one sweep of a config, using 
+ * the sweep time model fitted to the sweeps it has done so far (or the 
+ * starting model if it hasn't swept yet)
+ *
+ * @param sweep_device - the sweep device
+ * @param cfg - the power spectrum config
+ * @return - the time in seconds, negative on error
+ */
+double wsa_estimate_sweep_time(struct wsa_sweep_device *sweep_device, struct wsa_power_spectrum_config *cfg)
+{
+	struct wsa_sweep_device_properties dprop;
+	struct wsa_sweep_device_properties *prop;
+	uint32_t steps;
+
+	prop = wsa_config_properties(cfg, &dprop);
+	if (prop == NULL || cfg->packets_per_block == 0)
+		return -EUNSUPPORTED;
+
+	steps = cfg->packet_total / cfg->packets_per_block;
+
+	return steps * wsa_step_time(&sweep_device->timing, prop, cfg->samples_per_packet, cfg->packets_per_block);
+}
+
+
+/**
+ * splits a block into packets, picking the packet size that makes each 
+ * sweep step the quickest: fewer packets have less overhead, but a 
+ * packet size that doesn't divide the block well captures and sends 
+ * samples that aren't used
+ *
+ * @param prop - the properties of the mode being swept
+ * @param samples - the samples the block needs
+ * @param spp - set to the samples per packet
+ * @param ppb - set to the packets per block
+ */
+static void wsa_plan_block(struct wsa_sweep_device_properties *prop, uint32_t samples, uint32_t *spp, uint32_t *ppb)
+{
+	struct wsa_sweep_timing timing;
+	uint32_t packets;
+	uint32_t size;
+	double cost;
+	double best = -1;
+
+	// plans are shared by devices, so they use the starting model
+	wsa_sweep_timing_defaults(&timing);
+
+	for (packets = (samples + WSA_MAX_SPP - 1) / WSA_MAX_SPP; ; packets++) {
+		// packets must hold a multiple of 32 samples
+		size = (samples + packets - 1) / packets;
+		size = ((size + WSA_SPP_MULTIPLE - 1) / WSA_SPP_MULTIPLE) * WSA_SPP_MULTIPLE;
+		if (size < WSA_MIN_SPP)
+			size = WSA_MIN_SPP;
+
+		cost = wsa_step_time(&timing, prop, size, packets);
+		if (best < 0 || cost < best) {
+			best = cost;
+			*spp = size;
+			*ppb = packets;
+		}
+
+		// more packets than that only adds overhead
+		if (size == WSA_MIN_SPP)
+			break;
+	}
+}
+
+
+/**
+ * rounds an fft size up to a multiple of 64 with no prime factors but 2, 3 
+ * and 5, which kiss_fft does quickly (it falls back to a slow generic 
+ * butterfly for other factors)
+ *
+ * @param points - a multiple of 64
+ * @return - the rounded size
+ */
+static uint32_t wsa_plan_fft_size(uint32_t points)
+{
+	uint32_t n;
+
+	for (;; points += 64) {
+		n = points / 64;
+		while (n % 2 == 0)
+			n /= 2;
+		while (n % 3 == 0)
+			n /= 3;
+		while (n % 5 == 0)
+			n /= 5;
+		if (n == 1)
+			return points;
+	}
+}
+
+
+/**
+ * works out the fft size that gives an rbw
+ *
+ * @param prop - the properties of the samples
+ * @param rbw - the rbw asked for
+ * @return - the fft size
+ */
+static uint32_t wsa_plan_points(struct wsa_sweep_device_properties *prop, uint64_t rbw)
+{
+	uint32_t points;
+
+	// how many points (fft bins) are in a full band
+	points = prop->full_bw / ((uint32_t) rbw);
+
+	// make the sample size is a multiple of 32
+	points = (uint32_t) ((((uint32_t) (points / WSA_SPP_MULTIPLE)) * WSA_SPP_MULTIPLE) + WSA_SPP_MULTIPLE);
+	
+	
+	// double points because superhet, real samples only give half as many bins
+	if (prop->sample_type != SAMPLETYPE_IQ)
+		points = points << 1;
+
+	// test value for size
+	if (points < WSA_MIN_SPP)
+		points = WSA_MIN_SPP;
+
+	// the fft can span several packets, up to the largest block the device captures
+	if (points > WSA_MAX_CAPTURE_BLOCK)
+		points = (WSA_MAX_CAPTURE_BLOCK / 64) * 64;
+
+	return wsa_plan_fft_size(points);
+}
+
+
+/**
+ * works out how many samples a block needs for the welch averaging of a 
+ * config
+ *
+ * @param pscfg - the config
+ * @param points - the fft size
+ * @return - the samples in each block
+ */
+static uint32_t wsa_plan_block_samples(struct wsa_power_spectrum_config *pscfg, uint32_t points)
+{
+	uint32_t block_samples = points;
+
+	// welch averaging needs enough samples in each block to hold all the segments
+	if (pscfg->welch_segments > 1) {
+		block_samples = points + ((pscfg->welch_segments - 1) * ((points * (100 - pscfg->welch_overlap)) / 100));
+		if (block_samples > WSA_MAX_CAPTURE_BLOCK)
+			block_samples = WSA_MAX_CAPTURE_BLOCK;
+	}
+
+	return block_samples;
+}
+
+
+/**
+ * picks the decimation to sweep a config with.  Decimating narrows the 
+ * band of each step, but an rbw then takes a smaller fft and fewer 
+ * samples, so for spans that are narrow next to the usable bandwidth 
+ * the steps are quicker and no more of them are needed.  Each power of 
+ * two the mode allows is costed with the starting sweep time model, and 
+ * the quickest that achieves the rbw wins; if none does, the one with 
+ * the finest rbw.
+ *
+ * @param pscfg - the config describing the sweep
+ * @param prop - the properties of the mode
+ * @return - the decimation
+ */
+static uint32_t wsa_plan_decimation(struct wsa_power_spectrum_config *pscfg, struct wsa_sweep_device_properties *prop)
+{
+	struct wsa_sweep_device_properties dprop;
+	struct wsa_sweep_timing timing;
+	uint32_t base = wsa_properties_decimation(prop);
+	uint32_t decimation;
+	uint32_t best = base;
+	uint32_t points;
+	uint32_t fstep;
+	uint32_t spp;
+	uint32_t ppb;
+	uint64_t span = pscfg->fstop - pscfg->fstart;
+	uint64_t rbw;
+	uint64_t best_rbw = 0;
+	uint64_t steps;
+	uint8_t fine;
+	double cost;
+	double best_cost = -1;
+
+	// only the I/Q modes are decimated into a narrower band
+	if (prop->sample_type != SAMPLETYPE_IQ || pscfg->fstop <= pscfg->fstart)
+		return base;
+
+	// plans are shared by devices, so they use the starting model
+	wsa_sweep_timing_defaults(&timing);
+
+	for (decimation = base; decimation <= prop->max_decimation; ) {
+		wsa_decimated_properties(prop, decimation, &dprop);
+
+		points = wsa_plan_points(&dprop, pscfg->requested_rbw);
+		rbw = (uint64_t) (((double) dprop.full_bw / wsa_spectrum_bins(&dprop, points)) + 0.5);
+
+		// decimating any further leaves too few bins in each step
+		if (rbw * 4 > dprop.usable_bw)
+			break;
+
+		// the first step must still be tunable
+		if (pscfg->fstart + (dprop.usable_bw >> 1) < dprop.min_tunable)
+			break;
+
+		fstep = ((dprop.usable_bw - (uint32_t) rbw) / dprop.tuning_resolution) * dprop.tuning_resolution;
+		steps = (span + fstep - 1) / fstep;
+
+		wsa_plan_block(&dprop, wsa_plan_block_samples(pscfg, points), &spp, &ppb);
+		cost = (double) steps * wsa_step_time(&timing, &dprop, spp, ppb);
+
+		fine = (rbw <= pscfg->requested_rbw);
+		if (best_cost < 0
+			|| (fine && (best_rbw > pscfg->requested_rbw || cost < best_cost))
+			|| (!fine && best_rbw > pscfg->requested_rbw && rbw < best_rbw)) {
+			best = decimation;
+			best_rbw = rbw;
+			best_cost = cost;
+		}
+
+		decimation = decimation << 1;
+		if (decimation < prop->min_decimation)
+			decimation = prop->min_decimation;
+	}
+
+	return best;
+}
+
+
+/**
+ * given a desired sweep configuration, this functions figures out how to achieve it
+ *
+ * @param sweep_device - the sweep device object we're operating on
+ * @param pscfg - the config object which describes what we're trying to sweep
+ * @return - negative on error, zero on success
+ */
+static int wsa_plan_sweep(struct wsa_power_spectrum_config *pscfg)
+{
+	struct wsa_sweep_device_properties *prop;
+	struct wsa_sweep_device_properties dprop;
+	struct wsa_sweep_plan *plan;
+	uint64_t fcstart, fcstop;
+	float tmpfreq;
+	uint32_t fstep;
+	uint32_t half_usable_bw;
+	uint8_t dd_mode = 0;
 	uint32_t add_packet = 0;
 	uint32_t points;
+	uint32_t spp;
 	uint32_t ppb = 1;
-	uint32_t divided_points;
+	uint32_t block_samples;
+	uint32_t decimation;
 	// try to get device properties for this mode
 	
 	prop = wsa_get_sweep_device_properties(pscfg->mode);
@@ -638,6 +2716,12 @@ static int wsa_plan_sweep(struct wsa_power_spectrum_config *pscfg)
 		return -EUNSUPPORTED;
 	}
 
+	// plan with the properties of the samples at the decimation picked
+	decimation = wsa_plan_decimation(pscfg, prop);
+	wsa_decimated_properties(prop, decimation, &dprop);
+	prop = &dprop;
+	pscfg->decimation = decimation;
+
 	/*
 	 * calculate some helper variables we'll need
 	 */
@@ -645,42 +2729,30 @@ static int wsa_plan_sweep(struct wsa_power_spectrum_config *pscfg)
 	// how wide is halfband for this mode?
 	half_usable_bw = prop->usable_bw >> 1;
 
-	// how many points (fft bins) are in a full band
-	points = prop->full_bw / ((uint32_t) pscfg->rbw);
-
-	// make the sample size is a multiple of 32
-	points = (uint32_t) ((((uint32_t) (points / WSA_SPP_MULTIPLE)) * WSA_SPP_MULTIPLE) + WSA_SPP_MULTIPLE);
-	
-	
-	// double points because superhet
-	points = points << 1;
+	// the fft that gives the rbw
+	points = wsa_plan_points(prop, pscfg->requested_rbw);
 
-	// test value for size
-	if (points < WSA_MIN_SPP)
-		points = WSA_MIN_SPP;
-	divided_points = WSA_MAX_SPP * 2;
+	// recalc what that actually results in for the rbw, to the nearest hz
+	pscfg->rbw = (uint64_t) (((double) prop->full_bw / wsa_spectrum_bins(prop, points)) + 0.5);
 
-	// if the points are greater than the maximum size, use multiple packets per block
-	if (points > WSA_MAX_SPP){
-		ppb = 1;
-		points = WSA_MAX_SPP;
-	}
- 
-	doutf(DHIGH, "wsa_plan_sweep: calculated spp/ppb: %d, %d\n", (int32_t) points,  (int32_t) ppb);
+	// welch averaging needs enough samples in each block to hold all the segments
+	block_samples = wsa_plan_block_samples(pscfg, points);
 
-	// recalc what that actually results in for the rbw
-	pscfg->rbw = (uint64_t) ((double) prop->full_bw) / (points / 2);
-	
+	// and split the block into packets
+	wsa_plan_block(prop, block_samples, &spp, &ppb);
+	doutf(DHIGH, "wsa_plan_sweep: calculated fft/spp/ppb: %d, %d, %d\n", (int32_t) points, (int32_t) spp, (int32_t) ppb);
 	
 	// assign the samples per packet and packets per block
-	pscfg->samples_per_packet = points;
+	pscfg->samples_per_packet = spp;
 	pscfg->packets_per_block = ppb;
+	pscfg->fft_size = points;
 	
 	// change the start and stop they want into center start and stops
 	fcstart = pscfg->fstart + half_usable_bw;
 
-	// determine if DD mode is required
-	if (pscfg->fstart < prop->min_tunable)
+	// determine if DD mode is required.  Its real 16 bit samples go through
+	// the same fft as the other steps, so only the I only modes can use it
+	if (pscfg->fstart < prop->min_tunable && prop->sample_type == SAMPLETYPE_I_ONLY)
 	{
 		dd_mode = 1;
 		fcstart = prop->min_tunable + half_usable_bw - prop->tuning_resolution;
@@ -721,7 +2793,7 @@ static int wsa_plan_sweep(struct wsa_power_spectrum_config *pscfg)
 		pscfg->only_dd = 0;
 
 	// create sweep plan objects for each entry
-	pscfg->sweep_plan = wsa_sweep_plan_entry_new(fcstart, fcstop, fstep, points, ppb, dd_mode);
+	pscfg->sweep_plan = wsa_sweep_plan_entry_new(fcstart, fcstop, fstep, spp, ppb, decimation, dd_mode);
 	doutf(DHIGH, "wsa_plan_sweep: calculated fstart/fstop: %u, %u\n",  fcstart,  fcstop);
 	// do we need a cleanup entry?
 	if ((fcstop + half_usable_bw) < pscfg->fstop) {
@@ -738,7 +2810,7 @@ static int wsa_plan_sweep(struct wsa_power_spectrum_config *pscfg)
 		if (dd_mode == 1)
 			tmpfreq = pscfg->fstop + (half_usable_bw / 2);
 		// now create the entry
-		pscfg->sweep_plan->next_entry = wsa_sweep_plan_entry_new(tmpfreq, tmpfreq, fstep, points, 1, dd_mode);
+		pscfg->sweep_plan->next_entry = wsa_sweep_plan_entry_new(tmpfreq, tmpfreq, fstep, spp, ppb, decimation, dd_mode);
 	}
 
 	
@@ -772,6 +2844,253 @@ static int wsa_plan_sweep(struct wsa_power_spectrum_config *pscfg)
 }
 
 
+/**
+ * frees a shared plan
+ *
+ * @param plan - the plan to free
+ */
+static void wsa_shared_plan_free(struct wsa_shared_plan *plan)
+{
+	wsa_sweep_plan_free(plan->sweep_plan);
+	free(plan->freqs);
+	free(plan);
+}
+
+
+/**
+ * frees the least recently used plans no config is using, beyond the
+ * WSA_PLAN_CACHE_SIZE kept for later.  The cache must be locked.
+ */
+static void wsa_plan_cache_trim(void)
+{
+	struct wsa_shared_plan **link = &wsa_plan_cache;
+	struct wsa_shared_plan *plan;
+	uint32_t unused = 0;
+
+	while (*link) {
+		plan = *link;
+		if (plan->refs == 0 && ++unused > WSA_PLAN_CACHE_SIZE) {
+			*link = plan->next;
+			wsa_shared_plan_free(plan);
+		} else {
+			link = &plan->next;
+		}
+	}
+}
+
+
+/**
+ * plans a sweep and works out the layout of the spectrum it produces
+ *
+ * @param cfg - a config describing the sweep, its plan settings are overwritten
+ * @param model - the model of the device the sweep is for
+ * @param planp - set to the new plan, with no references
+ * @return - negative on error, 0 on success
+ */
+static int wsa_shared_plan_new(struct wsa_power_spectrum_config *cfg, char const *model, struct wsa_shared_plan **planp)
+{
+	struct wsa_sweep_device_properties dprop;
+	struct wsa_sweep_device_properties *prop;
+	struct wsa_shared_plan *plan;
+	uint32_t fftlen;
+	uint32_t bins;
+	double bin;
+	uint32_t istop;
+	uint32_t i;
+	int result;
+
+	result = wsa_plan_sweep(cfg);
+	if (result < 0)
+		return result;
+	prop = wsa_config_properties(cfg, &dprop);
+
+	plan = (struct wsa_shared_plan *) malloc(sizeof(struct wsa_shared_plan));
+	if (plan == NULL) {
+		wsa_sweep_plan_free(cfg->sweep_plan);
+		return -ENOMEM;
+	}
+	memset(plan, 0, sizeof(struct wsa_shared_plan));
+
+	plan->fstart = cfg->fstart;
+	plan->fstop = cfg->fstop;
+	plan->requested_rbw = cfg->requested_rbw;
+	plan->mode = cfg->mode;
+	plan->welch_segments = cfg->welch_segments;
+	plan->welch_overlap = cfg->welch_overlap;
+	strncpy(plan->model, model, MAX_STR_LEN - 1);
+
+	plan->sweep_plan = cfg->sweep_plan;
+	plan->rbw = cfg->rbw;
+	plan->packet_total = cfg->packet_total;
+	plan->packets_per_block = cfg->packets_per_block;
+	plan->samples_per_packet = cfg->samples_per_packet;
+	plan->fft_size = cfg->fft_size;
+	plan->decimation = cfg->decimation;
+	plan->only_dd = cfg->only_dd;
+
+	// the bins are placed with the exact bin width, cfg->rbw is rounded to the hz
+	fftlen = plan->fft_size >> 1;
+	bins = wsa_spectrum_bins(prop, plan->fft_size);
+	bin = (double) prop->full_bw / bins;
+	plan->buflen = (uint32_t) ((double) (cfg->fstop - cfg->fstart) / bin);
+
+	/*
+	 * we used to be in superhet mode, but after a complex FFT, we have twice 
+	 * the spectrum at twice the RBW.
+	 * our fcenter is now moved from center to $passband_center so our start and stop 
+	 * indexes are calculated given that fact
+	 */
+	plan->istart[0] = (uint32_t) (prop->usable_left / bin);
+	istop = (uint32_t) (prop->usable_right / bin);
+	plan->ilen[0] = istop - plan->istart[0];
+	plan->istart[1] = (uint32_t) ((prop->full_bw - prop->usable_right) / bin);
+	istop = (uint32_t) ((prop->full_bw - prop->usable_left) / bin);
+	plan->ilen[1] = istop - plan->istart[1];
+
+	// in DD mode the start and stop will be different
+	plan->dd_istart = (uint32_t) (((float) cfg->fstart / (float) prop->full_bw) * fftlen);
+	if (cfg->fstop > (float) prop->min_tunable)
+		istop = (uint32_t) (0.8 * fftlen);
+	else
+		istop = (uint32_t) (((float) cfg->fstop / (float) prop->full_bw) * fftlen) - 1;
+	plan->dd_ilen = istop - plan->dd_istart;
+	doutf(DHIGH, "wsa_shared_plan_new: calculated DD istart %u\n", plan->dd_istart);
+
+	// never read past the spectrum
+	for (i = 0; i < 2; i++) {
+		if (plan->istart[i] + plan->ilen[i] > bins)
+			plan->ilen[i] = (plan->istart[i] < bins) ? bins - plan->istart[i] : 0;
+	}
+	if (plan->dd_istart + plan->dd_ilen > fftlen)
+		plan->dd_ilen = (plan->dd_istart < fftlen) ? fftlen - plan->dd_istart : 0;
+
+	// and the frequency axis of the buffer
+	plan->freqs = (double *) malloc(sizeof(double) * plan->buflen);
+	if (plan->freqs == NULL) {
+		wsa_shared_plan_free(plan);
+		return -ENOMEM;
+	}
+	for (i = 0; i < plan->buflen; i++)
+		plan->freqs[i] = (double) plan->fstart + ((double) (plan->fstop - plan->fstart) * i) / plan->buflen;
+
+	*planp = plan;
+	return 0;
+}
+
+
+/**
+ * gives a config the plan for the sweep it describes, from the cache if 
+ * the same sweep was planned for the same model before
+ *
+ * @param cfg - the config, its plan settings are set on success
+ * @param model - the model of the device the sweep is for
+ * @return - negative on error, 0 on success
+ */
+static int wsa_shared_plan_get(struct wsa_power_spectrum_config *cfg, char const *model)
+{
+	struct wsa_mutex *lock = wsa_mutex_global();
+	struct wsa_shared_plan **link;
+	struct wsa_shared_plan *plan = NULL;
+	struct wsa_power_spectrum_config scratch;
+	int result = 0;
+
+	wsa_mutex_lock(lock);
+
+	for (link = &wsa_plan_cache; *link; link = &(*link)->next) {
+		plan = *link;
+		if (plan->fstart == cfg->fstart && plan->fstop == cfg->fstop
+			&& plan->requested_rbw == cfg->requested_rbw
+			&& plan->mode == cfg->mode
+			&& plan->welch_segments == cfg->welch_segments
+			&& plan->welch_overlap == cfg->welch_overlap
+			&& strncmp(plan->model, model, MAX_STR_LEN - 1) == 0) {
+			// move it to the front
+			*link = plan->next;
+			break;
+		}
+		plan = NULL;
+	}
+
+	// plan on a copy, so the config is left alone if it fails
+	if (plan == NULL) {
+		scratch = *cfg;
+		result = wsa_shared_plan_new(&scratch, model, &plan);
+	}
+
+	if (result >= 0) {
+		plan->refs++;
+		plan->next = wsa_plan_cache;
+		wsa_plan_cache = plan;
+		wsa_plan_cache_trim();
+	}
+
+	wsa_mutex_unlock(lock);
+
+	if (result < 0)
+		return result;
+
+	cfg->shared_plan = plan;
+	cfg->sweep_plan = plan->sweep_plan;
+	cfg->rbw = plan->rbw;
+	cfg->packet_total = plan->packet_total;
+	cfg->packets_per_block = plan->packets_per_block;
+	cfg->samples_per_packet = plan->samples_per_packet;
+	cfg->fft_size = plan->fft_size;
+	cfg->decimation = plan->decimation;
+	cfg->only_dd = plan->only_dd;
+	cfg->buflen = plan->buflen;
+	cfg->freqs = plan->freqs;
+	cfg->step_count = plan->packet_total / plan->packets_per_block;
+
+	return 0;
+}
+
+
+/**
+ * lets go of a config's plan, which stays cached for a while
+ *
+ * @param plan - the plan, may be NULL
+ */
+static void wsa_shared_plan_release(struct wsa_shared_plan *plan)
+{
+	struct wsa_mutex *lock = wsa_mutex_global();
+
+	if (plan == NULL)
+		return;
+
+	wsa_mutex_lock(lock);
+	plan->refs--;
+	wsa_plan_cache_trim();
+	wsa_mutex_unlock(lock);
+}
+
+
+/**
+ * frees the cached sweep plans no config is using.  Plans are shared by 
+ * the configs allocated for the same sweep, and kept for a while after 
+ * the last one is freed, so that allocating the same sweep again skips 
+ * the planning.
+ */
+void wsa_sweep_plan_cache_clear(void)
+{
+	struct wsa_mutex *lock = wsa_mutex_global();
+	struct wsa_shared_plan **link = &wsa_plan_cache;
+	struct wsa_shared_plan *plan;
+
+	wsa_mutex_lock(lock);
+	while (*link) {
+		plan = *link;
+		if (plan->refs == 0) {
+			*link = plan->next;
+			wsa_shared_plan_free(plan);
+		} else {
+			link = &plan->next;
+		}
+	}
+	wsa_mutex_unlock(lock);
+}
+
+
 /**
  * sets the attenuator in the sweep device
  *
@@ -797,26 +3116,23 @@ unsigned int wsa_sweep_device_get_attenuator(struct wsa_sweep_device *sweep_devi
 
 
 /**
- * converts a sweep plan into a list of sweep entries and loads them onto the device
+ * empties the sweep list of a device and sets what all its entries share,
+ * ready for the entries to be saved
  *
  * @param sweep_device - the sweep device to use
- * @param cfg - the sweep configuration which holds all sweep info, including the sweep plan
+ * @param init - 1 to also initialize the device object and make the list 
+ * 	run once, which reloading a list for the same device doesn't need
  * @return - negative on error, 0 on success
  */
-static int wsa_sweep_plan_load(struct wsa_sweep_device *wsasweepdev, struct wsa_power_spectrum_config *cfg)
+static int wsa_sweep_list_begin(struct wsa_sweep_device *wsasweepdev, uint8_t init)
 {
-	int result;
-	struct wsa_resp query;
+	int result = 0;
 	struct wsa_device *wsadev = wsasweepdev->real_device;
-	struct wsa_sweep_plan *plan_entry;
-	char dd[255] = "DD";
 	char atten_cmd[255];
-	char * strtok_result;
-    char * strtok_context = NULL;
-	plan_entry=cfg->sweep_plan;
 
 	// grab the device id, and initialize the object
-	result = _wsa_dev_init(wsadev);
+	if (init)
+		result = _wsa_dev_init(wsadev);
 
 	// clear any existing sweep entries
 	wsa_sweep_entry_delete_all(wsadev);
@@ -825,7 +3141,8 @@ static int wsa_sweep_plan_load(struct wsa_sweep_device *wsasweepdev, struct wsa_
 	wsa_sweep_entry_new(wsadev);
 
 	// setup the sweep list to only run once
-	wsa_set_sweep_iteration(wsadev, 1);
+	if (init)
+		wsa_set_sweep_iteration(wsadev, 1);
 
 	// set attenuation, if the device is a 408 model use sweep entry
 	if (strstr(wsadev->descr.dev_model, WSA5000408) != NULL || 
@@ -838,6 +3155,28 @@ static int wsa_sweep_plan_load(struct wsa_sweep_device *wsasweepdev, struct wsa_
 		result = wsa_send_scpi(wsadev, atten_cmd);
 	}
 
+	return result;
+}
+
+
+/**
+ * converts a sweep plan into a list of sweep entries and loads them onto the device
+ *
+ * @param sweep_device - the sweep device to use
+ * @param cfg - the sweep configuration which holds all sweep info, including the sweep plan
+ * @return - negative on error, 0 on success
+ */
+static int wsa_sweep_plan_load(struct wsa_sweep_device *wsasweepdev, struct wsa_power_spectrum_config *cfg)
+{
+	int result;
+	struct wsa_device *wsadev = wsasweepdev->real_device;
+	struct wsa_sweep_plan *plan_entry;
+	char dd[255] = "DD";
+	uint32_t decimation = 1;
+	plan_entry=cfg->sweep_plan;
+
+	result = wsa_sweep_list_begin(wsasweepdev, 1);
+
 	// if DD mode is required, create one sweep entry with DD mode
 	if (cfg->sweep_plan->dd_mode == 1){
 		
@@ -871,6 +3210,16 @@ static int wsa_sweep_plan_load(struct wsa_sweep_device *wsasweepdev, struct wsa_
 		wsa_set_sweep_packets_per_block(wsadev, plan_entry->ppb);
 		if (result < 0) fprintf(stderr, "ERROR ppb\n");
 
+		// the entries start out undecimated
+		if (plan_entry->decimation != decimation) {
+			result = wsa_set_sweep_decimation(wsadev, (int32_t) plan_entry->decimation);
+			if (result < 0) {
+				doutf(DHIGH, "wsa_sweep_plan_load: Failed to set the decimation: %d\n", result);
+				return result;
+			}
+			decimation = plan_entry->decimation;
+		}
+
 		// save to end of list
 		if (cfg->only_dd != 1) 
 			wsa_sweep_entry_save(wsadev, 0);
@@ -879,3 +3228,77 @@ static int wsa_sweep_plan_load(struct wsa_sweep_device *wsasweepdev, struct wsa_
 	return 0;
 }
 
+
+/**
+ * loads the steps an adaptive sweep picked onto the device, each run of
+ * consecutive steps of a plan entry as one sweep entry.  Every setting 
+ * is a round trip to the device, so only the frequencies are set again 
+ * for runs of the same plan entry.
+ *
+ * @param sweep_device - the sweep device to use
+ * @param cfg - the sweep configuration, with the steps in cfg->adaptive->order
+ * @return - negative on error, 0 on success
+ */
+static int wsa_adaptive_load(struct wsa_sweep_device *wsasweepdev, struct wsa_power_spectrum_config *cfg)
+{
+	int result;
+	struct wsa_adaptive_sweep *as = cfg->adaptive;
+	struct wsa_device *wsadev = wsasweepdev->real_device;
+	struct wsa_sweep_plan *entry;
+	struct wsa_sweep_plan *set_entry = NULL;
+	char dd[255] = "DD";
+	uint32_t decimation = 1;
+	uint32_t first;
+	uint32_t last;
+	uint32_t i;
+
+	result = wsa_sweep_list_begin(wsasweepdev, 0);
+
+	i = 0;
+
+	// the DD step comes first, as in the full list
+	if (as->order_len > 0 && as->entries[as->order[0]] == NULL) {
+		wsa_set_sweep_rfe_input_mode(wsadev, dd);
+		wsa_set_sweep_samples_per_packet(wsadev, (int32_t) cfg->sweep_plan->spp);
+		wsa_set_sweep_packets_per_block(wsadev, (int32_t) cfg->sweep_plan->ppb);
+		wsa_sweep_entry_save(wsadev, 0);
+		i++;
+	}
+
+	result = wsa_set_sweep_rfe_input_mode(wsadev, mode_const_to_string(cfg->mode));
+
+	while (i < as->order_len) {
+		first = as->order[i];
+		entry = as->entries[first];
+
+		// take in the steps that follow on in the same entry
+		last = first;
+		for (i++; i < as->order_len && as->order[i] == last + 1 && as->entries[last + 1] == entry; i++)
+			last++;
+
+		result = wsa_set_sweep_freq(wsadev, (int64_t) as->fcenter[first], (int64_t) as->fcenter[last]);
+		if (result < 0) fprintf(stderr, "ERROR %d fstart fstop\n", result);
+
+		if (entry != set_entry) {
+			result = wsa_set_sweep_freq_step(wsadev, (int64_t) entry->fstep);
+			if (result < 0) fprintf(stderr, "ERROR fstep\n");
+
+			wsa_set_sweep_samples_per_packet(wsadev, entry->spp);
+			wsa_set_sweep_packets_per_block(wsadev, entry->ppb);
+			if (entry->decimation != decimation) {
+				result = wsa_set_sweep_decimation(wsadev, (int32_t) entry->decimation);
+				if (result < 0) {
+					doutf(DHIGH, "wsa_adaptive_load: Failed to set the decimation: %d\n", result);
+					return result;
+				}
+				decimation = entry->decimation;
+			}
+			set_entry = entry;
+		}
+
+		wsa_sweep_entry_save(wsadev, 0);
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,385 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "wsa_sweep_group.h"
+#include "wsa_thread.h"
+#include "wsa_error.h"
+#include "wsa_debug.h"
+
+/// how many times the shares are planned again with the coarsest rbw 
+/// before the group gives up on them agreeing
+#define WSA_SWEEP_GROUP_PLAN_ATTEMPTS 4
+
+/// one device's share of a group operation, run on its own thread
+struct wsa_sweep_group_job {
+	struct wsa_sweep_group *group;
+	uint32_t index;
+	uint8_t configure;
+};
+
+
+/**
+ * the highest frequency a device can tune to, from its descriptor
+ *
+ * @param sweep_device - the device
+ * @return - the frequency, in Hz, or the largest frequency if the descriptor doesn't say
+ */
+static uint64_t wsa_sweep_group_max_freq(struct wsa_sweep_device *sweep_device)
+{
+	uint64_t max_freq = sweep_device->real_device->descr.max_tune_freq;
+
+	return (max_freq > 0) ? max_freq : (uint64_t) -1;
+}
+
+
+/**
+ * allocates a power spectrum config for each sub span of the group
+ *
+ * @param group - the group, with its devices and sub spans set
+ * @param starts - the start of each sub span, and the stop of the last at [count]
+ * @param rbw - the rbw to plan the configs with
+ * @param mode - the rfe mode to sweep in
+ * @return - 0 on success, negative on error
+ */
+static int wsa_sweep_group_alloc_cfgs(struct wsa_sweep_group *group,
+					uint64_t const *starts,
+					uint32_t rbw,
+					char const *mode)
+{
+	uint32_t i;
+	int result;
+
+	for (i = 0; i < group->count; i++) {
+		if (group->cfgs[i] != NULL) {
+			wsa_power_spectrum_free(group->cfgs[i]);
+			group->cfgs[i] = NULL;
+		}
+
+		result = wsa_power_spectrum_alloc(group->devices[i],
+					starts[i],
+					starts[i + 1],
+					rbw,
+					mode,
+					&group->cfgs[i]);
+		if (result < 0) {
+			group->cfgs[i] = NULL;
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * creates a sweep group, which sweeps a span with several devices at
+ * once.  Each device sweeps a share of the span no higher than the
+ * highest frequency it can tune to, the devices that can tune the lowest
+ * taking the lowest shares, and otherwise the span is split evenly.  Each
+ * share starts on a multiple of the rbw from fstart, and all the configs
+ * are planned with the same rbw, so the joined spectrum has one rbw
+ * throughout.  Devices left without a share, such as when the span is
+ * narrower than a few rbws, are not used.
+ *
+ * The configs of the group are in group->cfgs, where their averaging,
+ * threads and so on can be set as for any other config.
+ *
+ * @param devices - the devices to sweep with, each used by this group only
+ * @param count - the number of devices
+ * @param fstart - the start of the span, in Hz
+ * @param fstop - the stop of the span, in Hz
+ * @param rbw - the rbw to sweep with, in Hz
+ * @param mode - the rfe mode to sweep in
+ * @param groupp - where the group is stored
+ * @return - 0 on success, WSA_ERR_SWEEPGROUPRBW if the shares can't be
+ * planned with one rbw, negative on other errors
+ */
+int wsa_sweep_group_new(
+	struct wsa_sweep_device **devices,
+	uint32_t count,
+	uint64_t fstart,
+	uint64_t fstop,
+	uint32_t rbw,
+	char const *mode,
+	struct wsa_sweep_group **groupp
+)
+{
+	struct wsa_sweep_group *group;
+	uint32_t *order;
+	uint64_t *starts;
+	uint64_t cur;
+	uint64_t stop;
+	uint64_t coarsest;
+	uint32_t left;
+	uint32_t i;
+	uint32_t j;
+	int agree;
+	uint32_t k;
+	int result;
+
+	if (devices == NULL || count == 0 || fstop <= fstart || rbw == 0)
+		return WSA_ERR_INVNUMBER;
+
+	group = malloc(sizeof(struct wsa_sweep_group));
+	if (group == NULL)
+		return WSA_ERR_MALLOCFAILED;
+
+	memset(group, 0, sizeof(struct wsa_sweep_group));
+	group->fstart = fstart;
+	group->fstop = fstop;
+	group->devices = malloc(sizeof(struct wsa_sweep_device *) * count);
+	group->cfgs = malloc(sizeof(struct wsa_power_spectrum_config *) * count);
+	group->offsets = malloc(sizeof(uint32_t) * count);
+	group->results = malloc(sizeof(int) * count);
+	order = malloc(sizeof(uint32_t) * count);
+	starts = malloc(sizeof(uint64_t) * (count + 1));
+	if (group->devices == NULL || group->cfgs == NULL || group->offsets == NULL
+		|| group->results == NULL || order == NULL || starts == NULL) {
+		free(order);
+		free(starts);
+		wsa_sweep_group_free(group);
+		return WSA_ERR_MALLOCFAILED;
+	}
+	for (i = 0; i < count; i++)
+		group->cfgs[i] = NULL;
+
+	// the devices that tune the lowest go first, keeping their given order otherwise
+	for (i = 0; i < count; i++) {
+		for (j = i; j > 0; j--) {
+			if (wsa_sweep_group_max_freq(devices[order[j - 1]]) <= wsa_sweep_group_max_freq(devices[i]))
+				break;
+			order[j] = order[j - 1];
+		}
+		order[j] = i;
+	}
+
+	// split the span, each device taking an even share of what's left
+	cur = fstart;
+	left = count;
+	for (k = 0; k < count && cur < fstop; k++) {
+		i = order[k];
+		stop = cur + (fstop - cur) / left;
+		left--;
+		if (left == 0 || stop > fstop)
+			stop = fstop;
+		if (stop > wsa_sweep_group_max_freq(devices[i]))
+			stop = wsa_sweep_group_max_freq(devices[i]);
+		if (stop < fstop)
+			stop = fstart + ((stop - fstart) / rbw) * rbw;
+		if (stop <= cur)
+			continue;
+
+		group->devices[group->count] = devices[i];
+		starts[group->count] = cur;
+		group->count++;
+		cur = stop;
+	}
+	starts[group->count] = cur;
+	free(order);
+
+	if (cur < fstop) {
+		doutf(DHIGH, "wsa_sweep_group_new: the devices can't tune up to %llu Hz\n", (unsigned long long) fstop);
+		free(starts);
+		wsa_sweep_group_free(group);
+		return WSA_ERR_FREQOUTOFBOUND;
+	}
+
+	// plan every share, and again with the coarsest rbw until the plans 
+	// agree: in the I/Q modes each share picks its own decimation, so the
+	// shares can still disagree after planning again
+	result = wsa_sweep_group_alloc_cfgs(group, starts, rbw, mode);
+	for (j = 0; result >= 0; j++) {
+		coarsest = group->cfgs[0]->rbw;
+		agree = 1;
+		for (i = 1; i < group->count; i++) {
+			if (group->cfgs[i]->rbw != group->cfgs[0]->rbw)
+				agree = 0;
+			if (group->cfgs[i]->rbw > coarsest)
+				coarsest = group->cfgs[i]->rbw;
+		}
+		if (agree)
+			break;
+
+		if (j == WSA_SWEEP_GROUP_PLAN_ATTEMPTS) {
+			doutf(DHIGH, "wsa_sweep_group_new: the shares can't be planned with one rbw\n");
+			result = WSA_ERR_SWEEPGROUPRBW;
+			break;
+		}
+		result = wsa_sweep_group_alloc_cfgs(group, starts, (uint32_t) coarsest, mode);
+	}
+	free(starts);
+	if (result < 0) {
+		wsa_sweep_group_free(group);
+		return result;
+	}
+
+	// lay the spectra out one after the other
+	group->rbw = group->cfgs[0]->rbw;
+	for (i = 0; i < group->count; i++) {
+		group->offsets[i] = group->buflen;
+		group->buflen += group->cfgs[i]->buflen;
+	}
+
+	group->buf = malloc(sizeof(float) * group->buflen);
+	group->freqs = malloc(sizeof(double) * group->buflen);
+	if (group->buf == NULL || group->freqs == NULL) {
+		wsa_sweep_group_free(group);
+		return WSA_ERR_MALLOCFAILED;
+	}
+
+	for (i = 0; i < group->count; i++) {
+		memcpy(group->buf + group->offsets[i], group->cfgs[i]->buf, sizeof(float) * group->cfgs[i]->buflen);
+		memcpy(group->freqs + group->offsets[i], group->cfgs[i]->freqs, sizeof(double) * group->cfgs[i]->buflen);
+		group->results[i] = 0;
+	}
+
+	*groupp = group;
+	return 0;
+}
+
+
+/**
+ * frees a sweep group and its configs, but not its devices
+ *
+ * @param group - the group to free
+ */
+void wsa_sweep_group_free(struct wsa_sweep_group *group)
+{
+	uint32_t i;
+
+	if (group == NULL)
+		return;
+
+	if (group->cfgs != NULL) {
+		for (i = 0; i < group->count; i++) {
+			if (group->cfgs[i] != NULL)
+				wsa_power_spectrum_free(group->cfgs[i]);
+		}
+	}
+
+	free(group->devices);
+	free(group->cfgs);
+	free(group->offsets);
+	free(group->results);
+	free(group->buf);
+	free(group->freqs);
+	free(group);
+}
+
+
+/**
+ * thread function: configures or captures with one device of a group
+ *
+ * @param arg - the job
+ */
+static void wsa_sweep_group_job_run(void *arg)
+{
+	struct wsa_sweep_group_job *job = (struct wsa_sweep_group_job *) arg;
+	struct wsa_sweep_group *group = job->group;
+
+	if (job->configure) {
+		wsa_configure_sweep(group->devices[job->index], group->cfgs[job->index]);
+		group->results[job->index] = 0;
+	} else {
+		group->results[job->index] = wsa_capture_power_spectrum(group->devices[job->index],
+							group->cfgs[job->index],
+							NULL);
+	}
+}
+
+
+/**
+ * runs a job on every device of a group at once, the first on the
+ * calling thread, and waits for them all
+ *
+ * @param group - the group
+ * @param configure - 1 to configure the devices, 0 to capture with them
+ */
+static void wsa_sweep_group_run(struct wsa_sweep_group *group, uint8_t configure)
+{
+	struct wsa_sweep_group_job *jobs;
+	struct wsa_thread **threads;
+	struct wsa_sweep_group_job job;
+	uint32_t i;
+
+	jobs = malloc(sizeof(struct wsa_sweep_group_job) * group->count);
+	threads = malloc(sizeof(struct wsa_thread *) * group->count);
+
+	// without the memory for threads, one device at a time still works
+	if (jobs == NULL || threads == NULL) {
+		free(jobs);
+		free(threads);
+		job.group = group;
+		job.configure = configure;
+		for (i = 0; i < group->count; i++) {
+			job.index = i;
+			wsa_sweep_group_job_run(&job);
+		}
+		return;
+	}
+
+	for (i = 0; i < group->count; i++) {
+		jobs[i].group = group;
+		jobs[i].index = i;
+		jobs[i].configure = configure;
+		threads[i] = NULL;
+	}
+
+	for (i = 1; i < group->count; i++) {
+		threads[i] = wsa_thread_new(wsa_sweep_group_job_run, &jobs[i]);
+		if (threads[i] == NULL)
+			wsa_sweep_group_job_run(&jobs[i]);
+	}
+	wsa_sweep_group_job_run(&jobs[0]);
+
+	for (i = 1; i < group->count; i++) {
+		if (threads[i] != NULL)
+			wsa_thread_join(threads[i]);
+	}
+
+	free(jobs);
+	free(threads);
+}
+
+
+/**
+ * loads the sweep lists of all the devices of a group, at once
+ *
+ * @param group - the group to configure
+ */
+void wsa_sweep_group_configure(struct wsa_sweep_group *group)
+{
+	wsa_sweep_group_run(group, 1);
+}
+
+
+/**
+ * captures the span of a group, each device sweeping its share
+ * concurrently, and joins their spectra.  The share of a device whose
+ * capture fails keeps its last spectrum.
+ *
+ * @param group - the group to capture with
+ * @param buf - if buf is not NULL, a pointer to the joined spectrum is stored there for convenience
+ * @return - 0 on success, or the error of the first device that failed
+ */
+int wsa_sweep_group_capture(struct wsa_sweep_group *group, float **buf)
+{
+	int result = 0;
+	uint32_t i;
+
+	wsa_sweep_group_run(group, 0);
+
+	for (i = 0; i < group->count; i++) {
+		if (group->results[i] < 0) {
+			if (result == 0)
+				result = group->results[i];
+			continue;
+		}
+		memcpy(group->buf + group->offsets[i], group->cfgs[i]->buf, sizeof(float) * group->cfgs[i]->buflen);
+	}
+
+	if (buf != NULL)
+		*buf = group->buf;
+
+	return result;
+}
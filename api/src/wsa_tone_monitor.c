@@ -0,0 +1,493 @@
+#include <stdlib.h>
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "wsa_tone_monitor.h"
+#include "wsa_api.h"
+#include "wsa_dsp.h"
+#include "wsa_error.h"
+#include "wsa_debug.h"
+
+/// the smallest power converted to dB, to keep silent tones finite
+#define WSA_TONE_MIN_POWER 1e-20
+
+/// the cost of an fft per sample and stage, relative to one goertzel step
+#define WSA_TONE_FFT_COST 1.5
+
+
+/**
+ * picks the cheaper way of measuring the tones of a block: a goertzel 
+ * filter costs one step per sample and tone, an fft about 
+ * WSA_TONE_FFT_COST steps per sample and stage, half that for real 
+ * samples
+ *
+ * @param monitor - the monitor
+ * @return - WSA_TONE_GOERTZEL or WSA_TONE_FFT
+ */
+static uint32_t wsa_tone_monitor_choose(struct wsa_tone_monitor *monitor)
+{
+	double fft_cost;
+
+	if (monitor->method != WSA_TONE_AUTO)
+		return monitor->method;
+
+	fft_cost = WSA_TONE_FFT_COST * log((double) monitor->block_len) / log(2.0);
+	if (!monitor->iq)
+		fft_cost /= 2;
+
+	// each goertzel tone of I/Q data runs on both I and Q
+	if (((double) monitor->tone_count * (monitor->iq ? 2 : 1)) > fft_cost)
+		return WSA_TONE_FFT;
+
+	return WSA_TONE_GOERTZEL;
+}
+
+
+/**
+ * sets up the fft the monitor measures with when it has many tones
+ *
+ * @param monitor - the monitor
+ * @return - 0 on success, negative on error
+ */
+static int16_t wsa_tone_monitor_init_fft(struct wsa_tone_monitor *monitor)
+{
+	if (monitor->plan)
+		return 0;
+
+	monitor->plan = wsa_fft_plan_new((int32_t) monitor->block_len, 
+		monitor->iq ? WSA_FFT_COMPLEX : WSA_FFT_REAL);
+	monitor->fftout = malloc(sizeof(kiss_fft_cpx) * monitor->block_len);
+	monitor->spectrum = malloc(sizeof(double) * monitor->block_len);
+	if (monitor->iq)
+		monitor->segment_cpx = malloc(sizeof(kiss_fft_cpx) * monitor->block_len);
+	else
+		monitor->segment = malloc(sizeof(kiss_fft_scalar) * monitor->block_len);
+
+	if (monitor->plan == NULL || monitor->fftout == NULL || monitor->spectrum == NULL || 
+		(monitor->segment == NULL && monitor->segment_cpx == NULL)) {
+		// leave nothing half set up, so a later call tries again
+		wsa_fft_plan_free(monitor->plan);
+		free(monitor->fftout);
+		free(monitor->spectrum);
+		free(monitor->segment_cpx);
+		free(monitor->segment);
+		monitor->plan = NULL;
+		monitor->fftout = NULL;
+		monitor->spectrum = NULL;
+		monitor->segment_cpx = NULL;
+		monitor->segment = NULL;
+		return WSA_ERR_MALLOCFAILED;
+	}
+
+	return 0;
+}
+
+
+/**
+ * creates a tone monitor
+ *
+ * @param sample_rate - the sample rate, in Hz
+ * @param block_len - the number of samples measured in each block
+ * @param iq - 1 for I/Q samples, 0 for real samples
+ * @param freqs - the frequencies of the tones, relative to the baseband of 
+ *	the samples, in Hz: 0 to sample_rate / 2 for real samples, 
+ *	-sample_rate / 2 to sample_rate / 2 for I/Q samples
+ * @param tone_count - the number of tones
+ * @return - the monitor, or NULL on invalid parameters or failure
+ */
+struct wsa_tone_monitor *wsa_tone_monitor_new(double sample_rate, 
+					uint32_t block_len, 
+					uint8_t iq,
+					double const *freqs, 
+					uint32_t tone_count)
+{
+	struct wsa_tone_monitor *monitor;
+	double w;
+	uint32_t i;
+
+	if (sample_rate <= 0 || block_len < 2 || tone_count == 0)
+		return NULL;
+
+	monitor = malloc(sizeof(struct wsa_tone_monitor));
+	if (monitor == NULL)
+		return NULL;
+
+	memset(monitor, 0, sizeof(struct wsa_tone_monitor));
+	monitor->sample_rate = sample_rate;
+	monitor->block_len = block_len;
+	monitor->iq = iq ? 1 : 0;
+	monitor->tone_count = tone_count;
+	monitor->method = WSA_TONE_AUTO;
+
+	monitor->freqs = malloc(sizeof(double) * tone_count);
+	monitor->coef = malloc(sizeof(double) * tone_count);
+	monitor->cos_w = malloc(sizeof(double) * tone_count);
+	monitor->sin_w = malloc(sizeof(double) * tone_count);
+	monitor->state = malloc(sizeof(double) * tone_count * 2);
+	monitor->dft = malloc(sizeof(double) * tone_count * 4);
+	monitor->window = malloc(sizeof(kiss_fft_scalar) * block_len);
+	if (monitor->freqs == NULL || monitor->coef == NULL || monitor->cos_w == NULL || 
+		monitor->sin_w == NULL || monitor->state == NULL || monitor->dft == NULL || monitor->window == NULL) {
+		wsa_tone_monitor_free(monitor);
+		return NULL;
+	}
+
+	for (i = 0; i < tone_count; i++) {
+		monitor->freqs[i] = freqs[i];
+		w = 2 * M_PI * freqs[i] / sample_rate;
+		monitor->cos_w[i] = cos(w);
+		monitor->sin_w[i] = sin(w);
+		monitor->coef[i] = 2 * cos(w);
+	}
+
+	window_hanning_table(monitor->window, (int) block_len);
+
+	if (wsa_tone_monitor_set_method(monitor, WSA_TONE_AUTO) < 0) {
+		wsa_tone_monitor_free(monitor);
+		return NULL;
+	}
+
+	return monitor;
+}
+
+
+/**
+ * destroys a tone monitor
+ *
+ * @param monitor - the monitor, may be NULL
+ */
+void wsa_tone_monitor_free(struct wsa_tone_monitor *monitor)
+{
+	if (monitor == NULL)
+		return;
+
+	wsa_fft_plan_free(monitor->plan);
+	free(monitor->packet_q);
+	free(monitor->packet_i);
+	free(monitor->i32_buffer);
+	free(monitor->q16_buffer);
+	free(monitor->i16_buffer);
+	free(monitor->qdata);
+	free(monitor->idata);
+	free(monitor->spectrum);
+	free(monitor->fftout);
+	free(monitor->segment_cpx);
+	free(monitor->segment);
+	free(monitor->window);
+	free(monitor->dft);
+	free(monitor->state);
+	free(monitor->sin_w);
+	free(monitor->cos_w);
+	free(monitor->coef);
+	free(monitor->freqs);
+	free(monitor);
+}
+
+
+/**
+ * chooses how a tone monitor measures its tones
+ *
+ * @param monitor - the monitor
+ * @param method - WSA_TONE_GOERTZEL, WSA_TONE_FFT, or WSA_TONE_AUTO to use 
+ *	whichever costs less for the number of tones and the block length
+ * @return - 0 on success, negative on error, in which case the monitor 
+ *	keeps measuring the way it did
+ */
+int16_t wsa_tone_monitor_set_method(struct wsa_tone_monitor *monitor, uint32_t method)
+{
+	uint32_t previous;
+	uint32_t active_method;
+	int16_t result;
+
+	if (method != WSA_TONE_AUTO && method != WSA_TONE_GOERTZEL && method != WSA_TONE_FFT)
+		return WSA_ERR_INVNUMBER;
+
+	previous = monitor->method;
+	monitor->method = method;
+	active_method = wsa_tone_monitor_choose(monitor);
+
+	// keep measuring the previous way until the fft is set up
+	if (active_method == WSA_TONE_FFT) {
+		result = wsa_tone_monitor_init_fft(monitor);
+		if (result < 0) {
+			doutf(DHIGH, "wsa_tone_monitor_set_method: the fft could not be set up: %d\n", result);
+			monitor->method = previous;
+			return result;
+		}
+	}
+
+	monitor->active_method = active_method;
+	doutf(DMED, "wsa_tone_monitor_set_method: %u tones measured with %s\n", monitor->tone_count, 
+		(monitor->active_method == WSA_TONE_FFT) ? "an fft" : "goertzel filters");
+
+	return 0;
+}
+
+
+/**
+ * runs the goertzel filters of every tone over one channel of a block.
+ * The tones are the inner loop so it vectorizes across them.
+ *
+ * @param monitor - the monitor
+ * @param data - the samples of the channel
+ * @param re - where to store the real part of each tone's dft
+ * @param im - where to store the imaginary part of each tone's dft
+ */
+static void wsa_tone_monitor_goertzel(struct wsa_tone_monitor *monitor, 
+	kiss_fft_scalar const *data, double *re, double *im)
+{
+	double *s1 = monitor->state;
+	double *s2 = monitor->state + monitor->tone_count;
+	double const *coef = monitor->coef;
+	double x, s0;
+	uint32_t n, t;
+	uint32_t tones = monitor->tone_count;
+
+	for (t = 0; t < tones; t++) {
+		s1[t] = 0;
+		s2[t] = 0;
+	}
+
+	for (n = 0; n < monitor->block_len; n++) {
+		x = data[n] * monitor->window[n];
+		for (t = 0; t < tones; t++) {
+			s0 = x + (coef[t] * s1[t]) - s2[t];
+			s2[t] = s1[t];
+			s1[t] = s0;
+		}
+	}
+
+	// the dft at the tone, up to a phase that the power doesn't depend on
+	for (t = 0; t < tones; t++) {
+		re[t] = s1[t] - (s2[t] * monitor->cos_w[t]);
+		im[t] = s2[t] * monitor->sin_w[t];
+	}
+}
+
+
+/**
+ * reads the power of a tone off a spectrum.  A tone between bins comes 
+ * out of the nearest bin attenuated by the response of the hanning 
+ * window at that offset, sinc(d) / (1 - d^2), which is divided back out.
+ *
+ * @param power - the spectrum, unscaled
+ * @param len - the number of bins
+ * @param bin - the position of the tone in bins
+ * @return - the power at the tone
+ */
+static double wsa_tone_monitor_read_bin(double const *power, int32_t len, double bin)
+{
+	int32_t k = (int32_t) floor(bin + 0.5);
+	double delta = bin - k;
+	double response;
+
+	if (k < 0)
+		k = 0;
+	else if (k >= len)
+		k = len - 1;
+
+	if (delta == 0 || fabs(delta) > 0.5)
+		return power[k];
+
+	response = sin(M_PI * delta) / (M_PI * delta) / (1 - (delta * delta));
+
+	return power[k] / (response * response);
+}
+
+
+/**
+ * measures the tones of a block of samples
+ *
+ * The levels match the peak of each tone in the power spectrum of the same
+ * samples, without the scalloping loss of a tone between bins.
+ *
+ * @param monitor - the monitor
+ * @param idata - the I samples
+ * @param qdata - the Q samples, ignored for real samples
+ * @param len - the number of samples, at least the block length of the 
+ *	monitor; only the first block length samples are used
+ * @param reflevel - the reference level of the samples, in dBm
+ * @param power - where to store the power of each tone, in dBm
+ * @return - 0 on success, negative on error
+ */
+int16_t wsa_tone_monitor_process(struct wsa_tone_monitor *monitor,
+					kiss_fft_scalar const *idata,
+					kiss_fft_scalar const *qdata,
+					uint32_t len,
+					float reflevel,
+					float *power)
+{
+	double *spectrum = monitor->spectrum;
+	double *re = monitor->dft;
+	double *im = monitor->dft + monitor->tone_count;
+	double value, bin;
+	double scale = 1.0 / ((double) monitor->block_len * (double) monitor->block_len);
+	uint32_t n = monitor->block_len;
+	uint32_t t, i;
+
+	if (len < monitor->block_len || (monitor->iq && qdata == NULL))
+		return WSA_ERR_INVCAPTURESIZE;
+
+	if (monitor->active_method == WSA_TONE_GOERTZEL) {
+		wsa_tone_monitor_goertzel(monitor, idata, re, im);
+		if (monitor->iq) {
+			// the dft of I + jQ is the dft of I plus j times the dft of Q
+			wsa_tone_monitor_goertzel(monitor, qdata, re + (2 * monitor->tone_count), 
+				re + (3 * monitor->tone_count));
+			for (t = 0; t < monitor->tone_count; t++) {
+				value = re[t];
+				re[t] = value - re[(3 * monitor->tone_count) + t];
+				im[t] = im[t] + re[(2 * monitor->tone_count) + t];
+			}
+		}
+
+		for (t = 0; t < monitor->tone_count; t++) {
+			value = ((re[t] * re[t]) + (im[t] * im[t])) * scale;
+			if (value < WSA_TONE_MIN_POWER)
+				value = WSA_TONE_MIN_POWER;
+			power[t] = (float) (10 * log10(value)) + reflevel;
+		}
+
+		return 0;
+	}
+
+	if (monitor->iq) {
+		for (i = 0; i < n; i++) {
+			monitor->segment_cpx[i].r = idata[i] * monitor->window[i];
+			monitor->segment_cpx[i].i = qdata[i] * monitor->window[i];
+		}
+		wsa_fft_execute(monitor->plan, monitor->segment_cpx, monitor->fftout);
+		for (i = 0; i < n; i++)
+			spectrum[i] = (monitor->fftout[i].r * monitor->fftout[i].r) + (monitor->fftout[i].i * monitor->fftout[i].i);
+	} else {
+		for (i = 0; i < n; i++)
+			monitor->segment[i] = idata[i] * monitor->window[i];
+		wsa_fft_execute_real(monitor->plan, monitor->segment, monitor->fftout);
+		for (i = 0; i <= n / 2; i++)
+			spectrum[i] = (monitor->fftout[i].r * monitor->fftout[i].r) + (monitor->fftout[i].i * monitor->fftout[i].i);
+	}
+
+	for (t = 0; t < monitor->tone_count; t++) {
+		bin = monitor->freqs[t] * n / monitor->sample_rate;
+
+		// negative frequencies of I/Q data are in the top half of the fft
+		if (bin < -0.5)
+			bin += n;
+		value = wsa_tone_monitor_read_bin(spectrum, monitor->iq ? (int32_t) n : (int32_t) (n / 2) + 1, bin) * scale;
+		if (value < WSA_TONE_MIN_POWER)
+			value = WSA_TONE_MIN_POWER;
+		power[t] = (float) (10 * log10(value)) + reflevel;
+	}
+
+	return 0;
+}
+
+
+/**
+ * captures a block and measures its tones, with the reference level of 
+ * the block's digitizer context.  The device must already be tuned, and
+ * its samples per packet and packets per block set so a block holds at 
+ * least the block length of the monitor.
+ *
+ * @param dev - the device to capture with
+ * @param monitor - the monitor
+ * @param power - where to store the power of each tone, in dBm
+ * @return - 0 on success, WSA_ERR_INVSTREAMTYPE if the data stream is not 
+ * I/Q for an I/Q monitor or is I/Q for a real one, negative on other errors
+ */
+int16_t wsa_tone_monitor_capture(struct wsa_device *dev, 
+					struct wsa_tone_monitor *monitor, 
+					float *power)
+{
+	struct wsa_vrt_packet_header header;
+	struct wsa_vrt_packet_trailer trailer;
+	struct wsa_receiver_packet receiver;
+	struct wsa_digitizer_packet digitizer;
+	struct wsa_extension_packet extension;
+	float reflevel = 0;
+	int32_t samples_per_packet;
+	int32_t packets_per_block;
+	int32_t packet_count = 0;
+	uint32_t filled = 0;
+	uint32_t copy;
+	int16_t result;
+
+	result = wsa_get_samples_per_packet(dev, &samples_per_packet);
+	if (result < 0)
+		return result;
+	result = wsa_get_packets_per_block(dev, &packets_per_block);
+	if (result < 0)
+		return result;
+	if ((uint32_t) (samples_per_packet * packets_per_block) < monitor->block_len)
+		return WSA_ERR_INVCAPTURESIZE;
+
+	// the buffers stay with the monitor for the next block
+	if (monitor->idata == NULL) {
+		monitor->idata = malloc(sizeof(kiss_fft_scalar) * monitor->block_len);
+		monitor->qdata = malloc(sizeof(kiss_fft_scalar) * monitor->block_len);
+		if (monitor->idata == NULL || monitor->qdata == NULL)
+			return WSA_ERR_MALLOCFAILED;
+	}
+	if ((uint32_t) samples_per_packet > monitor->packet_size) {
+		free(monitor->packet_q);
+		free(monitor->packet_i);
+		free(monitor->i32_buffer);
+		free(monitor->q16_buffer);
+		free(monitor->i16_buffer);
+		monitor->i16_buffer = malloc(sizeof(int16_t) * samples_per_packet);
+		monitor->q16_buffer = malloc(sizeof(int16_t) * samples_per_packet);
+		monitor->i32_buffer = malloc(sizeof(int32_t) * samples_per_packet);
+		monitor->packet_i = malloc(sizeof(kiss_fft_scalar) * samples_per_packet);
+		monitor->packet_q = malloc(sizeof(kiss_fft_scalar) * samples_per_packet);
+		monitor->packet_size = (uint32_t) samples_per_packet;
+		if (monitor->i16_buffer == NULL || monitor->q16_buffer == NULL || monitor->i32_buffer == NULL ||
+			monitor->packet_i == NULL || monitor->packet_q == NULL) {
+			monitor->packet_size = 0;
+			return WSA_ERR_MALLOCFAILED;
+		}
+	}
+
+	result = wsa_capture_block(dev);
+	if (result < 0)
+		return result;
+
+	// read the whole block out, keeping the samples the monitor needs
+	while (packet_count < packets_per_block) {
+		result = wsa_read_vrt_packet(dev, &header, &trailer, &receiver, &digitizer, &extension,
+			monitor->i16_buffer, monitor->q16_buffer, monitor->i32_buffer, samples_per_packet, 5000);
+		if (result < 0)
+			return result;
+
+		if (header.stream_id == DIGITIZER_STREAM_ID &&
+			(digitizer.indicator_field & REF_LEVEL_INDICATOR_MASK) == REF_LEVEL_INDICATOR_MASK)
+			reflevel = (float) digitizer.reference_level;
+
+		if (header.packet_type != IF_PACKET_TYPE)
+			continue;
+		packet_count++;
+
+		// I/Q monitors need both channels, real ones a single channel
+		if ((header.stream_id == I16Q16_DATA_STREAM_ID) != (monitor->iq != 0))
+			return WSA_ERR_INVSTREAMTYPE;
+
+		if (filled == monitor->block_len)
+			continue;
+
+		normalize_iq_data(header.samples_per_packet, header.stream_id, monitor->i16_buffer, 
+			monitor->q16_buffer, monitor->i32_buffer, monitor->packet_i, monitor->packet_q);
+		copy = monitor->block_len - filled;
+		if (copy > header.samples_per_packet)
+			copy = header.samples_per_packet;
+		memcpy(monitor->idata + filled, monitor->packet_i, sizeof(kiss_fft_scalar) * copy);
+		if (header.stream_id == I16Q16_DATA_STREAM_ID)
+			memcpy(monitor->qdata + filled, monitor->packet_q, sizeof(kiss_fft_scalar) * copy);
+		filled += copy;
+	}
+
+	if (filled < monitor->block_len)
+		return WSA_ERR_INVCAPTURESIZE;
+
+	return wsa_tone_monitor_process(monitor, monitor->idata, monitor->qdata, 
+		monitor->block_len, reflevel, power);
+}
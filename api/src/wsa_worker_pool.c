@@ -0,0 +1,263 @@
+#include <stdlib.h>
+
+#include "wsa_thread.h"
+#include "wsa_worker_pool.h"
+#include "wsa_debug.h"
+
+/// the arguments handed to each worker thread
+struct wsa_worker {
+	struct wsa_worker_pool *pool;
+	int32_t id;
+	struct wsa_thread *thread;
+};
+
+/// a fixed set of threads that run jobs in parallel
+struct wsa_worker_pool {
+	/// the number of workers, including the thread calling wsa_worker_pool_wait()
+	int32_t size;
+
+	/// the background workers (size - 1 of them)
+	struct wsa_worker *workers;
+
+	/// protects everything below
+	struct wsa_mutex *lock;
+	struct wsa_cond *work_ready;
+	struct wsa_cond *work_done;
+
+	/// the job being run, NULL when idle
+	wsa_worker_job job;
+	void *arg;
+
+	/// the number of items in the job, the next one to hand out and how many are done
+	int32_t count;
+	int32_t next;
+	int32_t finished;
+
+	/// set when the pool is being destroyed
+	uint8_t quit;
+};
+
+
+/**
+ * runs items of the current job until there are none left. Must be 
+ * called with the lock held, returns with it held.
+ *
+ * @param pool - the pool
+ * @param worker - the id of the calling worker
+ */
+static void wsa_worker_pool_drain(struct wsa_worker_pool *pool, int32_t worker)
+{
+	int32_t index;
+
+	while (pool->job != NULL && pool->next < pool->count) {
+		index = pool->next++;
+
+		wsa_mutex_unlock(pool->lock);
+		pool->job(pool->arg, index, worker);
+		wsa_mutex_lock(pool->lock);
+
+		pool->finished++;
+		if (pool->finished == pool->count)
+			wsa_cond_signal(pool->work_done);
+	}
+}
+
+
+// the main loop of the background workers
+static void wsa_worker_main(void *arg)
+{
+	struct wsa_worker *worker = (struct wsa_worker *) arg;
+	struct wsa_worker_pool *pool = worker->pool;
+
+	wsa_mutex_lock(pool->lock);
+	for (;;) {
+		while (!pool->quit && (pool->job == NULL || pool->next >= pool->count))
+			wsa_cond_wait(pool->work_ready, pool->lock);
+
+		if (pool->quit)
+			break;
+
+		wsa_worker_pool_drain(pool, worker->id);
+	}
+	wsa_mutex_unlock(pool->lock);
+}
+
+
+/**
+ * creates a pool of workers
+ *
+ * @param size - the number of workers, including the calling thread. 
+ *	A size of 1 starts no threads and runs every job on the caller.
+ * @return - the pool, or NULL on failure
+ */
+struct wsa_worker_pool *wsa_worker_pool_new(int32_t size)
+{
+	struct wsa_worker_pool *pool;
+	int32_t i;
+
+	if (size < 1)
+		size = 1;
+
+	pool = malloc(sizeof(struct wsa_worker_pool));
+	if (pool == NULL)
+		return NULL;
+
+	pool->size = 1;
+	pool->job = NULL;
+	pool->arg = NULL;
+	pool->count = 0;
+	pool->next = 0;
+	pool->finished = 0;
+	pool->quit = 0;
+	pool->workers = malloc(sizeof(struct wsa_worker) * size);
+	pool->lock = wsa_mutex_new();
+	pool->work_ready = wsa_cond_new();
+	pool->work_done = wsa_cond_new();
+
+	if (pool->workers == NULL || pool->lock == NULL || 
+		pool->work_ready == NULL || pool->work_done == NULL) {
+		wsa_worker_pool_free(pool);
+		return NULL;
+	}
+
+	// worker 0 is whoever calls wsa_worker_pool_wait()
+	for (i = 1; i < size; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].id = i;
+		pool->workers[i].thread = wsa_thread_new(wsa_worker_main, &pool->workers[i]);
+		if (pool->workers[i].thread == NULL) {
+			doutf(DHIGH, "wsa_worker_pool_new: only started %d of %d workers\n", (int) i, (int) size);
+			break;
+		}
+		pool->size++;
+	}
+
+	return pool;
+}
+
+
+/**
+ * stops the workers and frees the pool
+ *
+ * @param pool - the pool to free, may be NULL
+ */
+void wsa_worker_pool_free(struct wsa_worker_pool *pool)
+{
+	int32_t i;
+
+	if (pool == NULL)
+		return;
+
+	if (pool->lock && pool->work_ready) {
+		wsa_mutex_lock(pool->lock);
+		pool->quit = 1;
+		wsa_cond_broadcast(pool->work_ready);
+		wsa_mutex_unlock(pool->lock);
+
+		for (i = 1; i < pool->size; i++)
+			wsa_thread_join(pool->workers[i].thread);
+	}
+
+	if (pool->work_done)
+		wsa_cond_free(pool->work_done);
+	if (pool->work_ready)
+		wsa_cond_free(pool->work_ready);
+	if (pool->lock)
+		wsa_mutex_free(pool->lock);
+	if (pool->workers)
+		free(pool->workers);
+	free(pool);
+}
+
+
+/**
+ * retrieves the number of workers in the pool
+ *
+ * @param pool - the pool
+ * @return - the number of workers, including the calling thread
+ */
+int32_t wsa_worker_pool_size(struct wsa_worker_pool *pool)
+{
+	return pool->size;
+}
+
+
+/**
+ * starts running job(arg, index, worker) for every index from 0 to 
+ * count - 1 on the background workers, and returns without waiting for 
+ * them.  The items are handed out in order but may complete in any order,
+ * so each item must only write to memory no other item touches.  Call 
+ * wsa_worker_pool_wait() before starting another job.
+ *
+ * A pool of size 1 has no background workers, so the job is run to 
+ * completion before this returns.
+ *
+ * @param pool - the pool
+ * @param job - the function to run for each item
+ * @param arg - passed to every call of job
+ * @param count - the number of items
+ */
+void wsa_worker_pool_start(struct wsa_worker_pool *pool, wsa_worker_job job, void *arg, int32_t count)
+{
+	int32_t i;
+
+	if (count <= 0)
+		return;
+
+	// nothing to hand out, don't bother with the lock
+	if (pool->size == 1) {
+		for (i = 0; i < count; i++)
+			job(arg, i, 0);
+		return;
+	}
+
+	wsa_mutex_lock(pool->lock);
+	pool->job = job;
+	pool->arg = arg;
+	pool->count = count;
+	pool->next = 0;
+	pool->finished = 0;
+	wsa_cond_broadcast(pool->work_ready);
+	wsa_mutex_unlock(pool->lock);
+}
+
+
+/**
+ * runs the items of the job started by wsa_worker_pool_start() that no
+ * worker has picked up yet on the calling thread, as worker 0, and waits
+ * for the rest to finish.  Returns straight away if no job is running.
+ *
+ * @param pool - the pool
+ */
+void wsa_worker_pool_wait(struct wsa_worker_pool *pool)
+{
+	if (pool->size == 1)
+		return;
+
+	wsa_mutex_lock(pool->lock);
+	if (pool->job != NULL) {
+		wsa_worker_pool_drain(pool, 0);
+		while (pool->finished < pool->count)
+			wsa_cond_wait(pool->work_done, pool->lock);
+
+		pool->job = NULL;
+	}
+	wsa_mutex_unlock(pool->lock);
+}
+
+
+/**
+ * runs job(arg, index, worker) for every index from 0 to count - 1 and
+ * waits for all of them to finish, helping out on the calling thread.  
+ * See wsa_worker_pool_start().
+ *
+ * @param pool - the pool
+ * @param job - the function to run for each item
+ * @param arg - passed to every call of job
+ * @param count - the number of items
+ */
+void wsa_worker_pool_run(struct wsa_worker_pool *pool, wsa_worker_job job, void *arg, int32_t count)
+{
+	wsa_worker_pool_start(pool, job, arg, count);
+	wsa_worker_pool_wait(pool);
+}
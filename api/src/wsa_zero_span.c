@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "wsa_zero_span.h"
+#include "wsa_api.h"
+#include "wsa_dsp.h"
+#include "wsa_error.h"
+#include "wsa_debug.h"
+
+/// the buffers a zero span capture decodes and measures each packet in
+struct wsa_zero_span_buffers {
+	int16_t *i16_buffer;
+	int16_t *q16_buffer;
+	int32_t *i32_buffer;
+	kiss_fft_scalar *idata;
+	kiss_fft_scalar *qdata;
+	kiss_fft_cpx *ddc_out;
+	int32_t ddc_size;
+	float *rms;
+	float *peak;
+};
+
+
+/**
+ * reads out a captured block and measures each of its data packets
+ *
+ * @param dev - the device the block was captured with
+ * @param buffers - buffers for samples_per_packet samples
+ * @param samples_per_packet - the samples in each packet
+ * @param packets_per_block - the data packets in the block
+ * @param sample_rate - the sample rate of the captured data, in Hz
+ * @param ddc - a ddc to pass the samples through, or NULL
+ * @param interval - the samples per point, 0 or less for one point per packet
+ * @param points - where to store the points
+ * @param max_points - the size of points
+ * @param point_count - where to store the number of points stored
+ * @return - 0 on success, negative on error
+ */
+static int16_t wsa_zero_span_read(struct wsa_device *dev,
+				struct wsa_zero_span_buffers *buffers,
+				int32_t samples_per_packet,
+				int32_t packets_per_block,
+				double sample_rate,
+				struct wsa_ddc *ddc,
+				int32_t interval,
+				struct wsa_envelope_point *points,
+				int32_t max_points,
+				int32_t *point_count)
+{
+	struct wsa_vrt_packet_header header;
+	struct wsa_vrt_packet_trailer trailer;
+	struct wsa_receiver_packet receiver;
+	struct wsa_digitizer_packet digitizer;
+	struct wsa_extension_packet extension;
+	kiss_fft_scalar *qdata;
+	float reflevel = 0;
+	int32_t packet_count = 0;
+	int32_t count, len, step, k;
+	int64_t first;
+	int64_t delay;
+	int16_t result;
+
+	while (packet_count < packets_per_block) {
+		result = wsa_read_vrt_packet(dev, &header, &trailer, &receiver, &digitizer, &extension,
+			buffers->i16_buffer, buffers->q16_buffer, buffers->i32_buffer, samples_per_packet, 5000);
+		if (result < 0) {
+			doutf(DHIGH, "wsa_zero_span_read: wsa_read_vrt_packet returned %hd\n", result);
+			return result;
+		}
+
+		if (header.stream_id == DIGITIZER_STREAM_ID &&
+			(digitizer.indicator_field & REF_LEVEL_INDICATOR_MASK) == REF_LEVEL_INDICATOR_MASK)
+			reflevel = (float) digitizer.reference_level;
+
+		if (header.packet_type != IF_PACKET_TYPE)
+			continue;
+		packet_count++;
+
+		len = header.samples_per_packet;
+		normalize_iq_data(len, header.stream_id, buffers->i16_buffer, buffers->q16_buffer, 
+			buffers->i32_buffer, buffers->idata, buffers->qdata);
+		qdata = (header.stream_id == I16Q16_DATA_STREAM_ID) ? buffers->qdata : NULL;
+
+		// measure the intervals, and work out where their first samples are in 
+		// the packet.  A ddc output lags the newest input it was filtered from
+		// by the (ntaps - 1) / 2 sample group delay of the filter, so the 
+		// positions are counted in half samples to take it out exactly.
+		if (ddc) {
+			first = ddc->next_output;
+			delay = (int64_t) ddc->ntaps - 1;
+			step = (int32_t) ddc->decimation;
+			len = wsa_ddc_process(ddc, buffers->idata, qdata, len, buffers->ddc_out, buffers->ddc_size);
+			if (len < 0) {
+				doutf(DHIGH, "wsa_zero_span_read: wsa_ddc_process returned %d\n", (int) len);
+				return (int16_t) len;
+			}
+			count = psd_envelope_cpx(buffers->ddc_out, len, interval, reflevel, buffers->rms, buffers->peak);
+		} else {
+			first = 0;
+			delay = 0;
+			step = 1;
+			count = psd_envelope(buffers->idata, qdata, len, interval, reflevel, buffers->rms, buffers->peak);
+		}
+
+		if (interval > 0)
+			step *= interval;
+		else
+			step *= len;
+
+		for (k = 0; k < count && *point_count < max_points; k++) {
+			wsa_time_add_samples(&header.time_stamp, (2 * (first + ((int64_t) k * step))) - delay, 
+				2 * sample_rate, &points[*point_count].time_stamp);
+			points[*point_count].rms = buffers->rms[k];
+			points[*point_count].peak = buffers->peak[k];
+			(*point_count)++;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * captures a block and measures its power versus time, at the frequency
+ * the device is tuned to, without any fft.  Every data packet of the 
+ * block is cut in intervals, each giving one point time stamped from the 
+ * packet's VRT time stamp, so points don't straddle packets.
+ *
+ * The device must already be tuned, and its samples per packet and 
+ * packets per block set.  With a ddc, the samples are mixed, filtered and
+ * decimated first and the interval counts output samples, time stamped 
+ * with the delay of its filter taken out; the ddc keeps 
+ * its state, so consecutive blocks of a stream can be measured in turn.
+ *
+ * @param dev - the device to capture with
+ * @param sample_rate - the sample rate of the captured data, in Hz
+ * @param ddc - a ddc to pass the samples through, or NULL
+ * @param interval - the samples per point, 0 or less for one point per packet
+ * @param points - where to store the points
+ * @param max_points - the size of points; the block is still read out in
+ *	full when it holds more points
+ * @param point_count - where to store the number of points stored
+ * @return - 0 on success, negative on error
+ */
+int16_t wsa_zero_span_capture(struct wsa_device *dev,
+				double sample_rate,
+				struct wsa_ddc *ddc,
+				int32_t interval,
+				struct wsa_envelope_point *points,
+				int32_t max_points,
+				int32_t *point_count)
+{
+	struct wsa_zero_span_buffers buffers;
+	int32_t samples_per_packet;
+	int32_t packets_per_block;
+	int16_t result;
+
+	*point_count = 0;
+	if (sample_rate <= 0)
+		return WSA_ERR_INVNUMBER;
+
+	result = wsa_get_samples_per_packet(dev, &samples_per_packet);
+	if (result < 0)
+		return result;
+	result = wsa_get_packets_per_block(dev, &packets_per_block);
+	if (result < 0)
+		return result;
+
+	buffers.i16_buffer = (int16_t *) malloc(sizeof(int16_t) * samples_per_packet);
+	buffers.q16_buffer = (int16_t *) malloc(sizeof(int16_t) * samples_per_packet);
+	buffers.i32_buffer = (int32_t *) malloc(sizeof(int32_t) * samples_per_packet);
+	buffers.idata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * samples_per_packet);
+	buffers.qdata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * samples_per_packet);
+	buffers.rms = (float *) malloc(sizeof(float) * samples_per_packet);
+	buffers.peak = (float *) malloc(sizeof(float) * samples_per_packet);
+	buffers.ddc_size = ddc ? wsa_ddc_output_size(ddc, samples_per_packet) : 0;
+	buffers.ddc_out = ddc ? (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * buffers.ddc_size) : NULL;
+
+	if (buffers.i16_buffer == NULL || buffers.q16_buffer == NULL || buffers.i32_buffer == NULL || 
+		buffers.idata == NULL || buffers.qdata == NULL || buffers.rms == NULL || buffers.peak == NULL || 
+		(ddc && buffers.ddc_out == NULL)) {
+		doutf(DHIGH, "wsa_zero_span_capture: failed to allocate memory\n");
+		result = WSA_ERR_MALLOCFAILED;
+	} else {
+		result = wsa_capture_block(dev);
+		if (result >= 0)
+			result = wsa_zero_span_read(dev, &buffers, samples_per_packet, packets_per_block,
+				sample_rate, ddc, interval, points, max_points, point_count);
+	}
+
+	free(buffers.ddc_out);
+	free(buffers.peak);
+	free(buffers.rms);
+	free(buffers.qdata);
+	free(buffers.idata);
+	free(buffers.i32_buffer);
+	free(buffers.q16_buffer);
+	free(buffers.i16_buffer);
+
+	return result;
+}
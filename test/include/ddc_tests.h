@@ -0,0 +1,8 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <wsa_api.h>
+#include <wsa_lib.h>
+#include <wsa_error.h>
+
+int16_t ddc_tests(int32_t *fail_count, int32_t *pass_count);
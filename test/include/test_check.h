@@ -0,0 +1,4 @@
+#include <wsa_api.h>
+
+// counts a check as a pass or a fail
+void test_check(int passed, int32_t *fail_count, int32_t *pass_count);
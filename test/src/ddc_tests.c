@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <wsa_api.h>
+#include <wsa_lib.h>
+#include <wsa_ddc.h>
+#include <wsa_error.h>
+#include <test_check.h>
+
+#define DDC_TEST_RATE 1000000.0
+#define DDC_TEST_LEN 40000
+#define DDC_TEST_STEPS 2000
+
+// the response of the filter of a ddc at a frequency in cycles per input 
+// sample, in dB
+static double ddc_test_response(struct wsa_ddc *ddc, double f)
+{
+	double re = 0;
+	double im = 0;
+	uint32_t k;
+
+	for (k = 0; k < ddc->ntaps; k++) {
+		re += ddc->taps[k] * cos(2 * M_PI * f * k);
+		im -= ddc->taps[k] * sin(2 * M_PI * f * k);
+	}
+
+	return 10 * log10((re * re) + (im * im));
+}
+
+// runs a real tone through a ddc and measures the level of the output 
+// once the filter has settled, in dB relative to the level of the tone in
+// the real fft of the input
+static double ddc_test_tone(struct wsa_ddc *ddc, double freq, kiss_fft_scalar *idata, 
+		kiss_fft_cpx *out, int32_t out_size)
+{
+	double power = 0;
+	int32_t count, i;
+	int32_t settled = (int32_t) (ddc->ntaps / ddc->decimation) + 1;
+
+	for (i = 0; i < DDC_TEST_LEN; i++)
+		idata[i] = (kiss_fft_scalar) cos(2 * M_PI * freq * i / DDC_TEST_RATE);
+
+	wsa_ddc_reset(ddc);
+	count = wsa_ddc_process(ddc, idata, NULL, DDC_TEST_LEN, out, out_size);
+	if (count <= settled)
+		return 0;
+
+	for (i = settled; i < count; i++)
+		power += (out[i].r * out[i].r) + (out[i].i * out[i].i);
+
+	// a full scale tone has amplitude 1 / 2 in the real fft
+	return 10 * log10(power / (count - settled) / 0.25);
+}
+
+// checks the claims made for the default filter of a ddc: flat to within 
+// 0.001 dB over WSA_DDC_PASSBAND of the output nyquist frequency, 6.02 dB 
+// down at it, and WSA_DDC_STOPBAND_ATTENUATION down over everything that 
+// aliases into the passband; then runs tones through the ddc to check 
+// that the output follows the filter
+// results are stored in the pass/fail count variables
+int16_t ddc_tests(int32_t *fail_count, int32_t *pass_count){
+
+	uint32_t decimations[3] = {4, 5, 16};
+	kiss_fft_scalar *idata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * DDC_TEST_LEN);
+	kiss_fft_cpx *out = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * DDC_TEST_LEN);
+	struct wsa_ddc *ddc;
+	double nyquist, response, ripple, stopband;
+	uint32_t d, i;
+
+	if (idata == NULL || out == NULL) {
+		free(idata);
+		free(out);
+		*fail_count = *fail_count + 1;
+		return WSA_ERR_MALLOCFAILED;
+	}
+
+	for (d = 0; d < 3; d++) {
+		// shifted by a quarter of the sample rate, so the negative frequency
+		// image of the real input lands in the stopband
+		ddc = wsa_ddc_new(DDC_TEST_RATE, DDC_TEST_RATE / 4, decimations[d], 0);
+		if (ddc == NULL) {
+			*fail_count = *fail_count + 1;
+			continue;
+		}
+
+		// the output nyquist frequency, in cycles per input sample
+		nyquist = 0.5 / decimations[d];
+
+		ripple = 0;
+		for (i = 0; i <= DDC_TEST_STEPS; i++) {
+			response = ddc_test_response(ddc, WSA_DDC_PASSBAND * nyquist * i / DDC_TEST_STEPS);
+			if (fabs(response) > ripple)
+				ripple = fabs(response);
+		}
+		test_check(ripple < 0.001, fail_count, pass_count);
+
+		test_check(fabs(ddc_test_response(ddc, nyquist) + 6.02) < 0.05, fail_count, pass_count);
+
+		stopband = -1000;
+		for (i = 0; i <= DDC_TEST_STEPS; i++) {
+			response = ddc_test_response(ddc, (2 - WSA_DDC_PASSBAND) * nyquist 
+				+ (0.5 - (2 - WSA_DDC_PASSBAND) * nyquist) * i / DDC_TEST_STEPS);
+			if (response > stopband)
+				stopband = response;
+		}
+		test_check(stopband <= -WSA_DDC_STOPBAND_ATTENUATION, fail_count, pass_count);
+
+		// a tone in the passband comes through at its level, one that 
+		// would alias into the passband doesn't
+		nyquist *= DDC_TEST_RATE;
+		test_check(fabs(ddc_test_tone(ddc, (DDC_TEST_RATE / 4) + (0.6 * nyquist), 
+			idata, out, DDC_TEST_LEN)) < 0.01, fail_count, pass_count);
+		test_check(ddc_test_tone(ddc, (DDC_TEST_RATE / 4) + (1.5 * nyquist), 
+			idata, out, DDC_TEST_LEN) < -WSA_DDC_STOPBAND_ATTENUATION, fail_count, pass_count);
+
+		wsa_ddc_free(ddc);
+	}
+
+	free(idata);
+	free(out);
+	return 0;
+}
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <wsa_api.h>
+#include <wsa_lib.h>
+#include <wsa_dsp.h>
+#include <wsa_fft.h>
+#include <wsa_error.h>
+
+#define FIXED_TEST_FFTLEN 1024
+#define FIXED_TEST_SEGMENTS 7
+#define FIXED_TEST_STRONG_BIN 100
+#define FIXED_TEST_WEAK_BIN 300
+
+// compares a fixed point spectrum with the floating point one at the two 
+// tones, in dB, and counts the comparison as a pass or a fail
+static void fixed_point_compare(kiss_fft_scalar *fixed, kiss_fft_scalar *reference, 
+		float strong_tolerance, float weak_tolerance, int32_t *fail_count, int32_t *pass_count)
+{
+	float strong = 10 * log10f(fixed[FIXED_TEST_STRONG_BIN] / reference[FIXED_TEST_STRONG_BIN]);
+	float weak = 10 * log10f(fixed[FIXED_TEST_WEAK_BIN] / reference[FIXED_TEST_WEAK_BIN]);
+
+	if (psd_max_index(fixed, FIXED_TEST_FFTLEN / 2) != FIXED_TEST_STRONG_BIN 
+		|| fabsf(strong) > strong_tolerance || fabsf(weak) > weak_tolerance)
+		*fail_count = *fail_count + 1;
+	else
+		*pass_count = *pass_count + 1;
+}
+
+// computes the spectrum of a synthetic block holding a strong and a 
+// 60 dB weaker tone with the floating point fft and both fixed point 
+// ffts, from 16 bit and from 32 bit (HDR) samples, and checks that they 
+// agree at the tones
+// results are stored in the pass/fail count variables
+int16_t fixed_point_tests(int32_t *fail_count, int32_t *pass_count){
+
+	int32_t fftlen = FIXED_TEST_FFTLEN;
+	int32_t hop = FIXED_TEST_FFTLEN / 2;
+	int32_t len = hop * (FIXED_TEST_SEGMENTS + 1);
+	int16_t *i16data = malloc(sizeof(int16_t) * len);
+	int32_t *i32data = malloc(sizeof(int32_t) * len);
+	int16_t *window = malloc(sizeof(int16_t) * fftlen);
+	kiss_fft_scalar *scalar_window = malloc(sizeof(kiss_fft_scalar) * fftlen);
+	kiss_fft_scalar *idata = malloc(sizeof(kiss_fft_scalar) * len);
+	kiss_fft_scalar *segment = malloc(sizeof(kiss_fft_scalar) * fftlen);
+	kiss_fft_cpx *fftout = malloc(sizeof(kiss_fft_cpx) * (fftlen / 2 + 1));
+	int32_t *fixed_segment = malloc(sizeof(int32_t) * fftlen);
+	int32_t *fixed_fftout = malloc(sizeof(int32_t) * (fftlen + 2));
+	kiss_fft_scalar reference[FIXED_TEST_FFTLEN / 2];
+	kiss_fft_scalar fixed[FIXED_TEST_FFTLEN / 2];
+	struct wsa_fft_plan *plan;
+	int32_t result;
+	int32_t i;
+
+	if (!i16data || !i32data || !window || !scalar_window || !idata || !segment || !fftout || !fixed_segment || !fixed_fftout) {
+		*fail_count = *fail_count + 1;
+		return WSA_ERR_MALLOCFAILED;
+	}
+
+	// half of full scale (8192), and a tone 60 dB below it
+	for (i = 0; i < len; i++) {
+		i16data[i] = (int16_t) floor(0.5 + 4096 * cos(2 * M_PI * FIXED_TEST_STRONG_BIN * i / fftlen)
+			+ 4 * cos(2 * M_PI * FIXED_TEST_WEAK_BIN * i / fftlen));
+		idata[i] = (kiss_fft_scalar) i16data[i] / 8192;
+
+		// the same samples at the 32 bit full scale (8388608)
+		i32data[i] = (int32_t) i16data[i] * 1024;
+	}
+	window_hanning_fixed(window, fftlen);
+	window_hanning_table(scalar_window, fftlen);
+
+	// the floating point reference
+	plan = wsa_fft_plan_new(fftlen, WSA_FFT_REAL);
+	result = psd_welch_accumulate(plan, idata, scalar_window, fftlen, hop, 0, FIXED_TEST_SEGMENTS, segment, fftout, reference);
+	wsa_fft_plan_free(plan);
+	if (result != FIXED_TEST_SEGMENTS)
+		*fail_count = *fail_count + 1;
+	else
+		*pass_count = *pass_count + 1;
+
+	// the 32 bit fft matches floating point
+	plan = wsa_fft_plan_new(fftlen, WSA_FFT_REAL_FIXED32);
+	result = psd_welch_accumulate_fixed(plan, i16data, NULL, window, fftlen, hop, 0, FIXED_TEST_SEGMENTS, 
+		fixed_segment, fixed_fftout, fixed);
+	wsa_fft_plan_free(plan);
+	if (result != FIXED_TEST_SEGMENTS)
+		*fail_count = *fail_count + 1;
+	else
+		fixed_point_compare(fixed, reference, 0.01f, 0.1f, fail_count, pass_count);
+
+	// the 16 bit fft rounds more, but still sees the weak tone
+	plan = wsa_fft_plan_new(fftlen, WSA_FFT_REAL_FIXED16);
+	result = psd_welch_accumulate_fixed(plan, i16data, NULL, window, fftlen, hop, 0, FIXED_TEST_SEGMENTS, 
+		fixed_segment, fixed_fftout, fixed);
+	wsa_fft_plan_free(plan);
+	if (result != FIXED_TEST_SEGMENTS)
+		*fail_count = *fail_count + 1;
+	else
+		fixed_point_compare(fixed, reference, 0.05f, 1.0f, fail_count, pass_count);
+
+	// and both do the same with 32 bit samples
+	plan = wsa_fft_plan_new(fftlen, WSA_FFT_REAL_FIXED32);
+	result = psd_welch_accumulate_fixed(plan, NULL, i32data, window, fftlen, hop, 0, FIXED_TEST_SEGMENTS, 
+		fixed_segment, fixed_fftout, fixed);
+	wsa_fft_plan_free(plan);
+	if (result != FIXED_TEST_SEGMENTS)
+		*fail_count = *fail_count + 1;
+	else
+		fixed_point_compare(fixed, reference, 0.01f, 0.1f, fail_count, pass_count);
+
+	plan = wsa_fft_plan_new(fftlen, WSA_FFT_REAL_FIXED16);
+	result = psd_welch_accumulate_fixed(plan, NULL, i32data, window, fftlen, hop, 0, FIXED_TEST_SEGMENTS, 
+		fixed_segment, fixed_fftout, fixed);
+	wsa_fft_plan_free(plan);
+	if (result != FIXED_TEST_SEGMENTS)
+		*fail_count = *fail_count + 1;
+	else
+		fixed_point_compare(fixed, reference, 0.05f, 1.0f, fail_count, pass_count);
+
+	free(fixed_fftout);
+	free(fixed_segment);
+	free(fftout);
+	free(segment);
+	free(idata);
+	free(window);
+	free(scalar_window);
+	free(i32data);
+	free(i16data);
+	return 0;
+}
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <wsa_api.h>
+#include <wsa_lib.h>
+#include <wsa_dsp.h>
+#include <wsa_error.h>
+#include <test_check.h>
+
+#define IQ_TEST_LEN 4096
+#define IQ_TEST_BIN 64
+#define IQ_TEST_AMPLITUDE 0.5
+#define IQ_TEST_DC_I 0.02
+#define IQ_TEST_DC_Q -0.03
+#define IQ_TEST_GAIN 1.2
+#define IQ_TEST_PHASE (5 * M_PI / 180)
+
+/// what a corrected block is measured as
+struct iq_test_result {
+	double dc_i;
+	double dc_q;
+
+	/// the power of the image of the tone relative to the tone, in dB
+	double image;
+
+	/// the correlation coefficient of I and Q
+	double correlation;
+};
+
+// fills a block with a tone a whole number of cycles long, with a DC 
+// offset on both channels and Q too strong and skewed in phase
+static void iq_test_block(kiss_fft_scalar *idata, kiss_fft_scalar *qdata)
+{
+	double w;
+	int32_t n;
+
+	for (n = 0; n < IQ_TEST_LEN; n++) {
+		w = 2 * M_PI * IQ_TEST_BIN * n / IQ_TEST_LEN;
+		idata[n] = (kiss_fft_scalar) (IQ_TEST_AMPLITUDE * cos(w) + IQ_TEST_DC_I);
+		qdata[n] = (kiss_fft_scalar) (IQ_TEST_GAIN * IQ_TEST_AMPLITUDE * sin(w + IQ_TEST_PHASE) + IQ_TEST_DC_Q);
+	}
+}
+
+// measures the DC offsets of a block, the image of its tone and the 
+// correlation of I and Q
+static void iq_test_measure(kiss_fft_scalar const *idata, kiss_fft_scalar const *qdata, 
+		struct iq_test_result *result)
+{
+	double tone_r = 0, tone_i = 0, image_r = 0, image_i = 0;
+	double ii = 0, qq = 0, iq = 0;
+	double i, q, c, s;
+	int32_t n;
+
+	result->dc_i = 0;
+	result->dc_q = 0;
+	for (n = 0; n < IQ_TEST_LEN; n++) {
+		result->dc_i += idata[n];
+		result->dc_q += qdata[n];
+	}
+	result->dc_i /= IQ_TEST_LEN;
+	result->dc_q /= IQ_TEST_LEN;
+
+	// the dft of I + jQ at the tone and at its image
+	for (n = 0; n < IQ_TEST_LEN; n++) {
+		i = idata[n] - result->dc_i;
+		q = qdata[n] - result->dc_q;
+		c = cos(2 * M_PI * IQ_TEST_BIN * n / IQ_TEST_LEN);
+		s = sin(2 * M_PI * IQ_TEST_BIN * n / IQ_TEST_LEN);
+		tone_r += (i * c) + (q * s);
+		tone_i += (q * c) - (i * s);
+		image_r += (i * c) - (q * s);
+		image_i += (q * c) + (i * s);
+		ii += i * i;
+		qq += q * q;
+		iq += i * q;
+	}
+
+	result->image = 10 * log10(((image_r * image_r) + (image_i * image_i)) / ((tone_r * tone_r) + (tone_i * tone_i)));
+	result->correlation = iq / sqrt(ii * qq);
+}
+
+// checks that a corrected block has no DC offset, no image and 
+// uncorrelated I and Q
+static void iq_test_check(struct iq_test_result const *result, double image, 
+		int32_t *fail_count, int32_t *pass_count)
+{
+	test_check(fabs(result->dc_i) < 1e-4 && fabs(result->dc_q) < 1e-4, fail_count, pass_count);
+	test_check(result->image < image, fail_count, pass_count);
+	test_check(fabs(result->correlation) < 1e-3, fail_count, pass_count);
+}
+
+// feeds a tone with a known DC offset, gain imbalance and phase skew to 
+// psd_iq_correct and psd_iq_correct_i16, and checks that the corrected 
+// tone has lost its image and DC offset and that I and Q come out 
+// uncorrelated, both for the first block after a reset and for a block 
+// corrected with the estimates of the one before it
+// results are stored in the pass/fail count variables
+int16_t iq_correction_tests(int32_t *fail_count, int32_t *pass_count){
+
+	kiss_fft_scalar *idata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * IQ_TEST_LEN);
+	kiss_fft_scalar *qdata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * IQ_TEST_LEN);
+	int16_t *i16_buffer = (int16_t *) malloc(sizeof(int16_t) * IQ_TEST_LEN);
+	int16_t *q16_buffer = (int16_t *) malloc(sizeof(int16_t) * IQ_TEST_LEN);
+	struct psd_iq_corrector corrector;
+	struct iq_test_result result;
+	int32_t n;
+
+	if (idata == NULL || qdata == NULL || i16_buffer == NULL || q16_buffer == NULL) {
+		free(idata);
+		free(qdata);
+		free(i16_buffer);
+		free(q16_buffer);
+		*fail_count = *fail_count + 1;
+		return WSA_ERR_MALLOCFAILED;
+	}
+
+	// the imbalance puts an image about 20 dB below the tone
+	iq_test_block(idata, qdata);
+	iq_test_measure(idata, qdata, &result);
+	test_check(result.image > -30 && fabs(result.correlation) > 0.05, fail_count, pass_count);
+
+	psd_iq_corrector_init(&corrector, 1);
+	psd_iq_correct(&corrector, idata, qdata, IQ_TEST_LEN);
+	iq_test_measure(idata, qdata, &result);
+	iq_test_check(&result, -100, fail_count, pass_count);
+
+	iq_test_block(idata, qdata);
+	psd_iq_correct(&corrector, idata, qdata, IQ_TEST_LEN);
+	iq_test_measure(idata, qdata, &result);
+	iq_test_check(&result, -100, fail_count, pass_count);
+
+	// the same block as 16 bit samples (full scale 8192)
+	iq_test_block(idata, qdata);
+	for (n = 0; n < IQ_TEST_LEN; n++) {
+		i16_buffer[n] = (int16_t) floor(0.5 + idata[n] * 8192);
+		q16_buffer[n] = (int16_t) floor(0.5 + qdata[n] * 8192);
+	}
+
+	psd_iq_corrector_reset(&corrector);
+	psd_iq_correct_i16(&corrector, i16_buffer, q16_buffer, 8192, idata, qdata, IQ_TEST_LEN);
+	iq_test_measure(idata, qdata, &result);
+	iq_test_check(&result, -100, fail_count, pass_count);
+
+	psd_iq_correct_i16(&corrector, i16_buffer, q16_buffer, 8192, idata, qdata, IQ_TEST_LEN);
+	iq_test_measure(idata, qdata, &result);
+	iq_test_check(&result, -100, fail_count, pass_count);
+
+	free(idata);
+	free(qdata);
+	free(i16_buffer);
+	free(q16_buffer);
+	return 0;
+}
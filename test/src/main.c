@@ -7,6 +7,14 @@
 #include <wsa_sweep_device.h>
 #include <wsa_error.h>
 #include <attenuation_tests.h>
+#include <fixed_point_tests.h>
+#include <spectrum_index_tests.h>
+#include <peak_search_tests.h>
+#include <mask_tests.h>
+#include <pack_tests.h>
+#include <ddc_tests.h>
+#include <iq_correction_tests.h>
+#include <tone_monitor_tests.h>
 
 
 /**
@@ -22,6 +30,8 @@ int32_t main(int32_t argc, char *argv[])
 	int i;
 	int32_t fail_count = 0;
 	int32_t pass_count = 0;
+	int32_t suite_fail = 0;
+	int32_t suite_pass = 0;
 
 	// initialize WSA settings
 	int32_t attenuator = 0;
@@ -34,6 +44,56 @@ int32_t main(int32_t argc, char *argv[])
 	// initialize sweep device
 	struct wsa_sweep_device wsa_Sweep_device;
 	struct wsa_sweep_device *wsa_sweep_dev = &wsa_Sweep_device;
+
+	// DSP TESTS: these work on synthetic data, no device needed
+	suite_fail = suite_pass = 0;
+	result = fixed_point_tests(&suite_fail, &suite_pass);
+	printf("FIXED POINT TEST RESULTS: %d Tests, %d Passes, %d Fails\n", suite_fail + suite_pass, suite_pass, suite_fail);
+	fail_count += suite_fail;
+	pass_count += suite_pass;
+
+	suite_fail = suite_pass = 0;
+	result = spectrum_index_tests(&suite_fail, &suite_pass);
+	printf("SPECTRUM INDEX TEST RESULTS: %d Tests, %d Passes, %d Fails\n", suite_fail + suite_pass, suite_pass, suite_fail);
+	fail_count += suite_fail;
+	pass_count += suite_pass;
+
+	suite_fail = suite_pass = 0;
+	result = peak_search_tests(&suite_fail, &suite_pass);
+	printf("PEAK SEARCH TEST RESULTS: %d Tests, %d Passes, %d Fails\n", suite_fail + suite_pass, suite_pass, suite_fail);
+	fail_count += suite_fail;
+	pass_count += suite_pass;
+
+	suite_fail = suite_pass = 0;
+	result = mask_tests(&suite_fail, &suite_pass);
+	printf("MASK TEST RESULTS: %d Tests, %d Passes, %d Fails\n", suite_fail + suite_pass, suite_pass, suite_fail);
+	fail_count += suite_fail;
+	pass_count += suite_pass;
+
+	suite_fail = suite_pass = 0;
+	result = pack_tests(&suite_fail, &suite_pass);
+	printf("PACK TEST RESULTS: %d Tests, %d Passes, %d Fails\n", suite_fail + suite_pass, suite_pass, suite_fail);
+	fail_count += suite_fail;
+	pass_count += suite_pass;
+
+	suite_fail = suite_pass = 0;
+	result = ddc_tests(&suite_fail, &suite_pass);
+	printf("DDC TEST RESULTS: %d Tests, %d Passes, %d Fails\n", suite_fail + suite_pass, suite_pass, suite_fail);
+	fail_count += suite_fail;
+	pass_count += suite_pass;
+
+	suite_fail = suite_pass = 0;
+	result = iq_correction_tests(&suite_fail, &suite_pass);
+	printf("IQ CORRECTION TEST RESULTS: %d Tests, %d Passes, %d Fails\n", suite_fail + suite_pass, suite_pass, suite_fail);
+	fail_count += suite_fail;
+	pass_count += suite_pass;
+
+	suite_fail = suite_pass = 0;
+	result = tone_monitor_tests(&suite_fail, &suite_pass);
+	printf("TONE MONITOR TEST RESULTS: %d Tests, %d Passes, %d Fails\n", suite_fail + suite_pass, suite_pass, suite_fail);
+	fail_count += suite_fail;
+	pass_count += suite_pass;
+
 	sprintf(intf_str, "TCPIP::%s", wsa_addr);
     dev = &wsa_dev; // create device pointer
 	result = wsa_open(dev, intf_str); 
@@ -43,8 +103,11 @@ int32_t main(int32_t argc, char *argv[])
 	result = wsa_system_request_acq_access(dev, &acq_result);
 
 	// ATTENUATION TESTS: Test attenuation for all 4 valid values (0, 10, 20, 30)
-	result = attenuation_tests(dev, &fail_count, &pass_count);
-	printf("ATTENATION TEST RESULTS: %d Tests, %d Passes, %d Fails", fail_count + pass_count, pass_count, fail_count);
+	suite_fail = suite_pass = 0;
+	result = attenuation_tests(dev, &suite_fail, &suite_pass);
+	printf("ATTENATION TEST RESULTS: %d Tests, %d Passes, %d Fails", suite_fail + suite_pass, suite_pass, suite_fail);
+	fail_count += suite_fail;
+	pass_count += suite_pass;
 
 	printf("TOTAL TEST RESULTS: %d Tests, %d Passes, %d Fails", fail_count + pass_count, pass_count, fail_count);
 	return 0;
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <wsa_api.h>
+#include <wsa_lib.h>
+#include <wsa_mask.h>
+#include <wsa_error.h>
+#include <test_check.h>
+
+#define MASK_TEST_BINS 1000
+#define MASK_TEST_FSTOP 1000000
+
+// checks one run of failing bins; the axis has 1 kHz bins from 0 Hz
+static int mask_test_run(struct wsa_mask_violation *run, uint32_t start_bin, uint32_t stop_bin, 
+		uint32_t limits, uint32_t worst_bin, float worst_margin)
+{
+	return run->start_bin == start_bin && run->stop_bin == stop_bin 
+		&& run->fstart == start_bin * 1000ULL && run->fstop == stop_bin * 1000ULL
+		&& run->limits == limits && run->worst_bin == worst_bin 
+		&& fabsf(run->worst_margin - worst_margin) < 0.001f;
+}
+
+// checks a spectrum against a mask with a stepped and sloped upper line
+// and a lower line over part of the span
+// results are stored in the pass/fail count variables
+int16_t mask_tests(int32_t *fail_count, int32_t *pass_count){
+
+	struct wsa_mask_point upper[] = {{0, -20.0f}, {500000, -20.0f}, {600000, -60.0f}, {999000, -60.0f}};
+	struct wsa_mask_point lower[] = {{200000, -90.0f}, {300000, -90.0f}};
+	struct wsa_mask_point backwards[] = {{600000, -20.0f}, {500000, -20.0f}};
+	struct wsa_mask_violation runs[8];
+	float spectrum[MASK_TEST_BINS];
+	struct wsa_mask *mask = wsa_mask_new();
+	uint32_t count;
+	float worst;
+	int16_t result;
+	uint32_t i;
+
+	if (mask == NULL) {
+		*fail_count = *fail_count + 1;
+		return WSA_ERR_MALLOCFAILED;
+	}
+
+	// lines must go up in frequency, and the mask be compiled before a check
+	result = wsa_mask_set_limit(mask, WSA_MASK_UPPER, backwards, 2);
+	test_check(result == WSA_ERR_INVMASK, fail_count, pass_count);
+
+	wsa_mask_set_limit(mask, WSA_MASK_UPPER, upper, 4);
+	wsa_mask_set_limit(mask, WSA_MASK_LOWER, lower, 2);
+	for (i = 0; i < MASK_TEST_BINS; i++)
+		spectrum[i] = -80.0f;
+	result = wsa_mask_check(mask, spectrum, runs, 8, &count, &worst);
+	test_check(result == WSA_ERR_INVMASK, fail_count, pass_count);
+
+	// a spectrum inside the mask: closest to the lower line, by 10 dB
+	result = wsa_mask_compile(mask, 0, MASK_TEST_FSTOP, MASK_TEST_BINS);
+	test_check(result == 0, fail_count, pass_count);
+	result = wsa_mask_check(mask, spectrum, runs, 8, &count, &worst);
+	test_check(result == 0 && count == 0 && fabsf(worst - 10.0f) < 0.001f, fail_count, pass_count);
+
+	// over the upper line, under the lower line, over the slope (-40 dBm
+	// at 550 kHz, 0.4 dB lower every bin) and just over the end of the 
+	// line; under -90 dBm where there is no lower line is fine
+	for (i = 100; i <= 104; i++)
+		spectrum[i] = -10.0f + ((i == 102) ? 5.0f : 0.0f);
+	spectrum[250] = -95.0f;
+	spectrum[251] = -92.0f;
+	for (i = 550; i <= 552; i++)
+		spectrum[i] = -35.0f;
+	spectrum[700] = -59.0f;
+	spectrum[400] = -95.0f;
+
+	result = wsa_mask_check(mask, spectrum, runs, 8, &count, &worst);
+	test_check(result == 0 && count == 4 && fabsf(worst + 15.0f) < 0.001f, fail_count, pass_count);
+	if (result == 0 && count == 4) {
+		test_check(mask_test_run(&runs[0], 100, 104, WSA_MASK_UPPER, 102, -15.0f), fail_count, pass_count);
+		test_check(mask_test_run(&runs[1], 250, 251, WSA_MASK_LOWER, 250, -5.0f), fail_count, pass_count);
+		test_check(mask_test_run(&runs[2], 550, 552, WSA_MASK_UPPER, 552, -5.8f), fail_count, pass_count);
+		test_check(mask_test_run(&runs[3], 700, 700, WSA_MASK_UPPER, 700, -1.0f), fail_count, pass_count);
+	}
+
+	// every run is counted, but only as many as fit are stored
+	memset(runs, 0, sizeof(runs));
+	result = wsa_mask_check(mask, spectrum, runs, 2, &count, &worst);
+	test_check(result == 0 && count == 4 && runs[1].start_bin == 250 && runs[2].start_bin == 0, 
+		fail_count, pass_count);
+
+	wsa_mask_free(mask);
+	return 0;
+}
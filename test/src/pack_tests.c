@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <wsa_api.h>
+#include <wsa_lib.h>
+#include <wsa_dsp.h>
+#include <wsa_error.h>
+#include <test_check.h>
+
+#define PACK_TEST_BINS 4096
+
+// finds the largest difference between two spectra, in dB
+static float pack_test_error(float const *a, float const *b, uint32_t len)
+{
+	float error = 0;
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		error = (fabsf(a[i] - b[i]) > error) ? fabsf(a[i] - b[i]) : error;
+
+	return error;
+}
+
+// packs and unpacks spectra in 16 bit centi-dB and in 8 bits, checking
+// the round trip error against the documented bounds and the clamping
+// results are stored in the pass/fail count variables
+int16_t pack_tests(int32_t *fail_count, int32_t *pass_count){
+
+	float *spectrum = (float *) malloc(sizeof(float) * PACK_TEST_BINS);
+	float *unpacked = (float *) malloc(sizeof(float) * PACK_TEST_BINS);
+	int16_t *cdb16 = (int16_t *) malloc(sizeof(int16_t) * PACK_TEST_BINS);
+	uint8_t *u8 = (uint8_t *) malloc(sizeof(uint8_t) * PACK_TEST_BINS);
+	float clamped[4] = {400.0f, -400.0f, 327.67f, -327.68f};
+	float offset, scale;
+	uint32_t i;
+
+	if (spectrum == NULL || unpacked == NULL || cdb16 == NULL || u8 == NULL) {
+		free(spectrum);
+		free(unpacked);
+		free(cdb16);
+		free(u8);
+		*fail_count = *fail_count + 1;
+		return WSA_ERR_MALLOCFAILED;
+	}
+
+	// levels all over the centi-dB range, off the 0.01 dB grid
+	for (i = 0; i < PACK_TEST_BINS; i++)
+		spectrum[i] = 320.0f * (float) sin(i * 0.377) + 0.0037f * (i % 7);
+
+	psd_pack_cdb16(spectrum, PACK_TEST_BINS, cdb16);
+	psd_unpack_cdb16(cdb16, PACK_TEST_BINS, unpacked);
+	test_check(pack_test_error(spectrum, unpacked, PACK_TEST_BINS) <= 0.005f + 1e-4f, 
+		fail_count, pass_count);
+
+	// levels outside the range are clamped to its ends, which are kept
+	psd_pack_cdb16(clamped, 4, cdb16);
+	test_check(cdb16[0] == 32767 && cdb16[1] == -32768 && cdb16[2] == 32767 && cdb16[3] == -32768, 
+		fail_count, pass_count);
+
+	// a noise floor between -116 and -104 dBm with a few signals at -40 dBm:
+	// 0 and 255 are the ends of the spectrum
+	for (i = 0; i < PACK_TEST_BINS; i++)
+		spectrum[i] = -110.0f + 6.0f * (float) sin(i * 1.13);
+	for (i = 100; i < PACK_TEST_BINS; i += 512)
+		spectrum[i] = -40.0f;
+	spectrum[7] = -116.0f;
+
+	psd_u8_range(spectrum, PACK_TEST_BINS, &offset, &scale);
+	test_check(offset == -116.0f && fabsf(scale - (76.0f / 255)) < 1e-6f, fail_count, pass_count);
+	psd_pack_u8(spectrum, PACK_TEST_BINS, offset, scale, u8);
+	psd_unpack_u8(u8, PACK_TEST_BINS, offset, scale, unpacked);
+	test_check(pack_test_error(spectrum, unpacked, PACK_TEST_BINS) <= (scale / 2) + 1e-4f, 
+		fail_count, pass_count);
+
+	// levels outside the range are clamped to its ends
+	clamped[0] = offset - 10.0f;
+	clamped[1] = offset + (300 * scale);
+	psd_pack_u8(clamped, 2, offset, scale, u8);
+	test_check(u8[0] == 0 && u8[1] == 255, fail_count, pass_count);
+
+	// a flat spectrum gets the finest step, and comes back exactly
+	for (i = 0; i < PACK_TEST_BINS; i++)
+		spectrum[i] = -87.5f;
+
+	psd_u8_range(spectrum, PACK_TEST_BINS, &offset, &scale);
+	test_check(offset == -87.5f && scale == PSD_U8_MIN_SCALE, fail_count, pass_count);
+	psd_pack_u8(spectrum, PACK_TEST_BINS, offset, scale, u8);
+	psd_unpack_u8(u8, PACK_TEST_BINS, offset, scale, unpacked);
+	test_check(pack_test_error(spectrum, unpacked, PACK_TEST_BINS) == 0, fail_count, pass_count);
+
+	free(spectrum);
+	free(unpacked);
+	free(cdb16);
+	free(u8);
+	return 0;
+}
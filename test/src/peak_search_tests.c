@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <wsa_api.h>
+#include <wsa_lib.h>
+#include <wsa_dsp.h>
+#include <wsa_error.h>
+#include <test_check.h>
+
+#define PEAK_TEST_BINS 1024
+#define PEAK_TEST_FSTART 1000000000ULL
+#define PEAK_TEST_BIN_WIDTH 1000.0
+
+// adds a tone whose shape is a parabola in dB (a gaussian in linear 
+// power), so that gaussian interpolation finds its exact position
+static void peak_test_tone(float *spectrum, double position, float level)
+{
+	float value;
+	uint32_t i;
+
+	for (i = 0; i < PEAK_TEST_BINS; i++) {
+		value = (float) (level - 3 * (i - position) * (i - position));
+		if (value > spectrum[i])
+			spectrum[i] = value;
+	}
+}
+
+// checks that a peak is at a position, in bins, and a level
+static int peak_test_at(struct psd_peak *peak, double position, float level, double tolerance)
+{
+	double expected = PEAK_TEST_FSTART + (position * PEAK_TEST_BIN_WIDTH);
+
+	return fabs(peak->freq - expected) < tolerance * PEAK_TEST_BIN_WIDTH 
+		&& fabsf(peak->power - level) < (float) tolerance;
+}
+
+// searches a synthetic spectrum holding tones of known position and 
+// level for its peaks
+// results are stored in the pass/fail count variables
+int16_t peak_search_tests(int32_t *fail_count, int32_t *pass_count){
+
+	float spectrum[PEAK_TEST_BINS];
+	struct psd_peak peaks[8];
+	uint64_t fstop = PEAK_TEST_FSTART + (uint64_t) (PEAK_TEST_BINS * PEAK_TEST_BIN_WIDTH);
+	uint32_t count;
+	int16_t result;
+	uint32_t i;
+
+	// a -100 dBm floor, tones between bins, a tone at the first bin and a
+	// 3 dB bump on the floor
+	for (i = 0; i < PEAK_TEST_BINS; i++)
+		spectrum[i] = -100.0f;
+	peak_test_tone(spectrum, 100.3, -10.0f);
+	peak_test_tone(spectrum, 300.25, -30.0f);
+	peak_test_tone(spectrum, 310.0, -20.0f);
+	peak_test_tone(spectrum, 0.0, -40.0f);
+	spectrum[600] = -97.0f;
+
+	// strongest first, interpolated to the tone, the bump doesn't stand 
+	// out by 6 dB and the edge counts as falling enough
+	result = psd_peak_search(PEAK_TEST_FSTART, fstop, PEAK_TEST_BINS, spectrum, -99.0f, 6.0f, 0, 
+		PSD_PEAK_INTERP_GAUSSIAN, 8, peaks, &count);
+	test_check(result == 0 && count == 4, fail_count, pass_count);
+	if (result == 0 && count == 4) {
+		test_check(peak_test_at(&peaks[0], 100.3, -10.0f, 0.001), fail_count, pass_count);
+		test_check(peak_test_at(&peaks[1], 310.0, -20.0f, 0.001), fail_count, pass_count);
+		test_check(peak_test_at(&peaks[2], 300.25, -30.0f, 0.001), fail_count, pass_count);
+		test_check(peaks[3].bin == 0 && peak_test_at(&peaks[3], 0.0, -40.0f, 0.001), fail_count, pass_count);
+	}
+
+	// without an excursion the bump is a peak too
+	result = psd_peak_search(PEAK_TEST_FSTART, fstop, PEAK_TEST_BINS, spectrum, -99.0f, 0.0f, 0, 
+		PSD_PEAK_INTERP_NONE, 8, peaks, &count);
+	test_check(result == 0 && count == 5 && peaks[4].bin == 600, fail_count, pass_count);
+
+	// the tone 10 bins from a stronger one goes with a separation of 20
+	result = psd_peak_search(PEAK_TEST_FSTART, fstop, PEAK_TEST_BINS, spectrum, -99.0f, 6.0f, 20, 
+		PSD_PEAK_INTERP_GAUSSIAN, 8, peaks, &count);
+	test_check(result == 0 && count == 3 && peaks[0].bin == 100 && peaks[1].bin == 310 
+		&& peaks[2].bin == 0, fail_count, pass_count);
+
+	// the threshold and the number of peaks asked for limit the search
+	result = psd_peak_search(PEAK_TEST_FSTART, fstop, PEAK_TEST_BINS, spectrum, -25.0f, 6.0f, 0, 
+		PSD_PEAK_INTERP_GAUSSIAN, 8, peaks, &count);
+	test_check(result == 0 && count == 2, fail_count, pass_count);
+	result = psd_peak_search(PEAK_TEST_FSTART, fstop, PEAK_TEST_BINS, spectrum, -99.0f, 6.0f, 0, 
+		PSD_PEAK_INTERP_GAUSSIAN, 1, peaks, &count);
+	test_check(result == 0 && count == 1 && peaks[0].bin == 100, fail_count, pass_count);
+
+	// parabolic interpolation of the linear power lands near the tone
+	result = psd_peak_search(PEAK_TEST_FSTART, fstop, PEAK_TEST_BINS, spectrum, -99.0f, 6.0f, 0, 
+		PSD_PEAK_INTERP_PARABOLIC, 1, peaks, &count);
+	test_check(result == 0 && count == 1 && peak_test_at(&peaks[0], 100.3, -10.0f, 0.3), fail_count, pass_count);
+
+	return 0;
+}
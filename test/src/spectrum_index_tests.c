@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <wsa_api.h>
+#include <wsa_lib.h>
+#include <wsa_dsp.h>
+#include <wsa_error.h>
+#include <test_check.h>
+
+#define INDEX_TEST_BINS 4096
+
+// fills a spectrum with a noise floor around -100 dBm and a -20 dBm 
+// channel 200 bins wide centered on center
+static void index_test_spectrum(float *spectrum, uint32_t len, uint32_t center)
+{
+	uint32_t seed = 12345;
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		spectrum[i] = -100.0f + (float) ((seed >> 16) % 1000) / 100.0f;
+		if (i + 100 >= center && i < center + 100)
+			spectrum[i] = -20.0f;
+	}
+}
+
+// compares the index's channel power, absolute power and acpr with the
+// direct sums over the same ranges
+static void index_power_tests(struct psd_spectrum_index *index, float *spectrum, 
+		int32_t *fail_count, int32_t *pass_count)
+{
+	uint32_t ranges[][2] = {{0, 1}, {0, INDEX_TEST_BINS}, {1000, 1100}, 
+		{1900, 2100}, {2099, 2101}, {4000, INDEX_TEST_BINS}, {INDEX_TEST_BINS - 2, INDEX_TEST_BINS - 1}};
+	uint32_t count = sizeof(ranges) / sizeof(ranges[0]);
+	float direct, indexed, acpr;
+	float direct_abs, direct_adj;
+	double indexed_abs;
+	int16_t result, index_result;
+	uint32_t r;
+
+	for (r = 0; r < count; r++) {
+		result = psd_calculate_channel_power(ranges[r][0], ranges[r][1], spectrum, INDEX_TEST_BINS, &direct);
+		index_result = psd_index_channel_power(index, ranges[r][0], ranges[r][1], &indexed);
+		test_check(result == 0 && index_result == 0 && fabsf(direct - indexed) < 0.001f, fail_count, pass_count);
+
+		result = psd_calculate_absolute_power(ranges[r][0], ranges[r][1], spectrum, INDEX_TEST_BINS, &direct_abs);
+		index_result = psd_index_absolute_power(index, ranges[r][0], ranges[r][1], &indexed_abs);
+		test_check(result == 0 && index_result == 0 && fabs(indexed_abs / direct_abs - 1) < 1e-4, fail_count, pass_count);
+	}
+
+	// the adjacent channel ratio is the difference of the channel powers
+	psd_calculate_channel_power(1900, 2100, spectrum, INDEX_TEST_BINS, &direct);
+	psd_calculate_channel_power(2100, 2300, spectrum, INDEX_TEST_BINS, &direct_adj);
+	result = psd_index_acpr(index, 1900, 2100, 2100, 2300, &acpr);
+	test_check(result == 0 && fabsf(acpr - (direct_adj - direct)) < 0.001f, fail_count, pass_count);
+
+	// and both reject the same ranges
+	result = psd_calculate_channel_power(100, 100, spectrum, INDEX_TEST_BINS, &direct);
+	index_result = psd_index_channel_power(index, 100, 100, &indexed);
+	test_check(result == WSA_ERR_INVCHPOWERRANGE && index_result == WSA_ERR_INVCHPOWERRANGE, fail_count, pass_count);
+
+	result = psd_calculate_channel_power(100, INDEX_TEST_BINS + 1, spectrum, INDEX_TEST_BINS, &direct);
+	index_result = psd_index_channel_power(index, 100, INDEX_TEST_BINS + 1, &indexed);
+	test_check(result == WSA_ERR_INVCHPOWERRANGE && index_result == WSA_ERR_INVCHPOWERRANGE, fail_count, pass_count);
+}
+
+// checks the occupied bandwidth of a spectrum whose power is all in 100
+// equal bins, 1000 to 1099, so each bin holds 1% of it
+static void index_obw_tests(struct psd_spectrum_index *index, float *spectrum, 
+		int32_t *fail_count, int32_t *pass_count)
+{
+	uint32_t obw_start, obw_stop;
+	uint64_t obw;
+	int16_t result;
+	uint32_t i;
+
+	for (i = 0; i < INDEX_TEST_BINS; i++)
+		spectrum[i] = (i >= 1000 && i < 1100) ? 0.0f : -200.0f;
+	result = psd_spectrum_index_build(index, spectrum, INDEX_TEST_BINS);
+	test_check(result == 0, fail_count, pass_count);
+
+	// 99% leaves 0.5% below the band, the first bin, and 0.5% above it,
+	// the last bin
+	result = psd_index_occupied_bandwidth(index, 0, INDEX_TEST_BINS, 99.0f, PSD_OBW_PERCENTILE, &obw_start, &obw_stop);
+	test_check(result == 0 && obw_start == 1000 && obw_stop == 1099, fail_count, pass_count);
+
+	// 80% runs from the bin the power reaches 10% in to the one it 
+	// reaches 90% in
+	result = psd_index_occupied_bandwidth(index, 0, INDEX_TEST_BINS, 80.0f, PSD_OBW_PERCENTILE, &obw_start, &obw_stop);
+	test_check(result == 0 && obw_start == 1009 && obw_stop == 1089, fail_count, pass_count);
+
+	// the symmetric band grows about bin 1050, the center of the range: 
+	// 1001 to 1099 is the narrowest that holds 98.5%
+	result = psd_index_occupied_bandwidth(index, 950, 1150, 98.5f, PSD_OBW_SYMMETRIC, &obw_start, &obw_stop);
+	test_check(result == 0 && obw_start == 1001 && obw_stop == 1099, fail_count, pass_count);
+
+	// and stops at the range when the power is off center
+	result = psd_index_occupied_bandwidth(index, 1000, 1400, 50.0f, PSD_OBW_SYMMETRIC, &obw_start, &obw_stop);
+	test_check(result == 0 && obw_start == 1050 && obw_stop == 1350, fail_count, pass_count);
+
+	// the band in Hz, with 1 kHz bins
+	result = psd_occupied_bandwidth(0, INDEX_TEST_BINS * 1000, INDEX_TEST_BINS, spectrum, 99.0f, PSD_OBW_PERCENTILE, &obw);
+	test_check(result == 0 && obw == 100000, fail_count, pass_count);
+
+	// invalid percentages and methods are rejected
+	result = psd_index_occupied_bandwidth(index, 0, INDEX_TEST_BINS, 0.0f, PSD_OBW_PERCENTILE, &obw_start, &obw_stop);
+	test_check(result == WSA_ERR_INVCHPOWERRANGE, fail_count, pass_count);
+	result = psd_index_occupied_bandwidth(index, 0, INDEX_TEST_BINS, 99.0f, 7, &obw_start, &obw_stop);
+	test_check(result == WSA_ERR_INVCHPOWERRANGE, fail_count, pass_count);
+}
+
+// builds a spectrum index of a synthetic spectrum and checks its queries
+// against the direct calculations
+// results are stored in the pass/fail count variables
+int16_t spectrum_index_tests(int32_t *fail_count, int32_t *pass_count){
+
+	float *spectrum = malloc(sizeof(float) * INDEX_TEST_BINS);
+	struct psd_spectrum_index *index = psd_spectrum_index_new(16);
+	int16_t result;
+
+	if (spectrum == NULL || index == NULL) {
+		*fail_count = *fail_count + 1;
+		free(spectrum);
+		psd_spectrum_index_free(index);
+		return WSA_ERR_MALLOCFAILED;
+	}
+
+	// the index grows to fit the spectrum
+	index_test_spectrum(spectrum, INDEX_TEST_BINS, 2000);
+	result = psd_spectrum_index_build(index, spectrum, INDEX_TEST_BINS);
+	test_check(result == 0 && index->len == INDEX_TEST_BINS, fail_count, pass_count);
+
+	if (result == 0)
+		index_power_tests(index, spectrum, fail_count, pass_count);
+
+	index_obw_tests(index, spectrum, fail_count, pass_count);
+
+	psd_spectrum_index_free(index);
+	free(spectrum);
+	return 0;
+}
@@ -0,0 +1,10 @@
+#include <test_check.h>
+
+// counts a check as a pass or a fail
+void test_check(int passed, int32_t *fail_count, int32_t *pass_count)
+{
+	if (passed)
+		*pass_count = *pass_count + 1;
+	else
+		*fail_count = *fail_count + 1;
+}
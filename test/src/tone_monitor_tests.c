@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <wsa_api.h>
+#include <wsa_lib.h>
+#include <wsa_tone_monitor.h>
+#include <wsa_error.h>
+#include <test_check.h>
+
+#define TONE_TEST_RATE 1000000.0
+#define TONE_TEST_LEN 4096
+#define TONE_TEST_TONES 3
+
+// fills a block with a strong tone on a bin, a weaker one between bins 
+// and, for I/Q samples, a third one at a negative frequency
+static void tone_test_block(double const *freqs, uint8_t iq, kiss_fft_scalar *idata, kiss_fft_scalar *qdata)
+{
+	double amplitudes[TONE_TEST_TONES] = {0.5, 0.05, 0.1};
+	double w;
+	int32_t n, t;
+
+	for (n = 0; n < TONE_TEST_LEN; n++) {
+		idata[n] = 0;
+		qdata[n] = 0;
+		for (t = 0; t < (iq ? TONE_TEST_TONES : TONE_TEST_TONES - 1); t++) {
+			w = 2 * M_PI * freqs[t] * n / TONE_TEST_RATE;
+			idata[n] += (kiss_fft_scalar) (amplitudes[t] * cos(w));
+			qdata[n] += (kiss_fft_scalar) (amplitudes[t] * sin(w));
+		}
+	}
+}
+
+// measures the tones of a block with goertzel filters and with an fft, 
+// and checks that both methods agree at every tone
+static void tone_test_compare(double const *freqs, uint8_t iq, kiss_fft_scalar *idata, kiss_fft_scalar *qdata, 
+		int32_t *fail_count, int32_t *pass_count)
+{
+	struct wsa_tone_monitor *monitor;
+	float goertzel[TONE_TEST_TONES];
+	float fft[TONE_TEST_TONES];
+	uint32_t tones = iq ? TONE_TEST_TONES : TONE_TEST_TONES - 1;
+	uint32_t t;
+	int16_t result;
+
+	monitor = wsa_tone_monitor_new(TONE_TEST_RATE, TONE_TEST_LEN, iq, freqs, tones);
+	if (monitor == NULL) {
+		*fail_count = *fail_count + 1;
+		return;
+	}
+
+	tone_test_block(freqs, iq, idata, qdata);
+
+	result = wsa_tone_monitor_set_method(monitor, WSA_TONE_GOERTZEL);
+	if (result >= 0)
+		result = wsa_tone_monitor_process(monitor, idata, qdata, TONE_TEST_LEN, 0, goertzel);
+	if (result >= 0)
+		result = wsa_tone_monitor_set_method(monitor, WSA_TONE_FFT);
+	if (result >= 0)
+		result = wsa_tone_monitor_process(monitor, idata, qdata, TONE_TEST_LEN, 0, fft);
+	test_check(result >= 0 && monitor->active_method == WSA_TONE_FFT, fail_count, pass_count);
+
+	for (t = 0; result >= 0 && t < tones; t++)
+		test_check(fabsf(goertzel[t] - fft[t]) < 0.01f, fail_count, pass_count);
+
+	wsa_tone_monitor_free(monitor);
+}
+
+// measures tones in real and I/Q blocks with both methods of the tone 
+// monitor, and checks that the goertzel filters agree with the fft power
+// at the monitored tones
+// results are stored in the pass/fail count variables
+int16_t tone_monitor_tests(int32_t *fail_count, int32_t *pass_count){
+
+	double bin = TONE_TEST_RATE / TONE_TEST_LEN;
+	double freqs[TONE_TEST_TONES];
+	kiss_fft_scalar *idata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * TONE_TEST_LEN);
+	kiss_fft_scalar *qdata = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * TONE_TEST_LEN);
+
+	if (idata == NULL || qdata == NULL) {
+		free(idata);
+		free(qdata);
+		*fail_count = *fail_count + 1;
+		return WSA_ERR_MALLOCFAILED;
+	}
+
+	freqs[0] = 300 * bin;
+	freqs[1] = 700.3 * bin;
+	freqs[2] = -1000.5 * bin;
+
+	tone_test_compare(freqs, 0, idata, qdata, fail_count, pass_count);
+	tone_test_compare(freqs, 1, idata, qdata, fail_count, pass_count);
+
+	free(idata);
+	free(qdata);
+	return 0;
+}